@@ -0,0 +1,336 @@
+// Packs CJK glyph sets into the font atlas pages with the skyline and the MaxRects packers,
+// and reports how many glyphs fit before the atlas is full and the cost per glyph.
+// Then times lookups of the glyph hash filled with CJK glyph keys at several sizes and phases,
+// and rasterizes the glyphs of the font, Roboto by default, with stb_truetype and the coverage rasterizer.
+// Last checks that glyphs larger than an atlas page are placed, the exit status is 1 if one is not.
+//
+//   bench [font.ttf [atlas size]]
+//
+// With a CJK font the glyph boxes are taken from the font at several sizes, otherwise they are
+// generated with the proportions of CJK text: mostly square ideographs with some kana and Latin.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FONTSTASH_IMPLEMENTATION
+#include "fontstash.h"
+
+#define BENCH_MAX_GLYPHS 65536
+#define BENCH_LOOKUPS 4000000
+#define BENCH_RASTER_GLYPHS 200
+
+struct BenchGlyph {
+	int w, h;
+};
+typedef struct BenchGlyph BenchGlyph;
+
+static unsigned int bench__seed = 12345;
+
+static int bench__rand(int n)
+{
+	bench__seed = bench__seed * 1103515245u + 12345u;
+	return (int)((bench__seed >> 8) % (unsigned int)n);
+}
+
+static double bench__now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int bench__fontGlyphs(const char* path, BenchGlyph* glyphs, int maxGlyphs)
+{
+	static const float sizes[] = { 12.0f, 14.0f, 16.0f, 20.0f, 24.0f, 32.0f };
+	FONSparams params;
+	FONScontext* fs;
+	int i, font, n = 0;
+
+	memset(&params, 0, sizeof(params));
+	params.width = 256;
+	params.height = 256;
+	params.flags = FONS_ZERO_TOPLEFT;
+	fs = fonsCreateInternal(&params);
+	if (fs == NULL) return 0;
+	font = fonsAddFont(fs, "cjk", path, 0);
+	if (font == FONS_INVALID) {
+		fonsDeleteInternal(fs);
+		return 0;
+	}
+	// Common ideographs, kana and Latin at each size, the glyph boxes include the padding.
+	for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+		unsigned int c;
+		short isize = (short)(sizes[i] * 10.0f);
+		for (c = 0; c < 2500 + 170 + 95 && n < maxGlyphs; c++) {
+			unsigned int cp = c < 2500 ? 0x4e00 + c : c < 2670 ? 0x3041 + (c - 2500) : 0x20 + (c - 2670);
+			FONSglyph* glyph = fons__getGlyph(fs, fs->fonts[font], cp, isize, 0, 0, FONS_GLYPH_BITMAP_OPTIONAL);
+			if (glyph == NULL || glyph->index == 0) continue;
+			glyphs[n].w = glyph->x1 - glyph->x0;
+			glyphs[n].h = glyph->y1 - glyph->y0;
+			n++;
+		}
+	}
+	fonsDeleteInternal(fs);
+	return n;
+}
+
+static int bench__synthGlyphs(BenchGlyph* glyphs, int maxGlyphs)
+{
+	static const int sizes[] = { 12, 14, 16, 20, 24, 32 };
+	int i, n = 0;
+	for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+		int j, s = sizes[i];
+		for (j = 0; j < 2765 && n < maxGlyphs; j++, n++) {
+			if (j < 2500) {
+				// Ideographs nearly fill the em square.
+				glyphs[n].w = s * (85 + bench__rand(14)) / 100 + 4;
+				glyphs[n].h = s * (80 + bench__rand(16)) / 100 + 4;
+			} else {
+				glyphs[n].w = s * (30 + bench__rand(35)) / 100 + 4;
+				glyphs[n].h = s * (45 + bench__rand(35)) / 100 + 4;
+			}
+		}
+	}
+	return n;
+}
+
+// Packs the glyphs in order into pages of an atlas like fons__allocGlyphRect, without evicting.
+static void bench__pack(const char* name, const BenchGlyph* glyphs, int nglyphs, int size, int maxRects)
+{
+	FONSatlas* pages[64];
+	int i, p, npages = 0, cur = 0, placed = 0, used = 0, rects = 0;
+	double t0, t, worst = 0.0, total = 0.0;
+
+	for (i = 0; i < size && npages < 64; i += FONS_PAGE_SIZE) {
+		int j;
+		for (j = 0; j < size && npages < 64; j += FONS_PAGE_SIZE)
+			pages[npages++] = fons__allocAtlas(FONS_PAGE_SIZE, FONS_PAGE_SIZE, FONS_INIT_ATLAS_NODES, maxRects);
+	}
+
+	for (i = 0; i < nglyphs; i++) {
+		int x, y, ok = 0;
+		t0 = bench__now();
+		if (fons__atlasAddRect(pages[cur], glyphs[i].w, glyphs[i].h, &x, &y)) {
+			ok = 1;
+		} else {
+			for (p = 0; p < npages && !ok; p++) {
+				if (p != cur && fons__atlasAddRect(pages[p], glyphs[i].w, glyphs[i].h, &x, &y)) {
+					cur = p;
+					ok = 1;
+				}
+			}
+		}
+		t = bench__now() - t0;
+		total += t;
+		if (t > worst) worst = t;
+		if (!ok) break;
+		placed++;
+	}
+
+	for (p = 0; p < npages; p++) {
+		used += pages[p]->used;
+		rects += maxRects ? pages[p]->nrects : pages[p]->nnodes;
+		fons__deleteAtlas(pages[p]);
+	}
+	printf("%-9s %6d glyphs  %5.1f%% used  %6.0f ns/glyph  %6.0f ns worst  %5d free spans\n", name, placed,
+		   100.0 * used / ((double)npages * FONS_PAGE_SIZE * FONS_PAGE_SIZE),
+		   placed > 0 ? total / (placed + 1) * 1e9 : 0.0, worst * 1e9, rects);
+}
+
+// Fills the glyph hash of a font with nkeys glyph keys and looks up random ones of them,
+// or keys not in the hash when miss is set.
+static void bench__lookup(int nkeys, int miss)
+{
+	static const short sizes[] = { 120, 140, 160, 200, 240, 320 };
+	FONSfont* font;
+	int* order;
+	int i, found = 0;
+	double t0, t;
+
+	font = (FONSfont*)calloc(1, sizeof(FONSfont));
+	order = (int*)malloc(sizeof(int) * BENCH_LOOKUPS);
+	if (font == NULL || order == NULL) {
+		free(font);
+		free(order);
+		return;
+	}
+	for (i = 0; i < nkeys; i++) {
+		FONSglyph* glyph = fons__allocGlyph(font);
+		if (glyph == NULL) break;
+		memset(glyph, 0, sizeof(FONSglyph));
+		glyph->codepoint = 0x4e00 + i / 12;
+		glyph->size = sizes[(i / 2) % 6];
+		glyph->phase = (short)(i % 2 * 6);
+		if (!fons__hashGlyph(font, font->nglyphs-1)) break;
+	}
+	nkeys = font->nglyphs;
+	for (i = 0; i < BENCH_LOOKUPS; i++)
+		order[i] = bench__rand(nkeys);
+	font->lookups = font->probes = font->maxProbe = 0;
+
+	t0 = bench__now();
+	for (i = 0; i < BENCH_LOOKUPS; i++) {
+		const FONSglyph* glyph = &font->glyphs[order[i]];
+		found += fons__findGlyph(font, glyph->codepoint + (miss ? 0x10000 : 0), glyph->size, glyph->blur, glyph->phase) != -1;
+	}
+	t = bench__now() - t0;
+
+	printf("%6d keys %-5s %6.1f ns/lookup  %5.2f mean probe  %3d max probe  %6d slots  %d found\n", nkeys,
+		   miss ? "miss" : "hit", t / BENCH_LOOKUPS * 1e9, (double)font->probes / font->lookups, font->maxProbe,
+		   font->cslots, found);
+
+	free(order);
+	free(font->glyphs);
+	free(font->slots);
+	free(font);
+}
+
+// Rasterizes up to BENCH_RASTER_GLYPHS glyphs of the font at each size with both rasterizers,
+// the way fons__renderGlyph does on the calling thread, and reports the time per glyph.
+static void bench__raster(const char* path)
+{
+	static const float sizes[] = { 12.0f, 24.0f, 48.0f, 96.0f, 192.0f };
+	int glyphs[BENCH_RASTER_GLYPHS];
+	FONSparams params;
+	FONScontext* fs;
+	FONSttFontImpl* impl;
+	unsigned char* bitmap;
+	unsigned int c;
+	int i, j, k, font, n = 0;
+
+	memset(&params, 0, sizeof(params));
+	params.width = 256;
+	params.height = 256;
+	params.flags = FONS_ZERO_TOPLEFT;
+	fs = fonsCreateInternal(&params);
+	if (fs == NULL) return;
+	font = fonsAddFont(fs, "raster", path, 0);
+	bitmap = (unsigned char*)malloc(512 * 512);
+	if (font == FONS_INVALID || bitmap == NULL) {
+		printf("\nCould not load %s for rasterizing.\n", path);
+		free(bitmap);
+		fonsDeleteInternal(fs);
+		return;
+	}
+	impl = &fs->fonts[font]->font;
+	// Printable ASCII, then ideographs if the font has them.
+	for (c = 0x21; c < 0x9fff && n < BENCH_RASTER_GLYPHS; c = c == 0x7e ? 0x4e00 : c + 1) {
+		int g = fons__tt_getGlyphIndex(impl, (int)c);
+		if (g != 0) glyphs[n++] = g;
+	}
+
+	printf("\nrasterizing %d glyphs of %s\n", n, path);
+	for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+		float scale = fons__tt_getPixelHeightScale(impl, sizes[i]);
+		double t[2];
+		int reps = sizes[i] < 50.0f ? 20 : 4;
+		for (k = 0; k < 2; k++) {
+			double t0 = bench__now();
+			for (j = 0; j < n * reps; j++) {
+				int advance, lsb, x0, y0, x1, y1, g = glyphs[j % n];
+				fs->nscratch = 0;
+				fons__tt_buildGlyphBitmap(impl, g, sizes[i], scale, 0.0f, &advance, &lsb, &x0, &y0, &x1, &y1);
+				if (x1 - x0 > 512 || y1 - y0 > 512) continue;
+				if (k == 0)
+					fons__tt_renderGlyphBitmap(impl, bitmap, x1 - x0, y1 - y0, 512, scale, scale, 0.0f, g);
+				else
+					fons__tt_renderGlyphCoverage(impl, bitmap, x1 - x0, y1 - y0, 512, scale, scale, 0.0f, g);
+			}
+			t[k] = (bench__now() - t0) / (n * reps);
+		}
+		printf("%5.0f px  stb %8.0f ns/glyph  coverage %8.0f ns/glyph  %4.2fx\n", sizes[i], t[0] * 1e9, t[1] * 1e9,
+			   t[0] / t[1]);
+	}
+
+	free(bitmap);
+	fonsDeleteInternal(fs);
+}
+
+// Places glyphs larger than a page, with and without blur, in a 1024x1024 atlas. Returns the number not placed.
+static int bench__large(const char* path)
+{
+	static const float sizes[] = { 100.0f, 200.0f, 300.0f, 400.0f, 600.0f };
+	static const float blurs[] = { 0.0f, 20.0f };
+	FONSparams params;
+	FONScontext* fs;
+	FONStextIter iter;
+	FONSquad q;
+	int i, j, font, failed = 0;
+
+	memset(&params, 0, sizeof(params));
+	params.width = 1024;
+	params.height = 1024;
+	params.flags = FONS_ZERO_TOPLEFT;
+	fs = fonsCreateInternal(&params);
+	if (fs == NULL) return 1;
+	font = fonsAddFont(fs, "large", path, 0);
+	if (font == FONS_INVALID) {
+		printf("\nCould not load %s for large glyphs.\n", path);
+		fonsDeleteInternal(fs);
+		return 1;
+	}
+
+	printf("\nglyphs larger than a page in a 1024x1024 atlas\n");
+	fonsSetFont(fs, font);
+	for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+		for (j = 0; j < (int)(sizeof(blurs) / sizeof(blurs[0])); j++) {
+			int placed = 0, n = 0;
+			fonsBeginFrame(fs);
+			fonsSetSize(fs, sizes[i]);
+			fonsSetBlur(fs, blurs[j]);
+			fonsTextIterInit(fs, &iter, 0, 0, "Wg", NULL, FONS_GLYPH_BITMAP_REQUIRED);
+			while (fonsTextIterNext(fs, &iter, &q)) {
+				n++;
+				if (iter.bitmap) placed++;
+			}
+			printf("%5.0f px  blur %2.0f  placed %d of %d\n", sizes[i], blurs[j], placed, n);
+			failed += n - placed;
+		}
+	}
+
+	fonsDeleteInternal(fs);
+	return failed;
+}
+
+int main(int argc, char** argv)
+{
+	BenchGlyph* glyphs;
+	int i, n, failed, size = argc > 2 ? atoi(argv[2]) : 1024;
+
+	glyphs = (BenchGlyph*)malloc(sizeof(BenchGlyph) * BENCH_MAX_GLYPHS);
+	if (glyphs == NULL) return 1;
+	n = argc > 1 ? bench__fontGlyphs(argv[1], glyphs, BENCH_MAX_GLYPHS) : 0;
+	if (argc > 1 && n == 0) {
+		printf("Could not load glyphs from %s.\n", argv[1]);
+		free(glyphs);
+		return 1;
+	}
+	if (n == 0)
+		n = bench__synthGlyphs(glyphs, BENCH_MAX_GLYPHS);
+
+	// Glyphs of mixed sizes arrive in text order.
+	for (i = n-1; i > 0; i--) {
+		int j = bench__rand(i+1);
+		BenchGlyph tmp = glyphs[i];
+		glyphs[i] = glyphs[j];
+		glyphs[j] = tmp;
+	}
+
+	printf("%d glyphs into a %dx%d atlas of %dx%d pages\n", n, size, size, FONS_PAGE_SIZE, FONS_PAGE_SIZE);
+	bench__pack("skyline", glyphs, n, size, 0);
+	bench__pack("maxrects", glyphs, n, size, 1);
+
+	printf("\nglyph hash, %d lookups\n", BENCH_LOOKUPS);
+	for (i = 1000; i <= 64000; i *= 4) {
+		bench__lookup(i, 0);
+		bench__lookup(i, 1);
+	}
+
+	bench__raster(argc > 1 ? argv[1] : "Roboto-Regular.ttf");
+	failed = bench__large(argc > 1 ? argv[1] : "Roboto-Regular.ttf");
+
+	free(glyphs);
+	return failed > 0 ? 1 : 0;
+}
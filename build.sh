@@ -1 +1 @@
-gcc -Wall -O1 -ggdb3 -o nvg nvg.c -lGLESv2 -lglfw -lm
+gcc -Wall -O1 -ggdb3 -o nvg nvg.c -lGLESv2 -lglfw -lm -pthread
@@ -19,11 +19,25 @@
 #ifndef FONS_H
 #define FONS_H
 
+#include <stddef.h>
+
 #define FONS_INVALID -1
+#define FONS_MAX_SUBPIXEL 4
 
 enum FONSflags {
 	FONS_ZERO_TOPLEFT = 1,
 	FONS_ZERO_BOTTOMLEFT = 2,
+	// Packs glyphs with MaxRects best short side fit instead of the skyline, which reuses the space
+	// left under taller glyphs and fits more glyphs per page at a higher insertion cost.
+	FONS_PACK_MAXRECTS = 4,
+};
+
+enum FONSrasterizer {
+	// Rasterizer of the font backend, the scanline rasterizer of stb_truetype or FreeType.
+	FONS_RASTER_SCANLINE = 0,
+	// Accumulates the signed area covered by the outline in a float buffer and sums it along the rows,
+	// which is faster for large glyphs. Only available with stb_truetype.
+	FONS_RASTER_COVERAGE = 1,
 };
 
 enum FONSalign {
@@ -73,17 +87,47 @@ struct FONSquad
 };
 typedef struct FONSquad FONSquad;
 
+// The counters wrap around, the difference between two reads is correct modulo 2^32.
+struct FONSglyphStats {
+	unsigned int hits;			// Glyphs drawn from the atlas.
+	unsigned int misses;		// Glyphs drawn which were not in the atlas.
+	unsigned int rasterized;	// Glyph bitmaps rasterized, or queued to the workers.
+	unsigned int evicted;		// Glyph bitmaps thrown away with atlas pages or by resetting the atlas.
+	int glyphs;			// Glyphs in the atlas.
+	int atlasBytes;		// Atlas area used by the glyphs.
+	unsigned int lookups;		// Glyph hash lookups.
+	unsigned int probes;		// Slots visited by the lookups, probes / lookups is the mean probe length.
+	int maxProbe;		// Longest probe sequence of a lookup.
+	int hashSlots;		// Slots of the glyph hash, it is grown to stay at most half full.
+};
+typedef struct FONSglyphStats FONSglyphStats;
+
+struct FONSatlasStats {
+	int pages;
+	int area;			// Pixels of all pages.
+	int used;			// Pixels covered by glyphs.
+	int free;			// Pixels where glyphs can still be placed, the rest of the unused area is lost until pages are evicted.
+	int largestFree;	// Area of the largest free rectangle, fragmentation is 1 - largestFree / free.
+	int freeRects;		// Skyline segments or free rectangles tracked by the packer.
+};
+typedef struct FONSatlasStats FONSatlasStats;
+
 struct FONStextIter {
 	float x, y, nextx, nexty, scale, spacing;
 	unsigned int codepoint;
 	short isize, iblur;
 	struct FONSfont* font;
 	int prevGlyphIndex;
+	unsigned int prevCodepoint;
 	const char* str;
 	const char* next;
 	const char* end;
 	unsigned int utf8state;
 	int bitmapOption;
+	unsigned int pageMask;	// Bit (page % 32) is set for each atlas page used by the quads.
+	int bitmap;				// Non-zero if the glyph of the last quad is in the atlas, its UV coordinates are valid.
+	int scaled;				// Non-zero if a quad was scaled from a glyph of another size, such quads are rounded
+							// from the exact pen position rather than placed at whole pixels from it.
 };
 typedef struct FONStextIter FONStextIter;
 
@@ -98,6 +142,8 @@ void fonsSetErrorCallback(FONScontext* s, void (*callback)(void* uptr, int error
 void fonsGetAtlasSize(FONScontext* s, int* width, int* height);
 // Expands the atlas size.
 int fonsExpandAtlas(FONScontext* s, int width, int height);
+// Returns how much of the atlas is used by glyphs and how much free space is left.
+void fonsGetAtlasStats(FONScontext* s, FONSatlasStats* stats);
 // Resets the whole stash.
 int fonsResetAtlas(FONScontext* stash, int width, int height);
 
@@ -105,6 +151,19 @@ int fonsResetAtlas(FONScontext* stash, int width, int height);
 int fonsAddFont(FONScontext* s, const char* name, const char* path, int fontIndex);
 int fonsAddFontMem(FONScontext* s, const char* name, unsigned char* data, int ndata, int freeData, int fontIndex);
 int fonsGetFontByName(FONScontext* s, const char* name);
+// Returns bytes of font data mapped from files and how much of it is resident in memory,
+// and the bytes of font data held in memory buffers.
+void fonsFontMemory(FONScontext* s, size_t* mapped, size_t* resident, size_t* heap);
+// Renders the font from signed distance field glyphs rasterized once at FONS_SDF_SIZE.
+// Returns 0 if the font backend does not support distance fields.
+int fonsSetFontSDF(FONScontext* s, int font, int enabled);
+int fonsGetFontSDF(FONScontext* s, int font);
+// Returns glyph cache counters of the font since it was added, or the sum over all fonts if font is -1.
+void fonsGetGlyphStats(FONScontext* s, int font, FONSglyphStats* stats);
+// Rasterizes glyphs at perOctave sizes per doubling of the size and scales their quads to the requested size,
+// trading slight blur for fewer glyphs when sizes change continuously. 0 rasterizes every size, which is the default.
+void fonsSetSizeBuckets(FONScontext* s, int perOctave);
+int fonsGetSizeBuckets(FONScontext* s);
 
 // State handling
 void fonsPushState(FONScontext* s);
@@ -134,10 +193,60 @@ int fonsTextIterNext(FONScontext* stash, FONStextIter* iter, struct FONSquad* qu
 // Pull texture changes
 const unsigned char* fonsGetTextureData(FONScontext* stash, int* width, int* height);
 int fonsValidateTexture(FONScontext* s, int* dirty);
+// Returns up to maxRects changed areas of the texture as x0,y0,x1,y1 quadruples and clears them.
+// Areas not returned are kept for the next call.
+int fonsGetDirtyRects(FONScontext* s, int* rects, int maxRects);
 
 // Draws the stash texture for debugging
 void fonsDrawDebug(FONScontext* s, float x, float y);
 
+// Glyph workers
+// Starts or stops threads rasterizing glyphs off the calling thread, returns the number of workers running.
+int fonsSetWorkers(FONScontext* s, int nworkers);
+// In asynchronous mode missing glyphs are reserved in the atlas and draw empty until fonsPackGlyphs copies them in.
+void fonsSetAsync(FONScontext* s, int enabled);
+
+// Subpixel positioning
+// Rasterizes glyphs at 1 to FONS_MAX_SUBPIXEL horizontal phases. With more than one phase, advances are not rounded
+// and each glyph is drawn from the variant nearest to its pen position, at the cost of up to that many bitmaps
+// per glyph in the atlas. Returns the number of phases used.
+int fonsSetSubpixel(FONScontext* s, int phases);
+int fonsGetSubpixel(FONScontext* s);
+// Returns the number of phases and fills, for up to maxPhases phases, the glyphs in the atlas and their area in pixels.
+int fonsSubpixelUsage(FONScontext* s, int* glyphs, int* area, int maxPhases);
+// Selects the rasterizer of glyphs rasterized from now on, FONS_RASTER_COVERAGE when FONS_USE_COVERAGE is defined
+// and FONS_RASTER_SCANLINE otherwise by default. Returns the rasterizer used.
+int fonsSetRasterizer(FONScontext* s, int rasterizer);
+int fonsGetRasterizer(FONScontext* s);
+// Requests glyphs of the codepoint ranges (pairs of first and last codepoint) at current font, size and blur.
+// Returns the number of glyphs available or queued, stops early if the atlas is full.
+int fonsPrewarm(FONScontext* s, const unsigned int* ranges, int nranges);
+// Copies glyphs finished by the workers into the atlas, returns the number of glyphs copied.
+int fonsPackGlyphs(FONScontext* s);
+// Returns number of glyphs still being rasterized.
+int fonsPendingGlyphs(FONScontext* s);
+
+// Atlas pages
+// Starts a new frame, pages used during the frame are not evicted before the next one.
+void fonsBeginFrame(FONScontext* s);
+// Marks pages of a FONStextIter pageMask as used this frame, for callers reusing earlier quads.
+void fonsTouchPages(FONScontext* s, unsigned int pageMask);
+// Changes whenever all glyphs are removed from the atlas and previously returned quads become invalid.
+int fonsAtlasGeneration(FONScontext* s);
+// Returns number of atlas pages evicted since the stash was created.
+int fonsAtlasEvictions(FONScontext* s);
+// Returns how many times the pages of a FONStextIter pageMask were evicted. Quads using only those pages
+// stay valid while this and fonsAtlasGeneration do not change.
+int fonsPageEvictions(FONScontext* s, unsigned int pageMask);
+
+// Glyph cache files
+// Writes the atlas pixels and the glyph tables of all fonts to a file, returns 0 on failure.
+int fonsSaveCache(FONScontext* s, const char* path);
+// Replaces the atlas with one written by fonsSaveCache, restoring the glyphs of fonts whose contents, fallbacks
+// and distance field mode match the saved ones. The file is mapped read-only and may be shared by several processes.
+// Returns the number of fonts restored, or -1 if the file does not match this build or atlas layout.
+int fonsLoadCache(FONScontext* s, const char* path);
+
 #endif // FONTSTASH_H
 
 
@@ -159,6 +268,11 @@ typedef struct FONSttFontImpl FONSttFontImpl;
 
 #else
 
+#ifndef FONS_NO_THREADS
+#	define FONS_THREADS 1
+#	include <pthread.h>
+#endif
+
 #define STB_TRUETYPE_IMPLEMENTATION
 
 static void* fons__tmpalloc(size_t size, void* up);
@@ -174,11 +288,34 @@ typedef struct FONSttFontImpl FONSttFontImpl;
 
 #endif
 
+#if defined(__SSE2__) && !defined(FONS_NO_SIMD)
+#	define FONS_SSE2 1
+#	include <emmintrin.h>
+#endif
+
+#if !defined(_WIN32) && !defined(FONS_NO_MMAP)
+#	define FONS_MMAP 1
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+#ifdef _WIN32
+#	include <process.h>
+#	define fons__getpid() _getpid()
+#else
+#	include <unistd.h>
+#	define fons__getpid() getpid()
+#endif
+
 #ifndef FONS_SCRATCH_BUF_SIZE
 #	define FONS_SCRATCH_BUF_SIZE 96000
 #endif
-#ifndef FONS_HASH_LUT_SIZE
-#	define FONS_HASH_LUT_SIZE 256
+#ifndef FONS_COVERAGE_STACK_SIZE
+#	define FONS_COVERAGE_STACK_SIZE 4096	// Coverage cells on the stack, larger glyphs use the heap.
+#endif
+#ifndef FONS_INIT_GLYPH_SLOTS
+#	define FONS_INIT_GLYPH_SLOTS 256
 #endif
 #ifndef FONS_INIT_FONTS
 #	define FONS_INIT_FONTS 4
@@ -198,6 +335,37 @@ typedef struct FONSttFontImpl FONSttFontImpl;
 #ifndef FONS_MAX_FALLBACKS
 #	define FONS_MAX_FALLBACKS 20
 #endif
+#ifndef FONS_SDF_SIZE
+#	define FONS_SDF_SIZE 48
+#endif
+#ifndef FONS_SDF_PAD
+#	define FONS_SDF_PAD 6
+#endif
+#ifndef FONS_MAX_WORKERS
+#	define FONS_MAX_WORKERS 8
+#endif
+#ifndef FONS_PAGE_SIZE
+#	define FONS_PAGE_SIZE 256
+#endif
+#ifndef FONS_CACHE_KEY_BYTES
+#	define FONS_CACHE_KEY_BYTES 4096
+#endif
+
+#ifndef FONS_BLUR_MAX_WIDTH
+#	define FONS_BLUR_MAX_WIDTH 512
+#endif
+#ifndef FONS_MAX_DIRTY_RECTS
+#	define FONS_MAX_DIRTY_RECTS 16
+#endif
+#ifndef FONS_LATIN_SIZES
+#	define FONS_LATIN_SIZES 4
+#endif
+
+#define FONS_CACHE_VERSION 5
+// Glyph phases are stored in twelfths of a pixel, which are shared by quantizations of 1 to 4 phases.
+#define FONS_SUBPIXEL_UNITS 12
+#define FONS_KERN_UNKNOWN (-32768)
+#define FONS_NO_CODEPOINT 0xffffffffu
 
 static unsigned int fons__hashint(unsigned int a)
 {
@@ -224,13 +392,42 @@ struct FONSglyph
 {
 	unsigned int codepoint;
 	int index;
-	int next;
 	short size, blur;
 	short x0,y0,x1,y1;
 	short xadv,xoff,yoff;
+	short pending;		// Atlas space is reserved, the bitmap is being rasterized by a worker.
+	short page;
+	short phase;		// Horizontal offset of the bitmap in FONS_SUBPIXEL_UNITS of a pixel.
 };
 typedef struct FONSglyph FONSglyph;
 
+// Glyphs of codepoints below 256 at one size, found without hashing.
+struct FONSlatin
+{
+	short size, blur;	// Glyph key of the table, -1 when unused.
+	int generation;
+	int lastUsed;
+	int glyphs[256];	// Index to the font glyphs, -1 if not created yet.
+};
+typedef struct FONSlatin FONSlatin;
+
+// Font resolved for a codepoint missing from the base font.
+struct FONSfallbackEntry
+{
+	unsigned int codepoint;		// FONS_NO_CODEPOINT when the slot is empty.
+	int font;					// Fallback font having the glyph, or -1 if none has.
+	int index;
+};
+typedef struct FONSfallbackEntry FONSfallbackEntry;
+
+// Slot of the glyph hash, which is keyed by codepoint, size, blur and phase.
+struct FONSglyphSlot
+{
+	unsigned int hash;	// Hash of the glyph key, compared before the key and reused when the hash grows.
+	int glyph;			// Index to the font glyphs, -1 when the slot is empty.
+};
+typedef struct FONSglyphSlot FONSglyphSlot;
+
 struct FONSfont
 {
 	FONSttFontImpl font;
@@ -238,15 +435,27 @@ struct FONSfont
 	unsigned char* data;
 	int dataSize;
 	unsigned char freeData;
+	unsigned char mapped;	// Data is mapped from the font file.
+	int index;			// Face index in a font collection.
 	float ascender;
 	float descender;
 	float lineh;
 	FONSglyph* glyphs;
 	int cglyphs;
 	int nglyphs;
-	int lut[FONS_HASH_LUT_SIZE];
+	FONSglyphSlot* slots;	// Open addressing hash of the glyphs, linearly probed.
+	int nslots, cslots;
 	int fallbacks[FONS_MAX_FALLBACKS];
 	int nfallbacks;
+	int sdf;
+	FONSlatin latin[FONS_LATIN_SIZES];
+	int latinLast, latinClock;
+	short* kern;		// Kerning of codepoint pairs below 256, built as pairs are met.
+	FONSfallbackEntry* fallbackMap;	// Open addressing hash, kept over sizes and atlas resets.
+	int nfallbackMap, cfallbackMap;
+	unsigned int hits, misses, rasterized, evicted;
+	unsigned int lookups, probes;
+	int maxProbe;
 };
 typedef struct FONSfont FONSfont;
 
@@ -266,23 +475,62 @@ struct FONSatlasNode {
 };
 typedef struct FONSatlasNode FONSatlasNode;
 
+struct FONSatlasRect {
+	short x, y, width, height;
+};
+typedef struct FONSatlasRect FONSatlasRect;
+
 struct FONSatlas
 {
 	int width, height;
 	FONSatlasNode* nodes;
 	int nnodes;
 	int cnodes;
+	int used;				// Area of the rects added since the atlas was reset.
+	FONSatlasRect* rects;	// Free rectangles of the MaxRects packer, none contains another. NULL with the skyline.
+	int nrects;
+	int crects;
 };
 typedef struct FONSatlas FONSatlas;
 
+// The atlas is split into pages which are packed separately, so that the least recently used can be evicted.
+struct FONSpage
+{
+	int x, y;
+	FONSatlas* atlas;
+	int lastUsed;	// Frame in which a glyph of the page was last drawn.
+	int evictions;
+	int span;		// First page of the block holding a glyph larger than a page, -1 if the page is packed on its own.
+};
+typedef struct FONSpage FONSpage;
+
+// Glyph rasterized by a worker into its own buffer.
+struct FONSglyphJob
+{
+	int font, glyph;	// Glyph entry waiting for the bitmap.
+	int generation;
+	FONSttFontImpl impl;
+	int index;
+	int gw, gh, pad, blur, sdf, rasterizer;
+	float scale, shift;
+	int done;
+	unsigned char* data;
+};
+typedef struct FONSglyphJob FONSglyphJob;
+
 struct FONScontext
 {
 	FONSparams params;
 	float itw,ith;
 	unsigned char* texData;
-	int dirtyRect[4];
+	int dirtyRects[FONS_MAX_DIRTY_RECTS][4];	// Changed areas, merged only when they overlap.
+	int ndirty;
 	FONSfont** fonts;
-	FONSatlas* atlas;
+	FONSpage* pages;
+	int npages, cpages;
+	int page;			// Page tried first when adding glyphs.
+	int frame;
+	int evictions;
 	int cfonts;
 	int nfonts;
 	float verts[FONS_VERTEX_COUNT*2];
@@ -295,6 +543,24 @@ struct FONScontext
 	int nstates;
 	void (*handleError)(void* uptr, int error, int val);
 	void* errorUptr;
+	int async;
+	int subpixel;		// Number of horizontal glyph phases.
+	int rasterizer;
+	int sizeBuckets;	// Glyph sizes per octave, 0 if sizes are not bucketed.
+	short bucketFrom, bucketTo;	// Last size mapped to a bucket.
+	int generation;		// Bumped when glyph entries are thrown away.
+	FONSglyphJob* jobs;
+	int njobs, cjobs;
+	int jobBase;		// Sequence number of jobs[0].
+	int jobNext;		// Next job to be picked up by a worker.
+	int nworkers;
+#ifdef FONS_THREADS
+	pthread_t workers[FONS_MAX_WORKERS];
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	int threadsInit;
+	int quit;
+#endif
 #ifdef FONS_USE_FREETYPE
 	FT_Library ftLibrary;
 #endif
@@ -344,17 +610,22 @@ int fons__tt_getGlyphIndex(FONSttFontImpl *font, int codepoint)
 	return FT_Get_Char_Index(font->font, codepoint);
 }
 
-int fons__tt_buildGlyphBitmap(FONSttFontImpl *font, int glyph, float size, float scale,
+int fons__tt_buildGlyphBitmap(FONSttFontImpl *font, int glyph, float size, float scale, float shiftX,
 							  int *advance, int *lsb, int *x0, int *y0, int *x1, int *y1)
 {
 	FT_Error ftError;
 	FT_GlyphSlot ftGlyph;
 	FT_Fixed advFixed;
+	FT_Vector delta;
 	FONS_NOTUSED(scale);
 
 	ftError = FT_Set_Pixel_Sizes(font->font, 0, size);
 	if (ftError) return 0;
+	delta.x = (FT_Pos)(shiftX * 64.0f);
+	delta.y = 0;
+	FT_Set_Transform(font->font, NULL, &delta);
 	ftError = FT_Load_Glyph(font->font, glyph, FT_LOAD_RENDER | FT_LOAD_FORCE_AUTOHINT | FT_LOAD_TARGET_LIGHT);
+	FT_Set_Transform(font->font, NULL, NULL);
 	if (ftError) return 0;
 	ftError = FT_Get_Advance(font->font, glyph, FT_LOAD_NO_SCALE, &advFixed);
 	if (ftError) return 0;
@@ -369,7 +640,7 @@ int fons__tt_buildGlyphBitmap(FONSttFontImpl *font, int glyph, float size, float
 }
 
 void fons__tt_renderGlyphBitmap(FONSttFontImpl *font, unsigned char *output, int outWidth, int outHeight, int outStride,
-								float scaleX, float scaleY, int glyph)
+								float scaleX, float scaleY, float shiftX, int glyph)
 {
 	FT_GlyphSlot ftGlyph = font->font->glyph;
 	int ftGlyphOffset = 0;
@@ -378,6 +649,7 @@ void fons__tt_renderGlyphBitmap(FONSttFontImpl *font, unsigned char *output, int
 	FONS_NOTUSED(outHeight);
 	FONS_NOTUSED(scaleX);
 	FONS_NOTUSED(scaleY);
+	FONS_NOTUSED(shiftX);
 	FONS_NOTUSED(glyph);	// glyph has already been loaded by fons__tt_buildGlyphBitmap
 
 	for ( y = 0; y < ftGlyph->bitmap.rows; y++ ) {
@@ -387,6 +659,21 @@ void fons__tt_renderGlyphBitmap(FONSttFontImpl *font, unsigned char *output, int
 	}
 }
 
+int fons__tt_renderGlyphCoverage(FONSttFontImpl *font, unsigned char *output, int outWidth, int outHeight, int outStride,
+								 float scaleX, float scaleY, float shiftX, int glyph)
+{
+	FONS_NOTUSED(font);
+	FONS_NOTUSED(output);
+	FONS_NOTUSED(outWidth);
+	FONS_NOTUSED(outHeight);
+	FONS_NOTUSED(outStride);
+	FONS_NOTUSED(scaleX);
+	FONS_NOTUSED(scaleY);
+	FONS_NOTUSED(shiftX);
+	FONS_NOTUSED(glyph);
+	return 0;
+}
+
 int fons__tt_getGlyphKernAdvance(FONSttFontImpl *font, int glyph1, int glyph2)
 {
 	FT_Vector ftKerning;
@@ -394,6 +681,20 @@ int fons__tt_getGlyphKernAdvance(FONSttFontImpl *font, int glyph1, int glyph2)
 	return (int)((ftKerning.x + 32) >> 6);  // Round up and convert to integer
 }
 
+int fons__tt_renderGlyphSDF(FONSttFontImpl *font, unsigned char *output, int outWidth, int outHeight, int outStride,
+							float scale, int padding, int glyph)
+{
+	FONS_NOTUSED(font);
+	FONS_NOTUSED(output);
+	FONS_NOTUSED(outWidth);
+	FONS_NOTUSED(outHeight);
+	FONS_NOTUSED(outStride);
+	FONS_NOTUSED(scale);
+	FONS_NOTUSED(padding);
+	FONS_NOTUSED(glyph);
+	return 0;
+}
+
 #else
 
 int fons__tt_init(FONScontext *context)
@@ -438,19 +739,224 @@ int fons__tt_getGlyphIndex(FONSttFontImpl *font, int codepoint)
 	return stbtt_FindGlyphIndex(&font->font, codepoint);
 }
 
-int fons__tt_buildGlyphBitmap(FONSttFontImpl *font, int glyph, float size, float scale,
+int fons__tt_buildGlyphBitmap(FONSttFontImpl *font, int glyph, float size, float scale, float shiftX,
 							  int *advance, int *lsb, int *x0, int *y0, int *x1, int *y1)
 {
 	FONS_NOTUSED(size);
 	stbtt_GetGlyphHMetrics(&font->font, glyph, advance, lsb);
-	stbtt_GetGlyphBitmapBox(&font->font, glyph, scale, scale, x0, y0, x1, y1);
+	stbtt_GetGlyphBitmapBoxSubpixel(&font->font, glyph, scale, scale, shiftX, 0.0f, x0, y0, x1, y1);
 	return 1;
 }
 
 void fons__tt_renderGlyphBitmap(FONSttFontImpl *font, unsigned char *output, int outWidth, int outHeight, int outStride,
-								float scaleX, float scaleY, int glyph)
+								float scaleX, float scaleY, float shiftX, int glyph)
+{
+	stbtt_MakeGlyphBitmapSubpixel(&font->font, output, outWidth, outHeight, outStride, scaleX, scaleY, shiftX, 0.0f, glyph);
+}
+
+// Coverage rasterizer after font-rs. Each line of the outline adds the signed area it covers to the cells
+// of a float buffer, and a running sum over the buffer gives the coverage of the pixels.
+
+// Adds the line from (x0,y0) to (x1,y1) to the w*h cells. The sum runs on from the end of a row into the next,
+// so area right of the last pixel is put at the start of the next row, the buffer has cells for that past the end.
+static void fons__coverageLine(float* acc, int w, int h, float x0, float y0, float x1, float y1)
+{
+	float dir = 1.0f, dxdy, x, t;
+	int y, yend;
+
+	if (y0 == y1) return;
+	if (y0 > y1) {
+		dir = -1.0f;
+		t = x0; x0 = x1; x1 = t;
+		t = y0; y0 = y1; y1 = t;
+	}
+	if (y1 <= 0.0f || y0 >= (float)h) return;
+	dxdy = (x1 - x0) / (y1 - y0);
+	x = x0;
+	y = 0;
+	if (y0 < 0.0f)
+		x -= y0 * dxdy;
+	else
+		y = (int)y0;
+	yend = fons__mini(h, (int)ceilf(y1));
+
+	for (; y < yend; y++) {
+		float* row = acc + y*w;
+		float dy = (y1 < y+1 ? y1 : (float)(y+1)) - (y0 > y ? y0 : (float)y);
+		float xnext = x + dxdy * dy;
+		float d = dy * dir;
+		float xa = x < xnext ? x : xnext;
+		float xb = x < xnext ? xnext : x;
+		int xai, xbi;
+		// The outline is inside the glyph box, clamping only catches rounding and keeps x positive for truncation.
+		if (xa < 0.0f) xa = 0.0f;
+		if (xb > (float)w) xb = (float)w;
+		if (xb < xa) xb = xa;
+		xai = (int)xa;
+		xbi = (int)xb;
+		if ((float)xbi < xb) xbi++;
+		if (xbi <= xai + 1) {
+			// Within one pixel, the area is split by the mean x.
+			float xm = 0.5f * (xa + xb) - xai;
+			row[xai] += d - d * xm;
+			row[xai+1] += d * xm;
+		} else {
+			float s = 1.0f / (xb - xa);
+			float xaf = xa - xai;
+			float xbf = xb - xbi + 1.0f;
+			float a0 = 0.5f * s * (1.0f - xaf) * (1.0f - xaf);
+			float am = 0.5f * s * xbf * xbf;
+			row[xai] += d * a0;
+			if (xbi == xai + 2) {
+				row[xai+1] += d * (1.0f - a0 - am);
+			} else {
+				float a1 = s * (1.5f - xaf);
+				int xi;
+				row[xai+1] += d * (a1 - a0);
+				for (xi = xai+2; xi < xbi-1; xi++)
+					row[xi] += d * s;
+				row[xbi-1] += d * (1.0f - a1 - (xbi - xai - 3) * s - am);
+			}
+			row[xbi] += d * am;
+		}
+		x = xnext;
+	}
+}
+
+// Splits a curve into n lines, so that they are within about 1/7 of a pixel from it for a deviation dd squared.
+static int fons__coverageSegments(float dd)
+{
+	float n = sqrtf(sqrtf(dd));
+	return n < 255.0f ? 1 + (int)n : 256;
+}
+
+static void fons__coverageQuad(float* acc, int w, int h, float x0, float y0, float x1, float y1, float x2, float y2)
+{
+	float dx = x0 - 2*x1 + x2, dy = y0 - 2*y1 + y2;
+	float px = x0, py = y0;
+	int i, n = fons__coverageSegments(3.0f * (dx*dx + dy*dy));
+	for (i = 1; i <= n; i++) {
+		float t = (float)i / n, mt = 1.0f - t;
+		float x = mt*mt*x0 + 2*mt*t*x1 + t*t*x2;
+		float y = mt*mt*y0 + 2*mt*t*y1 + t*t*y2;
+		fons__coverageLine(acc, w, h, px, py, x, y);
+		px = x;
+		py = y;
+	}
+}
+
+static void fons__coverageCubic(float* acc, int w, int h, float x0, float y0, float x1, float y1,
+								float x2, float y2, float x3, float y3)
+{
+	float dx0 = x0 - 2*x1 + x2, dy0 = y0 - 2*y1 + y2;
+	float dx1 = x1 - 2*x2 + x3, dy1 = y1 - 2*y2 + y3;
+	float d0 = dx0*dx0 + dy0*dy0, d1 = dx1*dx1 + dy1*dy1;
+	float px = x0, py = y0;
+	int i, n = fons__coverageSegments(27.0f * (d0 > d1 ? d0 : d1));
+	for (i = 1; i <= n; i++) {
+		float t = (float)i / n, mt = 1.0f - t;
+		float x = mt*mt*mt*x0 + 3*mt*mt*t*x1 + 3*mt*t*t*x2 + t*t*t*x3;
+		float y = mt*mt*mt*y0 + 3*mt*mt*t*y1 + 3*mt*t*t*y2 + t*t*t*y3;
+		fons__coverageLine(acc, w, h, px, py, x, y);
+		px = x;
+		py = y;
+	}
+}
+
+// Sums the cells along the rows into 8-bit coverage, 4 cells at a time with SSE2.
+static void fons__coverageAccumulate(const float* acc, unsigned char* output, int w, int h, int stride)
 {
-	stbtt_MakeGlyphBitmap(&font->font, output, outWidth, outHeight, outStride, scaleX, scaleY, glyph);
+	float sum = 0.0f, c;
+	int x, y;
+#ifdef FONS_SSE2
+	__m128 sign = _mm_set1_ps(-0.0f), one = _mm_set1_ps(1.0f), c255 = _mm_set1_ps(255.0f), half = _mm_set1_ps(0.5f);
+#endif
+
+	for (y = 0; y < h; y++) {
+		const float* row = acc + y*w;
+		unsigned char* dst = output + y*stride;
+		x = 0;
+#ifdef FONS_SSE2
+		if (w >= 4) {
+			__m128 offset = _mm_set1_ps(sum);
+			for (; x + 4 <= w; x += 4) {
+				__m128 v = _mm_loadu_ps(row + x);
+				__m128i ci;
+				int packed;
+				// Prefix sum of the lanes, continued from the last lane of the previous cells.
+				v = _mm_add_ps(v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 4)));
+				v = _mm_add_ps(v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 8)));
+				v = _mm_add_ps(v, offset);
+				offset = _mm_shuffle_ps(v, v, 0xff);
+				v = _mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_andnot_ps(sign, v), one), c255), half);
+				ci = _mm_cvttps_epi32(v);
+				ci = _mm_packs_epi32(ci, ci);
+				ci = _mm_packus_epi16(ci, ci);
+				packed = _mm_cvtsi128_si32(ci);
+				memcpy(dst + x, &packed, 4);
+			}
+			sum = _mm_cvtss_f32(offset);
+		}
+#endif
+		for (; x < w; x++) {
+			sum += row[x];
+			c = fabsf(sum);
+			dst[x] = (unsigned char)((c < 1.0f ? c : 1.0f) * 255.0f + 0.5f);
+		}
+	}
+}
+
+// Rasterizes the same bitmap as fons__tt_renderGlyphBitmap with the coverage rasterizer.
+// Returns 0 if it is out of memory.
+int fons__tt_renderGlyphCoverage(FONSttFontImpl *font, unsigned char *output, int outWidth, int outHeight, int outStride,
+								 float scaleX, float scaleY, float shiftX, int glyph)
+{
+	float stack[FONS_COVERAGE_STACK_SIZE];
+	float* acc;
+	stbtt_vertex* verts = NULL;
+	int i, n, ix0, iy0, ncells = outWidth * outHeight + 4;
+	float ox, oy, sx = 0.0f, sy = 0.0f, px = 0.0f, py = 0.0f;
+
+	if (outWidth <= 0 || outHeight <= 0) return 1;
+	acc = ncells <= FONS_COVERAGE_STACK_SIZE ? stack : (float*)malloc(sizeof(float) * ncells);
+	if (acc == NULL) return 0;
+	memset(acc, 0, sizeof(float) * ncells);
+
+	// Outline coordinates are flipped and moved to the glyph box.
+	stbtt_GetGlyphBitmapBoxSubpixel(&font->font, glyph, scaleX, scaleY, shiftX, 0.0f, &ix0, &iy0, NULL, NULL);
+	ox = shiftX - ix0;
+	oy = (float)-iy0;
+	n = stbtt_GetGlyphShape(&font->font, glyph, &verts);
+	for (i = 0; i < n; i++) {
+		const stbtt_vertex* v = &verts[i];
+		float x = v->x * scaleX + ox, y = oy - v->y * scaleY;
+		switch (v->type) {
+		case STBTT_vmove:
+			// Close the previous contour.
+			fons__coverageLine(acc, outWidth, outHeight, px, py, sx, sy);
+			sx = x;
+			sy = y;
+			break;
+		case STBTT_vline:
+			fons__coverageLine(acc, outWidth, outHeight, px, py, x, y);
+			break;
+		case STBTT_vcurve:
+			fons__coverageQuad(acc, outWidth, outHeight, px, py, v->cx * scaleX + ox, oy - v->cy * scaleY, x, y);
+			break;
+		case STBTT_vcubic:
+			fons__coverageCubic(acc, outWidth, outHeight, px, py, v->cx * scaleX + ox, oy - v->cy * scaleY,
+								v->cx1 * scaleX + ox, oy - v->cy1 * scaleY, x, y);
+			break;
+		}
+		px = x;
+		py = y;
+	}
+	fons__coverageLine(acc, outWidth, outHeight, px, py, sx, sy);
+	if (verts != NULL) stbtt_FreeShape(&font->font, verts);
+
+	fons__coverageAccumulate(acc, output, outWidth, outHeight, outStride);
+	if (acc != stack) free(acc);
+	return 1;
 }
 
 int fons__tt_getGlyphKernAdvance(FONSttFontImpl *font, int glyph1, int glyph2)
@@ -458,6 +964,20 @@ int fons__tt_getGlyphKernAdvance(FONSttFontImpl *font, int glyph1, int glyph2)
 	return stbtt_GetGlyphKernAdvance(&font->font, glyph1, glyph2);
 }
 
+int fons__tt_renderGlyphSDF(FONSttFontImpl *font, unsigned char *output, int outWidth, int outHeight, int outStride,
+							float scale, int padding, int glyph)
+{
+	int x, y, w, h, xoff, yoff;
+	unsigned char* sdf = stbtt_GetGlyphSDF(&font->font, scale, glyph, padding, 128, 128.0f/padding, &w, &h, &xoff, &yoff);
+	if (sdf == NULL) return 0;
+	for (y = 0; y < h && y < outHeight; y++) {
+		for (x = 0; x < w && x < outWidth; x++)
+			output[y*outStride + x] = sdf[y*w + x];
+	}
+	stbtt_FreeSDF(sdf, font->font.userdata);
+	return 1;
+}
+
 #endif
 
 #ifdef STB_TRUETYPE_IMPLEMENTATION
@@ -467,6 +987,10 @@ static void* fons__tmpalloc(size_t size, void* up)
 	unsigned char* ptr;
 	FONScontext* stash = (FONScontext*)up;
 
+	// Workers rasterize without a stash and use the heap.
+	if (stash == NULL)
+		return malloc(size);
+
 	// 16-byte align the returned pointer
 	size = (size + 0xf) & ~0xf;
 
@@ -482,9 +1006,9 @@ static void* fons__tmpalloc(size_t size, void* up)
 
 static void fons__tmpfree(void* ptr, void* up)
 {
-	(void)ptr;
-	(void)up;
-	// empty
+	if (up == NULL)
+		free(ptr);
+	// Scratch memory is released all at once.
 }
 
 #endif // STB_TRUETYPE_IMPLEMENTATION
@@ -534,10 +1058,11 @@ static void fons__deleteAtlas(FONSatlas* atlas)
 {
 	if (atlas == NULL) return;
 	if (atlas->nodes != NULL) free(atlas->nodes);
+	if (atlas->rects != NULL) free(atlas->rects);
 	free(atlas);
 }
 
-static FONSatlas* fons__allocAtlas(int w, int h, int nnodes)
+static FONSatlas* fons__allocAtlas(int w, int h, int nnodes, int maxRects)
 {
 	FONSatlas* atlas = NULL;
 
@@ -562,6 +1087,18 @@ static FONSatlas* fons__allocAtlas(int w, int h, int nnodes)
 	atlas->nodes[0].width = (short)w;
 	atlas->nnodes++;
 
+	// The whole area is free.
+	if (maxRects) {
+		atlas->rects = (FONSatlasRect*)malloc(sizeof(FONSatlasRect) * nnodes);
+		if (atlas->rects == NULL) goto error;
+		atlas->crects = nnodes;
+		atlas->rects[0].x = 0;
+		atlas->rects[0].y = 0;
+		atlas->rects[0].width = (short)w;
+		atlas->rects[0].height = (short)h;
+		atlas->nrects = 1;
+	}
+
 	return atlas;
 
 error:
@@ -598,26 +1135,26 @@ static void fons__atlasRemoveNode(FONSatlas* atlas, int idx)
 	atlas->nnodes--;
 }
 
-static void fons__atlasExpand(FONSatlas* atlas, int w, int h)
-{
-	// Insert node for empty space
-	if (w > atlas->width)
-		fons__atlasInsertNode(atlas, atlas->nnodes, atlas->width, 0, w - atlas->width);
-	atlas->width = w;
-	atlas->height = h;
-}
-
 static void fons__atlasReset(FONSatlas* atlas, int w, int h)
 {
 	atlas->width = w;
 	atlas->height = h;
 	atlas->nnodes = 0;
+	atlas->used = 0;
 
 	// Init root node.
 	atlas->nodes[0].x = 0;
 	atlas->nodes[0].y = 0;
 	atlas->nodes[0].width = (short)w;
 	atlas->nnodes++;
+
+	if (atlas->rects != NULL) {
+		atlas->rects[0].x = 0;
+		atlas->rects[0].y = 0;
+		atlas->rects[0].width = (short)w;
+		atlas->rects[0].height = (short)h;
+		atlas->nrects = 1;
+	}
 }
 
 static int fons__atlasAddSkylineLevel(FONSatlas* atlas, int idx, int x, int y, int w, int h)
@@ -678,11 +1215,105 @@ static int fons__atlasRectFits(FONSatlas* atlas, int i, int w, int h)
 	return y;
 }
 
+static int fons__atlasPushRect(FONSatlas* atlas, int x, int y, int w, int h)
+{
+	FONSatlasRect* r;
+	if (atlas->nrects+1 > atlas->crects) {
+		FONSatlasRect* rects;
+		int crects = atlas->crects == 0 ? 8 : atlas->crects * 2;
+		rects = (FONSatlasRect*)realloc(atlas->rects, sizeof(FONSatlasRect) * crects);
+		if (rects == NULL) return 0;
+		atlas->rects = rects;
+		atlas->crects = crects;
+	}
+	r = &atlas->rects[atlas->nrects++];
+	r->x = (short)x;
+	r->y = (short)y;
+	r->width = (short)w;
+	r->height = (short)h;
+	return 1;
+}
+
+static int fons__rectContains(const FONSatlasRect* a, const FONSatlasRect* b)
+{
+	return b->x >= a->x && b->y >= a->y && b->x + b->width <= a->x + a->width && b->y + b->height <= a->y + a->height;
+}
+
+// MaxRects with best short side fit. The free rectangles overlapping the placed one are split into the
+// up to four maximal rectangles around it, and only the new ones are checked for containment.
+static int fons__atlasAddMaxRect(FONSatlas* atlas, int rw, int rh, int* rx, int* ry)
+{
+	int i, j, n, bestShort = 0x7fffffff, bestLong = 0x7fffffff, besti = -1;
+	FONSatlasRect placed;
+
+	for (i = 0; i < atlas->nrects; i++) {
+		FONSatlasRect* r = &atlas->rects[i];
+		int dw = r->width - rw, dh = r->height - rh, s, l;
+		if (dw < 0 || dh < 0) continue;
+		s = fons__mini(dw, dh);
+		l = fons__maxi(dw, dh);
+		if (s < bestShort || (s == bestShort && l < bestLong)) {
+			besti = i;
+			bestShort = s;
+			bestLong = l;
+		}
+	}
+	if (besti == -1)
+		return 0;
+
+	placed.x = atlas->rects[besti].x;
+	placed.y = atlas->rects[besti].y;
+	placed.width = (short)rw;
+	placed.height = (short)rh;
+
+	// Split, the rectangles split are marked with zero width and removed below.
+	n = atlas->nrects;
+	for (i = 0; i < n; i++) {
+		FONSatlasRect r = atlas->rects[i];
+		if (placed.x >= r.x + r.width || placed.x + rw <= r.x || placed.y >= r.y + r.height || placed.y + rh <= r.y)
+			continue;
+		if (placed.x > r.x && !fons__atlasPushRect(atlas, r.x, r.y, placed.x - r.x, r.height)) return 0;
+		if (placed.x + rw < r.x + r.width && !fons__atlasPushRect(atlas, placed.x + rw, r.y, r.x + r.width - placed.x - rw, r.height)) return 0;
+		if (placed.y > r.y && !fons__atlasPushRect(atlas, r.x, r.y, r.width, placed.y - r.y)) return 0;
+		if (placed.y + rh < r.y + r.height && !fons__atlasPushRect(atlas, r.x, placed.y + rh, r.width, r.y + r.height - placed.y - rh)) return 0;
+		atlas->rects[i].width = 0;
+	}
+
+	// Prune new rectangles contained in others, and old ones contained in new ones.
+	for (i = n; i < atlas->nrects; i++) {
+		FONSatlasRect* r = &atlas->rects[i];
+		for (j = 0; j < atlas->nrects && r->width > 0; j++) {
+			FONSatlasRect* o = &atlas->rects[j];
+			if (j == i || o->width == 0) continue;
+			if (fons__rectContains(o, r))
+				r->width = 0;
+			else if (j < n && fons__rectContains(r, o))
+				o->width = 0;
+		}
+	}
+	for (i = 0, j = 0; i < atlas->nrects; i++) {
+		if (atlas->rects[i].width > 0)
+			atlas->rects[j++] = atlas->rects[i];
+	}
+	atlas->nrects = j;
+
+	*rx = placed.x;
+	*ry = placed.y;
+	return 1;
+}
+
 static int fons__atlasAddRect(FONSatlas* atlas, int rw, int rh, int* rx, int* ry)
 {
 	int besth = atlas->height, bestw = atlas->width, besti = -1;
 	int bestx = -1, besty = -1, i;
 
+	if (atlas->rects != NULL) {
+		if (!fons__atlasAddMaxRect(atlas, rw, rh, rx, ry))
+			return 0;
+		atlas->used += rw * rh;
+		return 1;
+	}
+
 	// Bottom left fit heuristic.
 	for (i = 0; i < atlas->nnodes; i++) {
 		int y = fons__atlasRectFits(atlas, i, rw, rh);
@@ -706,15 +1337,250 @@ static int fons__atlasAddRect(FONSatlas* atlas, int rw, int rh, int* rx, int* ry
 
 	*rx = bestx;
 	*ry = besty;
+	atlas->used += rw * rh;
+
+	return 1;
+}
+
+// Adds a changed area of the texture. Areas overlapping it are merged in, and when the list is full
+// the area is merged with the one growing the least.
+static void fons__addDirty(FONScontext* stash, int x0, int y0, int x1, int y1)
+{
+	int i, best = -1, bestGrowth = 0;
+	for (i = 0; i < stash->ndirty; ) {
+		int* r = stash->dirtyRects[i];
+		if (x0 < r[2] && r[0] < x1 && y0 < r[3] && r[1] < y1) {
+			x0 = fons__mini(x0, r[0]);
+			y0 = fons__mini(y0, r[1]);
+			x1 = fons__maxi(x1, r[2]);
+			y1 = fons__maxi(y1, r[3]);
+			// The grown area may overlap the ones already passed.
+			memcpy(r, stash->dirtyRects[--stash->ndirty], sizeof(int)*4);
+			i = 0;
+			continue;
+		}
+		i++;
+	}
+	if (stash->ndirty == FONS_MAX_DIRTY_RECTS) {
+		for (i = 0; i < stash->ndirty; i++) {
+			int* r = stash->dirtyRects[i];
+			int growth = (fons__maxi(x1, r[2]) - fons__mini(x0, r[0])) * (fons__maxi(y1, r[3]) - fons__mini(y0, r[1]))
+				- (r[2] - r[0]) * (r[3] - r[1]);
+			if (best == -1 || growth < bestGrowth) {
+				best = i;
+				bestGrowth = growth;
+			}
+		}
+		x0 = fons__mini(x0, stash->dirtyRects[best][0]);
+		y0 = fons__mini(y0, stash->dirtyRects[best][1]);
+		x1 = fons__maxi(x1, stash->dirtyRects[best][2]);
+		y1 = fons__maxi(y1, stash->dirtyRects[best][3]);
+		memcpy(stash->dirtyRects[best], stash->dirtyRects[--stash->ndirty], sizeof(int)*4);
+		fons__addDirty(stash, x0, y0, x1, y1);
+		return;
+	}
+	stash->dirtyRects[stash->ndirty][0] = x0;
+	stash->dirtyRects[stash->ndirty][1] = y0;
+	stash->dirtyRects[stash->ndirty][2] = x1;
+	stash->dirtyRects[stash->ndirty][3] = y1;
+	stash->ndirty++;
+}
+
+static void fons__deletePages(FONScontext* stash)
+{
+	int i;
+	for (i = 0; i < stash->npages; i++)
+		fons__deleteAtlas(stash->pages[i].atlas);
+	stash->npages = 0;
+	stash->page = 0;
+}
+
+// Adds pages covering the atlas area outside of the old width and height.
+static int fons__addPages(FONScontext* stash, int oldw, int oldh, int w, int h)
+{
+	int x, y;
+	for (y = 0; y < h; y += FONS_PAGE_SIZE) {
+		for (x = 0; x < w; x += FONS_PAGE_SIZE) {
+			FONSpage* page;
+			if (x < oldw && y < oldh) continue;
+			if (stash->npages+1 > stash->cpages) {
+				FONSpage* pages;
+				int cpages = stash->cpages == 0 ? 16 : stash->cpages * 2;
+				pages = (FONSpage*)realloc(stash->pages, sizeof(FONSpage) * cpages);
+				if (pages == NULL) return 0;
+				stash->pages = pages;
+				stash->cpages = cpages;
+			}
+			page = &stash->pages[stash->npages];
+			page->x = x;
+			page->y = y;
+			page->lastUsed = stash->frame;
+			page->evictions = 0;
+			page->span = -1;
+			page->atlas = fons__allocAtlas(fons__mini(FONS_PAGE_SIZE, w - x), fons__mini(FONS_PAGE_SIZE, h - y), FONS_INIT_ATLAS_NODES,
+										   stash->params.flags & FONS_PACK_MAXRECTS);
+			if (page->atlas == NULL) return 0;
+			stash->npages++;
+		}
+	}
+	return 1;
+}
 
+static int fons__pageAddRect(FONScontext* stash, int p, int rw, int rh, int* rx, int* ry)
+{
+	FONSpage* page = &stash->pages[p];
+	if (fons__atlasAddRect(page->atlas, rw, rh, rx, ry) == 0)
+		return 0;
+	*rx += page->x;
+	*ry += page->y;
+	page->lastUsed = stash->frame;
+	stash->page = p;
 	return 1;
 }
 
+static void fons__addWhiteRect(FONScontext* stash, int w, int h);
+
+// Frame in which a glyph of the page was last drawn, pages of a block are used with the glyph on its first page.
+static int fons__pageLastUsed(FONScontext* stash, int p)
+{
+	int span = stash->pages[p].span;
+	return stash->pages[span != -1 ? span : p].lastUsed;
+}
+
+// Throws away the glyphs of a page, the glyph entries are kept and rasterized again on demand.
+static void fons__clearPage(FONScontext* stash, int p)
+{
+	FONSpage* page = &stash->pages[p];
+	int i, j, y;
+
+	for (i = 0; i < stash->nfonts; i++) {
+		FONSfont* font = stash->fonts[i];
+		for (j = 0; j < font->nglyphs; j++) {
+			FONSglyph* glyph = &font->glyphs[j];
+			if (glyph->page != p || glyph->x0 < 0) continue;
+			font->evicted++;
+			// Same as a glyph created without bitmap.
+			glyph->x1 = (short)(glyph->x1 - glyph->x0 - 1);
+			glyph->y1 = (short)(glyph->y1 - glyph->y0 - 1);
+			glyph->x0 = -1;
+			glyph->y0 = -1;
+			glyph->pending = 0;
+		}
+	}
+
+	fons__atlasReset(page->atlas, page->atlas->width, page->atlas->height);
+	for (y = 0; y < page->atlas->height; y++)
+		memset(&stash->texData[page->x + (page->y + y) * stash->params.width], 0, page->atlas->width);
+	fons__addDirty(stash, page->x, page->y, page->x + page->atlas->width, page->y + page->atlas->height);
+	stash->evictions++;
+	page->evictions++;
+	page->span = -1;
+
+	if (p == 0)
+		fons__addWhiteRect(stash, 2,2);
+}
+
+// Evicts a page, or all pages of its block.
+static void fons__evictPageAt(FONScontext* stash, int p)
+{
+	int i, span = stash->pages[p].span;
+	if (span == -1) {
+		fons__clearPage(stash, p);
+		return;
+	}
+	for (i = 0; i < stash->npages; i++) {
+		if (stash->pages[i].span == span)
+			fons__clearPage(stash, i);
+	}
+}
+
+// Throws away the glyphs of the least recently used page that is not used in the current frame.
+static int fons__evictPage(FONScontext* stash, int rw, int rh)
+{
+	FONSpage* page;
+	int i, best = -1;
+
+	for (i = 0; i < stash->npages; i++) {
+		page = &stash->pages[i];
+		if (fons__pageLastUsed(stash, i) >= stash->frame || page->atlas->width < rw || page->atlas->height < rh) continue;
+		if (best == -1 || fons__pageLastUsed(stash, i) < fons__pageLastUsed(stash, best))
+			best = i;
+	}
+	if (best == -1) return -1;
+	fons__evictPageAt(stash, best);
+	return best;
+}
+
+// Returns non-zero if page q is in the block of size rw,rh starting at page p.
+static int fons__pageInBlock(FONScontext* stash, int p, int q, int rw, int rh)
+{
+	const FONSpage* a = &stash->pages[p];
+	const FONSpage* b = &stash->pages[q];
+	return b->x >= a->x && b->x < a->x + rw && b->y >= a->y && b->y < a->y + rh;
+}
+
+// Places a glyph larger than a page over a block of pages not used in the current frame. The pages of the
+// block are evicted and hold only that glyph, the glyph is on the first page of the block.
+static int fons__allocSpan(FONScontext* stash, int rw, int rh, int* rx, int* ry)
+{
+	int i, j, gx, gy, best = -1, bestUsed = 0;
+
+	// The first page keeps the white rectangle, blocks start at other pages.
+	for (i = 1; i < stash->npages; i++) {
+		FONSpage* page = &stash->pages[i];
+		int used = page->lastUsed, ok = 1;
+		if (page->x + rw > stash->params.width || page->y + rh > stash->params.height) continue;
+		for (j = 0; j < stash->npages && ok; j++) {
+			if (!fons__pageInBlock(stash, i, j, rw, rh)) continue;
+			if (j == 0 || fons__pageLastUsed(stash, j) >= stash->frame)
+				ok = 0;
+			used = fons__maxi(used, fons__pageLastUsed(stash, j));
+		}
+		if (ok && (best == -1 || used < bestUsed)) {
+			best = i;
+			bestUsed = used;
+		}
+	}
+	if (best == -1) return -1;
+
+	for (j = 0; j < stash->npages; j++) {
+		FONSpage* page = &stash->pages[j];
+		if (!fons__pageInBlock(stash, best, j, rw, rh)) continue;
+		if (page->atlas->used > 0 || page->span != -1)
+			fons__evictPageAt(stash, j);
+		fons__atlasAddRect(page->atlas, page->atlas->width, page->atlas->height, &gx, &gy);
+		page->span = best;
+		page->lastUsed = stash->frame;
+	}
+	*rx = stash->pages[best].x;
+	*ry = stash->pages[best].y;
+	return best;
+}
+
+// Finds space for a glyph, evicting a page if none of them has room.
+static int fons__allocGlyphRect(FONScontext* stash, int rw, int rh, int* rx, int* ry)
+{
+	int i, p;
+	if (stash->npages == 0) return -1;
+	if (rw > FONS_PAGE_SIZE || rh > FONS_PAGE_SIZE)
+		return fons__allocSpan(stash, rw, rh, rx, ry);
+	if (fons__pageAddRect(stash, stash->page, rw, rh, rx, ry))
+		return stash->page;
+	for (i = 0; i < stash->npages; i++) {
+		if (i != stash->page && fons__pageAddRect(stash, i, rw, rh, rx, ry))
+			return i;
+	}
+	p = fons__evictPage(stash, rw, rh);
+	if (p != -1 && fons__pageAddRect(stash, p, rw, rh, rx, ry))
+		return p;
+	return -1;
+}
+
 static void fons__addWhiteRect(FONScontext* stash, int w, int h)
 {
 	int x, y, gx, gy;
 	unsigned char* dst;
-	if (fons__atlasAddRect(stash->atlas, w, h, &gx, &gy) == 0)
+	if (stash->npages == 0 || fons__pageAddRect(stash, 0, w, h, &gx, &gy) == 0)
 		return;
 
 	// Rasterize
@@ -725,10 +1591,7 @@ static void fons__addWhiteRect(FONScontext* stash, int w, int h)
 		dst += stash->params.width;
 	}
 
-	stash->dirtyRect[0] = fons__mini(stash->dirtyRect[0], gx);
-	stash->dirtyRect[1] = fons__mini(stash->dirtyRect[1], gy);
-	stash->dirtyRect[2] = fons__maxi(stash->dirtyRect[2], gx+w);
-	stash->dirtyRect[3] = fons__maxi(stash->dirtyRect[3], gy+h);
+	fons__addDirty(stash, gx, gy, gx+w, gy+h);
 }
 
 FONScontext* fonsCreateInternal(FONSparams* params)
@@ -741,6 +1604,10 @@ FONScontext* fonsCreateInternal(FONSparams* params)
 	memset(stash, 0, sizeof(FONScontext));
 
 	stash->params = *params;
+	stash->subpixel = 1;
+#if defined(FONS_USE_COVERAGE) && !defined(FONS_USE_FREETYPE)
+	stash->rasterizer = FONS_RASTER_COVERAGE;
+#endif
 
 	// Allocate scratch buffer.
 	stash->scratch = (unsigned char*)malloc(FONS_SCRATCH_BUF_SIZE);
@@ -754,8 +1621,7 @@ FONScontext* fonsCreateInternal(FONSparams* params)
 			goto error;
 	}
 
-	stash->atlas = fons__allocAtlas(stash->params.width, stash->params.height, FONS_INIT_ATLAS_NODES);
-	if (stash->atlas == NULL) goto error;
+	if (!fons__addPages(stash, 0, 0, stash->params.width, stash->params.height)) goto error;
 
 	// Allocate space for fonts.
 	stash->fonts = (FONSfont**)malloc(sizeof(FONSfont*) * FONS_INIT_FONTS);
@@ -771,10 +1637,7 @@ FONScontext* fonsCreateInternal(FONSparams* params)
 	if (stash->texData == NULL) goto error;
 	memset(stash->texData, 0, stash->params.width * stash->params.height);
 
-	stash->dirtyRect[0] = stash->params.width;
-	stash->dirtyRect[1] = stash->params.height;
-	stash->dirtyRect[2] = 0;
-	stash->dirtyRect[3] = 0;
+	stash->ndirty = 0;
 
 	// Add white rect at 0,0 for debug drawing.
 	fons__addWhiteRect(stash, 2,2);
@@ -799,20 +1662,100 @@ int fonsAddFallbackFont(FONScontext* stash, int base, int fallback)
 	FONSfont* baseFont = stash->fonts[base];
 	if (baseFont->nfallbacks < FONS_MAX_FALLBACKS) {
 		baseFont->fallbacks[baseFont->nfallbacks++] = fallback;
+		// Codepoints may map to glyphs of the new fallback.
+		if (baseFont->kern) free(baseFont->kern);
+		baseFont->kern = NULL;
+		baseFont->nfallbackMap = 0;
+		if (baseFont->fallbackMap)
+			memset(baseFont->fallbackMap, 0xff, sizeof(FONSfallbackEntry) * baseFont->cfallbackMap);
 		return 1;
 	}
 	return 0;
 }
 
-void fonsResetFallbackFont(FONScontext* stash, int base)
+// Empties the glyph hash, the slots are kept for the glyphs created next.
+static void fons__clearGlyphHash(FONSfont* font)
 {
-	int i;
+	font->nslots = 0;
+	if (font->slots)
+		memset(font->slots, 0xff, sizeof(FONSglyphSlot) * font->cslots);
+}
 
+void fonsResetFallbackFont(FONScontext* stash, int base)
+{
 	FONSfont* baseFont = stash->fonts[base];
 	baseFont->nfallbacks = 0;
 	baseFont->nglyphs = 0;
-	for (i = 0; i < FONS_HASH_LUT_SIZE; i++)
-		baseFont->lut[i] = -1;
+	if (baseFont->kern) free(baseFont->kern);
+	baseFont->kern = NULL;
+	baseFont->nfallbackMap = 0;
+	if (baseFont->fallbackMap)
+		memset(baseFont->fallbackMap, 0xff, sizeof(FONSfallbackEntry) * baseFont->cfallbackMap);
+	stash->generation++;
+	fons__clearGlyphHash(baseFont);
+}
+
+int fonsSetFontSDF(FONScontext* stash, int font, int enabled)
+{
+	if (font < 0 || font >= stash->nfonts) return 0;
+#ifdef FONS_USE_FREETYPE
+	if (enabled) return 0;
+#endif
+	stash->fonts[font]->sdf = enabled ? 1 : 0;
+	return 1;
+}
+
+int fonsGetFontSDF(FONScontext* stash, int font)
+{
+	if (font < 0 || font >= stash->nfonts) return 0;
+	return stash->fonts[font]->sdf;
+}
+
+void fonsGetGlyphStats(FONScontext* stash, int font, FONSglyphStats* stats)
+{
+	int i, j;
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < stash->nfonts; i++) {
+		FONSfont* f = stash->fonts[i];
+		if (font != -1 && font != i) continue;
+		stats->hits += f->hits;
+		stats->misses += f->misses;
+		stats->rasterized += f->rasterized;
+		stats->evicted += f->evicted;
+		stats->lookups += f->lookups;
+		stats->probes += f->probes;
+		stats->maxProbe = fons__maxi(stats->maxProbe, f->maxProbe);
+		stats->hashSlots += f->cslots;
+		for (j = 0; j < f->nglyphs; j++) {
+			FONSglyph* glyph = &f->glyphs[j];
+			if (glyph->x0 < 0) continue;
+			stats->glyphs++;
+			stats->atlasBytes += (glyph->x1 - glyph->x0) * (glyph->y1 - glyph->y0);
+		}
+	}
+}
+
+void fonsSetSizeBuckets(FONScontext* stash, int perOctave)
+{
+	stash->sizeBuckets = perOctave > 0 ? perOctave : 0;
+	stash->bucketFrom = stash->bucketTo = 0;
+}
+
+int fonsGetSizeBuckets(FONScontext* stash)
+{
+	return stash->sizeBuckets;
+}
+
+// Returns the size the glyphs of isize are rasterized at, the last mapping is kept as sizes repeat.
+static short fons__bucketSize(FONScontext* stash, short isize)
+{
+	float b;
+	if (stash->sizeBuckets == 0 || isize < 2) return isize;
+	if (isize == stash->bucketFrom || isize == stash->bucketTo) return stash->bucketTo;
+	b = floorf(logf(isize / 10.0f) / logf(2.0f) * stash->sizeBuckets + 0.5f);
+	stash->bucketFrom = isize;
+	stash->bucketTo = (short)fons__maxi(2, (int)(powf(2.0f, b / stash->sizeBuckets) * 10.0f + 0.5f));
+	return stash->bucketTo;
 }
 
 void fonsSetSize(FONScontext* stash, float size)
@@ -878,15 +1821,70 @@ void fonsClearState(FONScontext* stash)
 	state->align = FONS_ALIGN_LEFT | FONS_ALIGN_BASELINE;
 }
 
-static void fons__freeFont(FONSfont* font)
-{
-	if (font == NULL) return;
-	if (font->glyphs) free(font->glyphs);
-	if (font->freeData && font->data) free(font->data);
-	free(font);
-}
-
-static int fons__allocFont(FONScontext* stash)
+// Maps a file read-only, or reads it into memory where mapping is not available.
+static unsigned char* fons__mapFile(const char* path, int* size, int* mapped)
+{
+	unsigned char* data = NULL;
+#ifdef FONS_MMAP
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) return NULL;
+	if (fstat(fd, &st) == 0 && st.st_size > 0 && st.st_size <= 0x7fffffff) {
+		void* ptr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (ptr != MAP_FAILED) {
+			data = (unsigned char*)ptr;
+			*size = (int)st.st_size;
+			*mapped = 1;
+		}
+	}
+	close(fd);
+	if (data != NULL) return data;
+#endif
+	{
+		FILE* fp = fopen(path, "rb");
+		long n;
+		if (fp == NULL) return NULL;
+		fseek(fp, 0, SEEK_END);
+		n = ftell(fp);
+		fseek(fp, 0, SEEK_SET);
+		if (n > 0 && n <= 0x7fffffff)
+			data = (unsigned char*)malloc((size_t)n);
+		if (data != NULL && fread(data, 1, (size_t)n, fp) != (size_t)n) {
+			free(data);
+			data = NULL;
+		}
+		fclose(fp);
+		*size = (int)n;
+		*mapped = 0;
+	}
+	return data;
+}
+
+static void fons__unmapFile(unsigned char* data, int size, int mapped)
+{
+#ifdef FONS_MMAP
+	if (mapped) {
+		munmap(data, (size_t)size);
+		return;
+	}
+#endif
+	FONS_NOTUSED(size);
+	FONS_NOTUSED(mapped);
+	free(data);
+}
+
+static void fons__freeFont(FONSfont* font)
+{
+	if (font == NULL) return;
+	if (font->glyphs) free(font->glyphs);
+	if (font->kern) free(font->kern);
+	if (font->fallbackMap) free(font->fallbackMap);
+	if (font->slots) free(font->slots);
+	if (font->freeData && font->data) fons__unmapFile(font->data, font->dataSize, font->mapped);
+	free(font);
+}
+
+static int fons__allocFont(FONScontext* stash)
 {
 	FONSfont* font = NULL;
 	if (stash->nfonts+1 > stash->cfonts) {
@@ -915,30 +1913,21 @@ error:
 
 int fonsAddFont(FONScontext* stash, const char* name, const char* path, int fontIndex)
 {
-	FILE* fp = 0;
-	int dataSize = 0;
-	size_t readed;
-	unsigned char* data = NULL;
+	int idx, dataSize = 0, mapped = 0;
+	unsigned char* data;
 
-	// Read in the font data.
-	fp = fopen(path, "rb");
-	if (fp == NULL) goto error;
-	fseek(fp,0,SEEK_END);
-	dataSize = (int)ftell(fp);
-	fseek(fp,0,SEEK_SET);
-	data = (unsigned char*)malloc(dataSize);
-	if (data == NULL) goto error;
-	readed = fread(data, 1, dataSize, fp);
-	fclose(fp);
-	fp = 0;
-	if (readed != (size_t)dataSize) goto error;
-
-	return fonsAddFontMem(stash, name, data, dataSize, 1, fontIndex);
+	// Map the font data, pages are read in as glyphs need them and shared with other processes.
+	data = fons__mapFile(path, &dataSize, &mapped);
+	if (data == NULL) return FONS_INVALID;
 
-error:
-	if (data) free(data);
-	if (fp) fclose(fp);
-	return FONS_INVALID;
+	idx = fonsAddFontMem(stash, name, data, dataSize, 0, fontIndex);
+	if (idx == FONS_INVALID) {
+		fons__unmapFile(data, dataSize, mapped);
+		return FONS_INVALID;
+	}
+	stash->fonts[idx]->freeData = 1;
+	stash->fonts[idx]->mapped = (unsigned char)mapped;
+	return idx;
 }
 
 int fonsAddFontMem(FONScontext* stash, const char* name, unsigned char* data, int dataSize, int freeData, int fontIndex)
@@ -955,14 +1944,15 @@ int fonsAddFontMem(FONScontext* stash, const char* name, unsigned char* data, in
 	strncpy(font->name, name, sizeof(font->name));
 	font->name[sizeof(font->name)-1] = '\0';
 
-	// Init hash lookup.
-	for (i = 0; i < FONS_HASH_LUT_SIZE; ++i)
-		font->lut[i] = -1;
+	// Init glyph lookup.
+	for (i = 0; i < FONS_LATIN_SIZES; ++i)
+		font->latin[i].size = -1;
 
 	// Read in the font data.
 	font->dataSize = dataSize;
 	font->data = data;
 	font->freeData = (unsigned char)freeData;
+	font->index = fontIndex;
 
 	// Init font
 	stash->nscratch = 0;
@@ -985,6 +1975,43 @@ error:
 	return FONS_INVALID;
 }
 
+static size_t fons__residentBytes(unsigned char* data, int size)
+{
+#ifdef FONS_MMAP
+	size_t i, n, count = 0, pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	unsigned char* vec;
+	n = ((size_t)size + pageSize-1) / pageSize;
+	vec = (unsigned char*)malloc(n);
+	if (vec == NULL) return 0;
+	if (mincore((void*)data, (size_t)size, (void*)vec) == 0) {
+		for (i = 0; i < n; i++)
+			count += vec[i] & 1;
+	}
+	free(vec);
+	count *= pageSize;
+	return count < (size_t)size ? count : (size_t)size;
+#else
+	FONS_NOTUSED(data);
+	return (size_t)size;
+#endif
+}
+
+void fonsFontMemory(FONScontext* stash, size_t* mapped, size_t* resident, size_t* heap)
+{
+	int i;
+	*mapped = *resident = *heap = 0;
+	if (stash == NULL) return;
+	for (i = 0; i < stash->nfonts; i++) {
+		FONSfont* font = stash->fonts[i];
+		if (font->mapped) {
+			*mapped += (size_t)font->dataSize;
+			*resident += fons__residentBytes(font->data, font->dataSize);
+		} else {
+			*heap += (size_t)font->dataSize;
+		}
+	}
+}
+
 int fonsGetFontByName(FONScontext* s, const char* name)
 {
 	int i;
@@ -1052,7 +2079,67 @@ static void fons__blurRows(unsigned char* dst, int w, int h, int dstStride, int
 		dst++;
 	}
 }
+#ifdef FONS_SSE2
+// Same filter as fons__blurRows for 16 adjacent columns. The values fit in 16 bits, and the
+// product with alpha shifted by APREC is the high half of a 16 bit multiply.
+static void fons__blurLanes16(unsigned char* dst, int h, int dstStride, int alpha)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i a = _mm_set1_epi16((short)alpha);
+	__m128i ahigh = alpha >= 0x8000 ? _mm_set1_epi16(-1) : zero; // alpha as signed 16 bits is alpha - 65536
+	__m128i zlo = zero, zhi = zero;
+	int y;
+
+#define FONS_BLUR_STEP(p) { \
+		__m128i v = _mm_loadu_si128((const __m128i*)(p)); \
+		__m128i dlo = _mm_sub_epi16(_mm_slli_epi16(_mm_unpacklo_epi8(v, zero), ZPREC), zlo); \
+		__m128i dhi = _mm_sub_epi16(_mm_slli_epi16(_mm_unpackhi_epi8(v, zero), ZPREC), zhi); \
+		zlo = _mm_add_epi16(zlo, _mm_add_epi16(_mm_mulhi_epi16(dlo, a), _mm_and_si128(dlo, ahigh))); \
+		zhi = _mm_add_epi16(zhi, _mm_add_epi16(_mm_mulhi_epi16(dhi, a), _mm_and_si128(dhi, ahigh))); \
+		_mm_storeu_si128((__m128i*)(p), _mm_packus_epi16(_mm_srli_epi16(zlo, ZPREC), _mm_srli_epi16(zhi, ZPREC))); \
+	}
 
+	for (y = 1; y < h; y++)
+		FONS_BLUR_STEP(dst + y*dstStride);
+	memset(dst + (h-1)*dstStride, 0, 16); // force zero border
+	zlo = zhi = zero;
+	for (y = h-2; y >= 0; y--)
+		FONS_BLUR_STEP(dst + y*dstStride);
+	memset(dst, 0, 16); // force zero border
+
+#undef FONS_BLUR_STEP
+}
+
+static void fons__blurRowsSSE2(unsigned char* dst, int w, int h, int dstStride, int alpha)
+{
+	int x;
+	for (x = 0; x + 16 <= w; x += 16)
+		fons__blurLanes16(dst + x, h, dstStride, alpha);
+	if (x < w)
+		fons__blurRows(dst + x, w - x, h, dstStride, alpha);
+}
+
+// Filters 16 rows at a time by transposing them so that they are adjacent in memory.
+static void fons__blurColsSSE2(unsigned char* dst, int w, int h, int dstStride, int alpha)
+{
+	unsigned char tmp[FONS_BLUR_MAX_WIDTH*16];
+	int x, y = 0, i;
+	if (w <= FONS_BLUR_MAX_WIDTH) {
+		for (; y + 16 <= h; y += 16) {
+			unsigned char* row = dst + y*dstStride;
+			for (i = 0; i < 16; i++)
+				for (x = 0; x < w; x++)
+					tmp[x*16 + i] = row[i*dstStride + x];
+			fons__blurLanes16(tmp, w, 16, alpha);
+			for (i = 0; i < 16; i++)
+				for (x = 0; x < w; x++)
+					row[i*dstStride + x] = tmp[x*16 + i];
+		}
+	}
+	if (y < h)
+		fons__blurCols(dst + y*dstStride, w, h - y, dstStride, alpha);
+}
+#endif
 
 static void fons__blur(FONScontext* stash, unsigned char* dst, int w, int h, int dstStride, int blur)
 {
@@ -1065,84 +2152,409 @@ static void fons__blur(FONScontext* stash, unsigned char* dst, int w, int h, int
 	// Calculate the alpha such that 90% of the kernel is within the radius. (Kernel extends to infinity)
 	sigma = (float)blur * 0.57735f; // 1 / sqrt(3)
 	alpha = (int)((1<<APREC) * (1.0f - expf(-2.3f / (sigma+1.0f))));
+#ifdef FONS_SSE2
+	fons__blurRowsSSE2(dst, w, h, dstStride, alpha);
+	fons__blurColsSSE2(dst, w, h, dstStride, alpha);
+	fons__blurRowsSSE2(dst, w, h, dstStride, alpha);
+	fons__blurColsSSE2(dst, w, h, dstStride, alpha);
+#else
 	fons__blurRows(dst, w, h, dstStride, alpha);
 	fons__blurCols(dst, w, h, dstStride, alpha);
 	fons__blurRows(dst, w, h, dstStride, alpha);
 	fons__blurCols(dst, w, h, dstStride, alpha);
+#endif
 //	fons__blurrows(dst, w, h, dstStride, alpha);
 //	fons__blurcols(dst, w, h, dstStride, alpha);
 }
 
+// Returns the slot of the codepoint in the fallback map, or the empty slot where it goes.
+static FONSfallbackEntry* fons__findFallback(FONSfont* font, unsigned int codepoint)
+{
+	unsigned int mask = (unsigned int)font->cfallbackMap - 1;
+	unsigned int i = fons__hashint(codepoint) & mask;
+	while (font->fallbackMap[i].codepoint != codepoint && font->fallbackMap[i].codepoint != FONS_NO_CODEPOINT)
+		i = (i + 1) & mask;
+	return &font->fallbackMap[i];
+}
+
+// Remembers the fallback resolved for a codepoint, the map is grown to stay at most half full.
+static void fons__addFallback(FONSfont* font, unsigned int codepoint, int fallback, int index)
+{
+	FONSfallbackEntry* entry;
+	if (codepoint == FONS_NO_CODEPOINT) return;
+	if ((font->nfallbackMap+1) * 2 > font->cfallbackMap) {
+		int i, cmap = font->cfallbackMap == 0 ? 64 : font->cfallbackMap * 2;
+		FONSfallbackEntry* old = font->fallbackMap;
+		int cold = font->cfallbackMap;
+		FONSfallbackEntry* map = (FONSfallbackEntry*)malloc(sizeof(FONSfallbackEntry) * cmap);
+		if (map == NULL) return;
+		memset(map, 0xff, sizeof(FONSfallbackEntry) * cmap);
+		font->fallbackMap = map;
+		font->cfallbackMap = cmap;
+		for (i = 0; i < cold; i++) {
+			if (old[i].codepoint != FONS_NO_CODEPOINT)
+				*fons__findFallback(font, old[i].codepoint) = old[i];
+		}
+		if (old) free(old);
+	}
+	entry = fons__findFallback(font, codepoint);
+	if (entry->codepoint == FONS_NO_CODEPOINT)
+		font->nfallbackMap++;
+	entry->codepoint = codepoint;
+	entry->font = fallback;
+	entry->index = index;
+}
+
+// Returns the font which has the codepoint, the base font or one of its fallbacks.
+static FONSfont* fons__glyphFont(FONScontext* stash, FONSfont* font, unsigned int codepoint, int* index)
+{
+	int i;
+	*index = fons__tt_getGlyphIndex(&font->font, codepoint);
+	// Try to find the glyph in fallback fonts, the result is kept to avoid searching them again.
+	if (*index == 0 && font->nfallbacks > 0) {
+		FONSfallbackEntry* entry = font->cfallbackMap > 0 && codepoint != FONS_NO_CODEPOINT ? fons__findFallback(font, codepoint) : NULL;
+		if (entry != NULL && entry->codepoint == codepoint) {
+			if (entry->font == -1) return font;
+			*index = entry->index;
+			return stash->fonts[entry->font];
+		}
+		for (i = 0; i < font->nfallbacks; ++i) {
+			FONSfont* fallbackFont = stash->fonts[font->fallbacks[i]];
+			int fallbackIndex = fons__tt_getGlyphIndex(&fallbackFont->font, codepoint);
+			if (fallbackIndex != 0) {
+				fons__addFallback(font, codepoint, font->fallbacks[i], fallbackIndex);
+				*index = fallbackIndex;
+				return fallbackFont;
+			}
+		}
+		// It is possible that we did not find a fallback glyph.
+		// In that case the glyph index is 0, and we'll proceed and cache empty glyph.
+		fons__addFallback(font, codepoint, -1, 0);
+	}
+	return font;
+}
+
+// Rasterizes a glyph into a gw*gh area including padding, callable from workers with a copy of the font.
+// A blurred glyph can be made from the bitmap src of the same glyph without blur, at the same stride.
+static void fons__renderGlyph(FONSttFontImpl* impl, unsigned char* dst, int stride, int gw, int gh, int pad,
+							  float scale, float shift, int index, int sdf, int rasterizer, int blur, const unsigned char* src)
+{
+	int x, y;
+
+	if (src != NULL) {
+		for (y = 0; y < gh-pad*2; y++)
+			memcpy(&dst[pad + (pad+y)*stride], &src[y*stride], gw-pad*2);
+	} else if (sdf) {
+		// The distance field covers the padding, only the one pixel border is left empty.
+		for (y = 1; y < gh-1; y++)
+			memset(&dst[1 + y*stride], 0, gw-2);
+		fons__tt_renderGlyphSDF(impl, &dst[1 + stride], gw-2, gh-2, stride, scale, FONS_SDF_PAD, index);
+	} else {
+		unsigned char* out = &dst[pad + pad*stride];
+		if (rasterizer != FONS_RASTER_COVERAGE ||
+			!fons__tt_renderGlyphCoverage(impl, out, gw-pad*2, gh-pad*2, stride, scale, scale, shift, index))
+			fons__tt_renderGlyphBitmap(impl, out, gw-pad*2, gh-pad*2, stride, scale, scale, shift, index);
+	}
+
+	// Make sure there is one pixel empty border.
+	for (y = 0; y < gh; y++) {
+		dst[y*stride] = 0;
+		dst[gw-1 + y*stride] = 0;
+	}
+	for (x = 0; x < gw; x++) {
+		dst[x] = 0;
+		dst[x + (gh-1)*stride] = 0;
+	}
+
+	// Blur
+	if (blur > 0)
+		fons__blur(NULL, dst, gw, gh, stride, blur);
+}
+
+static void fons__dirtyGlyph(FONScontext* stash, FONSglyph* glyph)
+{
+	fons__addDirty(stash, glyph->x0, glyph->y0, glyph->x1, glyph->y1);
+}
+
+#ifdef FONS_THREADS
+static void* fons__worker(void* arg)
+{
+	FONScontext* stash = (FONScontext*)arg;
+	FONSglyphJob job;
+	unsigned char* data;
+	int seq;
+
+	pthread_mutex_lock(&stash->lock);
+	while (!stash->quit) {
+		if (stash->jobNext >= stash->njobs) {
+			pthread_cond_wait(&stash->wake, &stash->lock);
+			continue;
+		}
+		// The job array may move while unlocked, work on a copy and find it again by sequence number.
+		seq = stash->jobBase + stash->jobNext;
+		job = stash->jobs[stash->jobNext++];
+		pthread_mutex_unlock(&stash->lock);
+
+		data = (unsigned char*)calloc(job.gw * job.gh, 1);
+		if (data != NULL)
+			fons__renderGlyph(&job.impl, data, job.gw, job.gw, job.gh, job.pad, job.scale, job.shift, job.index, job.sdf, job.rasterizer, job.blur, NULL);
+
+		pthread_mutex_lock(&stash->lock);
+		stash->jobs[seq - stash->jobBase].data = data;
+		stash->jobs[seq - stash->jobBase].done = 1;
+	}
+	pthread_mutex_unlock(&stash->lock);
+	return NULL;
+}
+#endif
+
+static int fons__queueGlyph(FONScontext* stash, FONSfont* font, FONSglyph* glyph, FONSfont* renderFont, float scale, int pad)
+{
+#ifdef FONS_THREADS
+	FONSglyphJob* job;
+	int i;
+
+	pthread_mutex_lock(&stash->lock);
+	if (stash->njobs+1 > stash->cjobs) {
+		FONSglyphJob* jobs;
+		int cjobs = stash->cjobs == 0 ? 64 : stash->cjobs * 2;
+		jobs = (FONSglyphJob*)realloc(stash->jobs, sizeof(FONSglyphJob) * cjobs);
+		if (jobs == NULL) {
+			pthread_mutex_unlock(&stash->lock);
+			return 0;
+		}
+		stash->jobs = jobs;
+		stash->cjobs = cjobs;
+	}
+	job = &stash->jobs[stash->njobs++];
+	memset(job, 0, sizeof(*job));
+	for (i = 0; i < stash->nfonts; i++) {
+		if (stash->fonts[i] == font) job->font = i;
+	}
+	job->glyph = (int)(glyph - font->glyphs);
+	job->generation = stash->generation;
+	job->impl = renderFont->font;
+	job->impl.font.userdata = NULL;
+	job->index = glyph->index;
+	job->gw = glyph->x1 - glyph->x0;
+	job->gh = glyph->y1 - glyph->y0;
+	job->pad = pad;
+	job->blur = glyph->blur;
+	job->sdf = font->sdf;
+	job->rasterizer = stash->rasterizer;
+	job->scale = scale;
+	job->shift = glyph->phase / (float)FONS_SUBPIXEL_UNITS;
+	glyph->pending = 1;
+	pthread_cond_signal(&stash->wake);
+	pthread_mutex_unlock(&stash->lock);
+	return 1;
+#else
+	FONS_NOTUSED(stash); FONS_NOTUSED(font); FONS_NOTUSED(glyph);
+	FONS_NOTUSED(renderFont); FONS_NOTUSED(scale); FONS_NOTUSED(pad);
+	return 0;
+#endif
+}
+
+// Rasterizes a glyph on the calling thread when it is needed before its worker is done.
+static void fons__finishGlyph(FONScontext* stash, FONSfont* font, FONSglyph* glyph)
+{
+	FONSfont* renderFont;
+	float size = font->sdf ? FONS_SDF_SIZE : glyph->size/10.0f;
+	int index;
+
+	renderFont = fons__glyphFont(stash, font, glyph->codepoint, &index);
+	fons__renderGlyph(&renderFont->font, &stash->texData[glyph->x0 + glyph->y0 * stash->params.width], stash->params.width,
+					  glyph->x1 - glyph->x0, glyph->y1 - glyph->y0, font->sdf ? FONS_SDF_PAD+1 : glyph->blur+2,
+					  fons__tt_getPixelHeightScale(&renderFont->font, size), glyph->phase / (float)FONS_SUBPIXEL_UNITS,
+					  index, font->sdf, stash->rasterizer, glyph->blur, NULL);
+	fons__dirtyGlyph(stash, glyph);
+	glyph->pending = 0;
+}
+
+// Returns the dense table of the glyph size, reusing the least recently used one for a new size.
+static FONSlatin* fons__latinTable(FONScontext* stash, FONSfont* font, short isize, short iblur)
+{
+	int i, best = 0;
+	FONSlatin* latin = &font->latin[font->latinLast];
+
+	if (latin->size != isize || latin->blur != iblur) {
+		for (i = 0; i < FONS_LATIN_SIZES; i++) {
+			if (font->latin[i].size == isize && font->latin[i].blur == iblur) break;
+			if (font->latin[i].lastUsed < font->latin[best].lastUsed) best = i;
+		}
+		if (i == FONS_LATIN_SIZES) {
+			i = best;
+			font->latin[i].size = isize;
+			font->latin[i].blur = iblur;
+			font->latin[i].generation = stash->generation - 1;
+		}
+		latin = &font->latin[i];
+		latin->lastUsed = ++font->latinClock;
+		font->latinLast = i;
+	}
+	// Glyph entries are thrown away with the atlas.
+	if (latin->generation != stash->generation) {
+		for (i = 0; i < 256; i++)
+			latin->glyphs[i] = -1;
+		latin->generation = stash->generation;
+	}
+	return latin;
+}
+
+static unsigned int fons__glyphHash(unsigned int codepoint, short isize, short iblur, short phase)
+{
+	unsigned int key = ((unsigned int)(unsigned short)isize << 16) | ((unsigned int)(iblur & 0xff) << 8) | (unsigned int)(phase & 0xff);
+	return fons__hashint(codepoint ^ fons__hashint(key));
+}
+
+// Returns index of the glyph entry of codepoint at size, blur and phase, or -1 if there is none.
+static int fons__findGlyph(FONSfont* font, unsigned int codepoint, short isize, short iblur, short phase)
+{
+	unsigned int h, i, mask;
+	int probes = 1;
+	if (font->cslots == 0) return -1;
+	h = fons__glyphHash(codepoint, isize, iblur, phase);
+	mask = (unsigned int)font->cslots - 1;
+	i = h & mask;
+	while (font->slots[i].glyph != -1) {
+		const FONSglyph* glyph = &font->glyphs[font->slots[i].glyph];
+		if (font->slots[i].hash == h && glyph->codepoint == codepoint && glyph->size == isize && glyph->blur == iblur &&
+			glyph->phase == phase)
+			break;
+		i = (i + 1) & mask;
+		probes++;
+	}
+	font->lookups++;
+	font->probes += probes;
+	if (probes > font->maxProbe) font->maxProbe = probes;
+	return font->slots[i].glyph;
+}
+
+// Adds the glyph entry to the hash, which is grown to stay at most half full. Returns 0 if out of memory.
+static int fons__hashGlyph(FONSfont* font, int index)
+{
+	const FONSglyph* glyph = &font->glyphs[index];
+	unsigned int h, i, mask;
+	if ((font->nslots+1) * 2 > font->cslots) {
+		int j, cslots = font->cslots == 0 ? FONS_INIT_GLYPH_SLOTS : font->cslots * 2;
+		FONSglyphSlot* slots = (FONSglyphSlot*)malloc(sizeof(FONSglyphSlot) * cslots);
+		if (slots == NULL) return 0;
+		memset(slots, 0xff, sizeof(FONSglyphSlot) * cslots);
+		mask = (unsigned int)cslots - 1;
+		for (j = 0; j < font->cslots; j++) {
+			if (font->slots[j].glyph == -1) continue;
+			i = font->slots[j].hash & mask;
+			while (slots[i].glyph != -1)
+				i = (i + 1) & mask;
+			slots[i] = font->slots[j];
+		}
+		if (font->slots) free(font->slots);
+		font->slots = slots;
+		font->cslots = cslots;
+	}
+	h = fons__glyphHash(glyph->codepoint, glyph->size, glyph->blur, glyph->phase);
+	mask = (unsigned int)font->cslots - 1;
+	i = h & mask;
+	while (font->slots[i].glyph != -1)
+		i = (i + 1) & mask;
+	font->slots[i].hash = h;
+	font->slots[i].glyph = index;
+	font->nslots++;
+	return 1;
+}
+
+// Returns the bitmap of the glyph without blur if it is in the atlas, for making a blurred variant of it.
+static const unsigned char* fons__unblurredBitmap(FONScontext* stash, FONSfont* font, unsigned int codepoint,
+												  short isize, short phase, int bw, int bh)
+{
+	FONSglyph* glyph;
+	int i = fons__findGlyph(font, codepoint, isize, 0, phase);
+	if (i == -1) return NULL;
+	glyph = &font->glyphs[i];
+	if (glyph->x0 < 0 || glyph->pending) return NULL;
+	if (glyph->x1 - glyph->x0 - 4 != bw || glyph->y1 - glyph->y0 - 4 != bh) return NULL;
+	return &stash->texData[glyph->x0 + 2 + (glyph->y0 + 2) * stash->params.width];
+}
+
 static FONSglyph* fons__getGlyph(FONScontext* stash, FONSfont* font, unsigned int codepoint,
-								 short isize, short iblur, int bitmapOption)
+								 short isize, short iblur, short phase, int bitmapOption)
 {
-	int i, g, advance, lsb, x0, y0, x1, y1, gw, gh, gx, gy, x, y;
+	int i, g, advance, lsb, x0, y0, x1, y1, gw, gh, gx, gy;
 	float scale;
 	FONSglyph* glyph = NULL;
-	unsigned int h;
+	FONSlatin* latin = NULL;
 	float size = isize/10.0f;
-	int pad, added;
-	unsigned char* bdst;
-	unsigned char* dst;
-	FONSfont* renderFont = font;
+	int pad, page;
+	FONSfont* renderFont;
 
 	if (isize < 2) return NULL;
 	if (iblur > 20) iblur = 20;
+	isize = fons__bucketSize(stash, isize);
+	size = isize/10.0f;
 	pad = iblur+2;
 
+	// Distance field glyphs are shared by all sizes and blurs, they are stored with size 0.
+	if (font->sdf) {
+		isize = 0;
+		iblur = 0;
+		phase = 0;
+		size = FONS_SDF_SIZE;
+		pad = FONS_SDF_PAD+1;
+	}
+
 	// Reset allocator.
 	stash->nscratch = 0;
 
-	// Find code point and size.
-	h = fons__hashint(codepoint) & (FONS_HASH_LUT_SIZE-1);
-	i = font->lut[h];
-	while (i != -1) {
-		if (font->glyphs[i].codepoint == codepoint && font->glyphs[i].size == isize && font->glyphs[i].blur == iblur) {
-			glyph = &font->glyphs[i];
-			if (bitmapOption == FONS_GLYPH_BITMAP_OPTIONAL || (glyph->x0 >= 0 && glyph->y0 >= 0)) {
-			  return glyph;
-			}
-			// At this point, glyph exists but the bitmap data is not yet created.
-			break;
+	// Find code point and size, codepoints below 256 are looked up in the table of the size.
+	if (codepoint < 256 && phase == 0) {
+		latin = fons__latinTable(stash, font, isize, iblur);
+		i = latin->glyphs[codepoint];
+	} else {
+		i = -1;
+	}
+	if (i == -1) {
+		i = fons__findGlyph(font, codepoint, isize, iblur, phase);
+		if (i != -1 && latin != NULL)
+			latin->glyphs[codepoint] = i;
+	}
+	if (i != -1) {
+		glyph = &font->glyphs[i];
+		if (bitmapOption == FONS_GLYPH_BITMAP_OPTIONAL || (glyph->x0 >= 0 && glyph->y0 >= 0)) {
+		  if (bitmapOption == FONS_GLYPH_BITMAP_REQUIRED) {
+			  font->hits++;
+			  stash->pages[glyph->page].lastUsed = stash->frame;
+			  if (glyph->pending && !stash->async)
+				  fons__finishGlyph(stash, font, glyph);
+		  }
+		  return glyph;
 		}
-		i = font->glyphs[i].next;
+		// At this point, glyph exists but the bitmap data is not yet created.
 	}
 
 	// Create a new glyph or rasterize bitmap data for a cached glyph.
-	g = fons__tt_getGlyphIndex(&font->font, codepoint);
-	// Try to find the glyph in fallback fonts.
-	if (g == 0) {
-		for (i = 0; i < font->nfallbacks; ++i) {
-			FONSfont* fallbackFont = stash->fonts[font->fallbacks[i]];
-			int fallbackIndex = fons__tt_getGlyphIndex(&fallbackFont->font, codepoint);
-			if (fallbackIndex != 0) {
-				g = fallbackIndex;
-				renderFont = fallbackFont;
-				break;
-			}
-		}
-		// It is possible that we did not find a fallback glyph.
-		// In that case the glyph index 'g' is 0, and we'll proceed below and cache empty glyph.
-	}
+	renderFont = fons__glyphFont(stash, font, codepoint, &g);
 	scale = fons__tt_getPixelHeightScale(&renderFont->font, size);
-	fons__tt_buildGlyphBitmap(&renderFont->font, g, size, scale, &advance, &lsb, &x0, &y0, &x1, &y1);
+	fons__tt_buildGlyphBitmap(&renderFont->font, g, size, scale, phase / (float)FONS_SUBPIXEL_UNITS,
+							  &advance, &lsb, &x0, &y0, &x1, &y1);
 	gw = x1-x0 + pad*2;
 	gh = y1-y0 + pad*2;
 
 	// Determines the spot to draw glyph in the atlas.
 	if (bitmapOption == FONS_GLYPH_BITMAP_REQUIRED) {
+		font->misses++;
 		// Find free spot for the rect in the atlas
-		added = fons__atlasAddRect(stash->atlas, gw, gh, &gx, &gy);
-		if (added == 0 && stash->handleError != NULL) {
+		page = fons__allocGlyphRect(stash, gw, gh, &gx, &gy);
+		if (page == -1 && stash->handleError != NULL) {
 			// Atlas is full, let the user to resize the atlas (or not), and try again.
 			stash->handleError(stash->errorUptr, FONS_ATLAS_FULL, 0);
-			added = fons__atlasAddRect(stash->atlas, gw, gh, &gx, &gy);
+			page = fons__allocGlyphRect(stash, gw, gh, &gx, &gy);
 		}
-		if (added == 0) return NULL;
+		if (page == -1) return NULL;
 	} else {
 		// Negative coordinate indicates there is no bitmap data created.
 		gx = -1;
 		gy = -1;
+		page = 0;
 	}
 
 	// Init glyph.
@@ -1151,11 +2563,12 @@ static FONSglyph* fons__getGlyph(FONScontext* stash, FONSfont* font, unsigned in
 		glyph->codepoint = codepoint;
 		glyph->size = isize;
 		glyph->blur = iblur;
-		glyph->next = 0;
+		glyph->phase = phase;
 
 		// Insert char to hash lookup.
-		glyph->next = font->lut[h];
-		font->lut[h] = font->nglyphs-1;
+		fons__hashGlyph(font, font->nglyphs-1);
+		if (latin != NULL)
+			latin->glyphs[codepoint] = font->nglyphs-1;
 	}
 	glyph->index = g;
 	glyph->x0 = (short)gx;
@@ -1165,25 +2578,23 @@ static FONSglyph* fons__getGlyph(FONScontext* stash, FONSfont* font, unsigned in
 	glyph->xadv = (short)(scale * advance * 10.0f);
 	glyph->xoff = (short)(x0 - pad);
 	glyph->yoff = (short)(y0 - pad);
+	glyph->pending = 0;
+	glyph->page = (short)page;
 
 	if (bitmapOption == FONS_GLYPH_BITMAP_OPTIONAL) {
 		return glyph;
 	}
 
-	// Rasterize
-	dst = &stash->texData[(glyph->x0+pad) + (glyph->y0+pad) * stash->params.width];
-	fons__tt_renderGlyphBitmap(&renderFont->font, dst, gw-pad*2,gh-pad*2, stash->params.width, scale, scale, g);
+	font->rasterized++;
+	// The reserved atlas space is empty, so the glyph draws as nothing until the worker is done.
+	if (stash->async && stash->nworkers > 0 &&
+		fons__queueGlyph(stash, font, glyph, renderFont, scale, pad))
+		return glyph;
 
-	// Make sure there is one pixel empty border.
-	dst = &stash->texData[glyph->x0 + glyph->y0 * stash->params.width];
-	for (y = 0; y < gh; y++) {
-		dst[y*stash->params.width] = 0;
-		dst[gw-1 + y*stash->params.width] = 0;
-	}
-	for (x = 0; x < gw; x++) {
-		dst[x] = 0;
-		dst[x + (gh-1)*stash->params.width] = 0;
-	}
+	// Rasterize, blurred glyphs are made from the glyph without blur when it is in the atlas.
+	fons__renderGlyph(&renderFont->font, &stash->texData[glyph->x0 + glyph->y0 * stash->params.width], stash->params.width,
+					  gw, gh, pad, scale, phase / (float)FONS_SUBPIXEL_UNITS, g, font->sdf, stash->rasterizer, iblur,
+					  iblur > 0 ? fons__unblurredBitmap(stash, font, codepoint, isize, phase, gw - pad*2, gh - pad*2) : NULL);
 
 	// Debug code to color the glyph background
 /*	unsigned char* fdst = &stash->texData[glyph->x0 + glyph->y0 * stash->params.width];
@@ -1195,30 +2606,128 @@ static FONSglyph* fons__getGlyph(FONScontext* stash, FONSfont* font, unsigned in
 		}
 	}*/
 
-	// Blur
-	if (iblur > 0) {
-		stash->nscratch = 0;
-		bdst = &stash->texData[glyph->x0 + glyph->y0 * stash->params.width];
-		fons__blur(stash, bdst, gw, gh, stash->params.width, iblur);
+	fons__dirtyGlyph(stash, glyph);
+
+	return glyph;
+}
+
+// Scales a distance field glyph from the reference size, or a bitmap glyph from its bucketed size.
+// The advance is rounded like for bitmap glyphs.
+static void fons__getScaledQuad(FONScontext* stash, FONSglyph* glyph, float s, float* x, float* y, FONSquad* q)
+{
+	float rx,ry,x0,y0,x1,y1;
+
+	x0 = (float)(glyph->x0+1);
+	y0 = (float)(glyph->y0+1);
+	x1 = (float)(glyph->x1-1);
+	y1 = (float)(glyph->y1-1);
+
+	rx = floorf(*x + (glyph->xoff+1)*s);
+	q->x0 = rx;
+	q->x1 = rx + (x1 - x0)*s;
+	if (stash->params.flags & FONS_ZERO_TOPLEFT) {
+		ry = floorf(*y + (glyph->yoff+1)*s);
+		q->y0 = ry;
+		q->y1 = ry + (y1 - y0)*s;
+	} else {
+		ry = floorf(*y - (glyph->yoff+1)*s);
+		q->y0 = ry;
+		q->y1 = ry - (y1 - y0)*s;
 	}
 
-	stash->dirtyRect[0] = fons__mini(stash->dirtyRect[0], glyph->x0);
-	stash->dirtyRect[1] = fons__mini(stash->dirtyRect[1], glyph->y0);
-	stash->dirtyRect[2] = fons__maxi(stash->dirtyRect[2], glyph->x1);
-	stash->dirtyRect[3] = fons__maxi(stash->dirtyRect[3], glyph->y1);
+	q->s0 = x0 * stash->itw;
+	q->t0 = y0 * stash->ith;
+	q->s1 = x1 * stash->itw;
+	q->t1 = y1 * stash->ith;
+
+	if (stash->subpixel > 1)
+		*x += glyph->xadv*s / 10.0f;
+	else
+		*x += (int)(glyph->xadv*s / 10.0f + 0.5f);
+}
+
+static int fons__getKern(FONSfont* font, int prevGlyphIndex, unsigned int prevCodepoint, FONSglyph* glyph)
+{
+	// FreeType kerning depends on the size last set to the face, so it is not kept.
+#ifndef FONS_USE_FREETYPE
+	if (prevCodepoint < 256 && glyph->codepoint < 256) {
+		int i, kern;
+		if (font->kern == NULL) {
+			font->kern = (short*)malloc(sizeof(short) * 256 * 256);
+			if (font->kern == NULL)
+				return fons__tt_getGlyphKernAdvance(&font->font, prevGlyphIndex, glyph->index);
+			for (i = 0; i < 256 * 256; i++)
+				font->kern[i] = FONS_KERN_UNKNOWN;
+		}
+		kern = font->kern[prevCodepoint * 256 + glyph->codepoint];
+		if (kern == FONS_KERN_UNKNOWN) {
+			kern = fons__tt_getGlyphKernAdvance(&font->font, prevGlyphIndex, glyph->index);
+			if (kern > FONS_KERN_UNKNOWN && kern <= 32767)
+				font->kern[prevCodepoint * 256 + glyph->codepoint] = (short)kern;
+		}
+		return kern;
+	}
+#else
+	FONS_NOTUSED(prevCodepoint);
+#endif
+	return fons__tt_getGlyphKernAdvance(&font->font, prevGlyphIndex, glyph->index);
+}
 
-	return glyph;
+// Option for looking up a glyph before its quad, with subpixel phases the bitmap is made for the phase chosen by fons__getQuad.
+static int fons__lookupBitmapOption(FONScontext* stash, FONSfont* font, int bitmapOption)
+{
+	return stash->subpixel > 1 && !font->sdf ? FONS_GLYPH_BITMAP_OPTIONAL : bitmapOption;
+}
+
+// With subpixel phases a string starts at the nearest phase, so that its layout is the same wherever it starts at that phase.
+static float fons__snapPhase(FONScontext* stash, float x)
+{
+	if (stash->subpixel <= 1) return x;
+	return floorf(x * stash->subpixel + 0.5f) / stash->subpixel;
 }
 
-static void fons__getQuad(FONScontext* stash, FONSfont* font,
-						   int prevGlyphIndex, FONSglyph* glyph,
-						   float scale, float spacing, float* x, float* y, FONSquad* q)
+// Returns the glyph the quad was made of, which is the variant of the pen phase when using subpixel phases.
+static FONSglyph* fons__getQuad(FONScontext* stash, FONSfont* font,
+								int prevGlyphIndex, unsigned int prevCodepoint, FONSglyph* glyph, short isize,
+								float scale, float spacing, int bitmapOption, float* x, float* y, FONSquad* q)
 {
-	float rx,ry,xoff,yoff,x0,y0,x1,y1;
+	float rx,ry,xoff,yoff,x0,y0,x1,y1,px;
+	int n = stash->subpixel;
 
 	if (prevGlyphIndex != -1) {
-		float adv = fons__tt_getGlyphKernAdvance(&font->font, prevGlyphIndex, glyph->index) * scale;
-		*x += (int)(adv + spacing + 0.5f);
+		float adv = fons__getKern(font, prevGlyphIndex, prevCodepoint, glyph) * scale;
+		if (n > 1)
+			*x += adv + spacing;
+		else
+			*x += (int)(adv + spacing + 0.5f);
+	}
+
+	if (glyph->size == 0) {
+		fons__getScaledQuad(stash, glyph, isize/10.0f / FONS_SDF_SIZE, x, y, q);
+		return glyph;
+	}
+	// Glyphs of a bucketed size are scaled, without subpixel phases.
+	if (glyph->size != isize) {
+		if (n > 1 && bitmapOption == FONS_GLYPH_BITMAP_REQUIRED) {
+			glyph = fons__getGlyph(stash, font, glyph->codepoint, glyph->size, glyph->blur, 0, bitmapOption);
+			if (glyph == NULL) return NULL;
+		}
+		fons__getScaledQuad(stash, glyph, (float)isize / glyph->size, x, y, q);
+		return glyph;
+	}
+
+	// The pen is rounded to the nearest phase, the whole pixels place the quad and the rest picks the variant.
+	px = *x;
+	if (n > 1) {
+		float p = floorf(*x * n + 0.5f);
+		short phase;
+		px = floorf(p / n);
+		phase = (short)((int)(p - px * n) * (FONS_SUBPIXEL_UNITS / n));
+		// Measuring uses the metrics of the glyph found, only drawing needs the bitmap of the phase.
+		if (bitmapOption == FONS_GLYPH_BITMAP_REQUIRED) {
+			glyph = fons__getGlyph(stash, font, glyph->codepoint, glyph->size, glyph->blur, phase, bitmapOption);
+			if (glyph == NULL) return NULL;
+		}
 	}
 
 	// Each glyph has 2px border to allow good interpolation,
@@ -1232,7 +2741,7 @@ static void fons__getQuad(FONScontext* stash, FONSfont* font,
 	y1 = (float)(glyph->y1-1);
 
 	if (stash->params.flags & FONS_ZERO_TOPLEFT) {
-		rx = floorf(*x + xoff);
+		rx = floorf(px + xoff);
 		ry = floorf(*y + yoff);
 
 		q->x0 = rx;
@@ -1245,7 +2754,7 @@ static void fons__getQuad(FONScontext* stash, FONSfont* font,
 		q->s1 = x1 * stash->itw;
 		q->t1 = y1 * stash->ith;
 	} else {
-		rx = floorf(*x + xoff);
+		rx = floorf(px + xoff);
 		ry = floorf(*y - yoff);
 
 		q->x0 = rx;
@@ -1259,21 +2768,22 @@ static void fons__getQuad(FONScontext* stash, FONSfont* font,
 		q->t1 = y1 * stash->ith;
 	}
 
-	*x += (int)(glyph->xadv / 10.0f + 0.5f);
+	if (n > 1)
+		*x += glyph->xadv / 10.0f;
+	else
+		*x += (int)(glyph->xadv / 10.0f + 0.5f);
+	return glyph;
 }
 
 static void fons__flush(FONScontext* stash)
 {
 	// Flush texture
-	if (stash->dirtyRect[0] < stash->dirtyRect[2] && stash->dirtyRect[1] < stash->dirtyRect[3]) {
-		if (stash->params.renderUpdate != NULL)
-			stash->params.renderUpdate(stash->params.userPtr, stash->dirtyRect, stash->texData);
-		// Reset dirty rect
-		stash->dirtyRect[0] = stash->params.width;
-		stash->dirtyRect[1] = stash->params.height;
-		stash->dirtyRect[2] = 0;
-		stash->dirtyRect[3] = 0;
+	if (stash->params.renderUpdate != NULL) {
+		int i;
+		for (i = 0; i < stash->ndirty; i++)
+			stash->params.renderUpdate(stash->params.userPtr, stash->dirtyRects[i], stash->texData);
 	}
+	stash->ndirty = 0;
 
 	// Flush triangles
 	if (stash->nverts > 0) {
@@ -1329,6 +2839,7 @@ float fonsDrawText(FONScontext* stash,
 	FONSglyph* glyph = NULL;
 	FONSquad q;
 	int prevGlyphIndex = -1;
+	unsigned int prevCodepoint = 0;
 	short isize = (short)(state->size*10.0f);
 	short iblur = (short)state->blur;
 	float scale;
@@ -1357,13 +2868,17 @@ float fonsDrawText(FONScontext* stash,
 	}
 	// Align vertically.
 	y += fons__getVertAlign(stash, font, state->align, isize);
+	x = fons__snapPhase(stash, x);
 
 	for (; str != end; ++str) {
 		if (fons__decutf8(&utf8state, &codepoint, *(const unsigned char*)str))
 			continue;
-		glyph = fons__getGlyph(stash, font, codepoint, isize, iblur, FONS_GLYPH_BITMAP_REQUIRED);
+		glyph = fons__getGlyph(stash, font, codepoint, isize, iblur, 0,
+							   fons__lookupBitmapOption(stash, font, FONS_GLYPH_BITMAP_REQUIRED));
+		if (glyph != NULL)
+			glyph = fons__getQuad(stash, font, prevGlyphIndex, prevCodepoint, glyph, isize, scale, state->spacing,
+								  FONS_GLYPH_BITMAP_REQUIRED, &x, &y, &q);
 		if (glyph != NULL) {
-			fons__getQuad(stash, font, prevGlyphIndex, glyph, scale, state->spacing, &x, &y, &q);
 
 			if (stash->nverts+6 > FONS_VERTEX_COUNT)
 				fons__flush(stash);
@@ -1377,6 +2892,7 @@ float fonsDrawText(FONScontext* stash,
 			fons__vertex(stash, q.x1, q.y1, q.s1, q.t1, state->color);
 		}
 		prevGlyphIndex = glyph != NULL ? glyph->index : -1;
+		prevCodepoint = codepoint;
 	}
 	fons__flush(stash);
 
@@ -1412,6 +2928,7 @@ int fonsTextIterInit(FONScontext* stash, FONStextIter* iter,
 	}
 	// Align vertically.
 	y += fons__getVertAlign(stash, iter->font, state->align, iter->isize);
+	x = fons__snapPhase(stash, x);
 
 	if (end == NULL)
 		end = str + strlen(str);
@@ -1425,6 +2942,7 @@ int fonsTextIterInit(FONScontext* stash, FONStextIter* iter,
 	iter->codepoint = 0;
 	iter->prevGlyphIndex = -1;
 	iter->bitmapOption = bitmapOption;
+	iter->bitmap = 0;
 
 	return 1;
 }
@@ -1439,17 +2957,28 @@ int fonsTextIterNext(FONScontext* stash, FONStextIter* iter, FONSquad* quad)
 		return 0;
 
 	for (; str != iter->end; str++) {
-		if (fons__decutf8(&iter->utf8state, &iter->codepoint, *(const unsigned char*)str))
+		unsigned char c = *(const unsigned char*)str;
+		if (c < 0x80 && iter->utf8state == 0)
+			iter->codepoint = c;
+		else if (fons__decutf8(&iter->utf8state, &iter->codepoint, c))
 			continue;
 		str++;
 		// Get glyph and quad
 		iter->x = iter->nextx;
 		iter->y = iter->nexty;
-		glyph = fons__getGlyph(stash, iter->font, iter->codepoint, iter->isize, iter->iblur, iter->bitmapOption);
+		glyph = fons__getGlyph(stash, iter->font, iter->codepoint, iter->isize, iter->iblur, 0,
+							   fons__lookupBitmapOption(stash, iter->font, iter->bitmapOption));
 		// If the iterator was initialized with FONS_GLYPH_BITMAP_OPTIONAL, then the UV coordinates of the quad will be invalid.
 		if (glyph != NULL)
-			fons__getQuad(stash, iter->font, iter->prevGlyphIndex, glyph, iter->scale, iter->spacing, &iter->nextx, &iter->nexty, quad);
+			glyph = fons__getQuad(stash, iter->font, iter->prevGlyphIndex, iter->prevCodepoint, glyph, iter->isize, iter->scale,
+								  iter->spacing, iter->bitmapOption, &iter->nextx, &iter->nexty, quad);
+		iter->bitmap = glyph != NULL && glyph->x0 >= 0;
+		if (glyph != NULL && glyph->size != iter->isize)
+			iter->scaled = 1;
+		if (iter->bitmap)
+			iter->pageMask |= 1u << (glyph->page & 31);
 		iter->prevGlyphIndex = glyph != NULL ? glyph->index : -1;
+		iter->prevCodepoint = iter->codepoint;
 		break;
 	}
 	iter->next = str;
@@ -1457,9 +2986,617 @@ int fonsTextIterNext(FONScontext* stash, FONStextIter* iter, FONSquad* quad)
 	return 1;
 }
 
-void fonsDrawDebug(FONScontext* stash, float x, float y)
+static void fons__clearJobs(FONScontext* stash)
+{
+	int i;
+	for (i = 0; i < stash->njobs; i++)
+		free(stash->jobs[i].data);
+	stash->jobBase += stash->njobs;
+	stash->njobs = 0;
+	stash->jobNext = 0;
+}
+
+#ifdef FONS_THREADS
+static void fons__stopWorkers(FONScontext* stash)
+{
+	int i;
+	if (stash->nworkers == 0) return;
+	pthread_mutex_lock(&stash->lock);
+	stash->quit = 1;
+	pthread_cond_broadcast(&stash->wake);
+	pthread_mutex_unlock(&stash->lock);
+	for (i = 0; i < stash->nworkers; i++)
+		pthread_join(stash->workers[i], NULL);
+	stash->quit = 0;
+	stash->nworkers = 0;
+}
+#endif
+
+int fonsSetWorkers(FONScontext* stash, int nworkers)
+{
+#ifdef FONS_THREADS
+	if (nworkers > FONS_MAX_WORKERS) nworkers = FONS_MAX_WORKERS;
+	if (nworkers < 0) nworkers = 0;
+	if (!stash->threadsInit) {
+		if (pthread_mutex_init(&stash->lock, NULL) != 0) return 0;
+		if (pthread_cond_init(&stash->wake, NULL) != 0) {
+			pthread_mutex_destroy(&stash->lock);
+			return 0;
+		}
+		stash->threadsInit = 1;
+	}
+	// Restart the pool with the new size, queued jobs are picked up again.
+	fons__stopWorkers(stash);
+	while (stash->nworkers < nworkers) {
+		if (pthread_create(&stash->workers[stash->nworkers], NULL, fons__worker, stash) != 0)
+			break;
+		stash->nworkers++;
+	}
+	// Without workers nobody will finish the queued glyphs.
+	if (stash->nworkers == 0) {
+		int i, j;
+		for (i = 0; i < stash->nfonts; i++) {
+			FONSfont* font = stash->fonts[i];
+			for (j = 0; j < font->nglyphs; j++) {
+				if (font->glyphs[j].pending)
+					fons__finishGlyph(stash, font, &font->glyphs[j]);
+			}
+		}
+		fons__clearJobs(stash);
+	}
+	return stash->nworkers;
+#else
+	FONS_NOTUSED(stash);
+	FONS_NOTUSED(nworkers);
+	return 0;
+#endif
+}
+
+void fonsSetAsync(FONScontext* stash, int enabled)
+{
+	stash->async = enabled;
+}
+
+int fonsSetSubpixel(FONScontext* stash, int phases)
+{
+	if (phases < 1) phases = 1;
+	if (phases > FONS_MAX_SUBPIXEL) phases = FONS_MAX_SUBPIXEL;
+	stash->subpixel = phases;
+	return phases;
+}
+
+int fonsGetSubpixel(FONScontext* stash)
+{
+	return stash->subpixel;
+}
+
+int fonsSetRasterizer(FONScontext* stash, int rasterizer)
+{
+#ifdef FONS_USE_FREETYPE
+	rasterizer = FONS_RASTER_SCANLINE;
+#endif
+	stash->rasterizer = rasterizer == FONS_RASTER_COVERAGE ? FONS_RASTER_COVERAGE : FONS_RASTER_SCANLINE;
+	return stash->rasterizer;
+}
+
+int fonsGetRasterizer(FONScontext* stash)
+{
+	return stash->rasterizer;
+}
+
+int fonsSubpixelUsage(FONScontext* stash, int* glyphs, int* area, int maxPhases)
+{
+	int i, j, n = stash->subpixel, step = FONS_SUBPIXEL_UNITS / stash->subpixel;
+	for (i = 0; i < maxPhases; i++) {
+		if (glyphs != NULL) glyphs[i] = 0;
+		if (area != NULL) area[i] = 0;
+	}
+	for (i = 0; i < stash->nfonts; i++) {
+		FONSfont* font = stash->fonts[i];
+		for (j = 0; j < font->nglyphs; j++) {
+			FONSglyph* glyph = &font->glyphs[j];
+			int phase = glyph->phase / step;
+			// Variants of another quantization are not counted.
+			if (glyph->x0 < 0 || glyph->phase % step != 0 || phase >= maxPhases) continue;
+			if (glyphs != NULL) glyphs[phase]++;
+			if (area != NULL) area[phase] += (glyph->x1 - glyph->x0) * (glyph->y1 - glyph->y0);
+		}
+	}
+	return n;
+}
+
+int fonsPrewarm(FONScontext* stash, const unsigned int* ranges, int nranges)
+{
+	FONSstate* state = fons__getState(stash);
+	FONSfont* font;
+	short isize = (short)(state->size*10.0f);
+	short iblur = (short)state->blur;
+	unsigned int c;
+	int i, async, count = 0;
+
+	if (state->font < 0 || state->font >= stash->nfonts) return 0;
+	font = stash->fonts[state->font];
+	if (font->data == NULL) return 0;
+
+	// Prewarming never blocks on rasterization when there are workers.
+	async = stash->async;
+	stash->async = 1;
+	for (i = 0; i < nranges; i++) {
+		for (c = ranges[i*2]; c <= ranges[i*2+1]; c++) {
+			if (fons__getGlyph(stash, font, c, isize, iblur, 0, FONS_GLYPH_BITMAP_REQUIRED) == NULL)
+				goto done;
+			count++;
+			if (c == 0xffffffff) break;
+		}
+	}
+done:
+	stash->async = async;
+	return count;
+}
+
+int fonsPackGlyphs(FONScontext* stash)
+{
+	int i, y, npacked = 0, ndone;
+	if (stash->njobs == 0) return 0;
+#ifdef FONS_THREADS
+	pthread_mutex_lock(&stash->lock);
+#endif
+	for (i = 0; i < stash->njobs; i++) {
+		FONSglyphJob* job = &stash->jobs[i];
+		FONSglyph* glyph;
+		if (!job->done) continue;
+		glyph = job->generation == stash->generation ? &stash->fonts[job->font]->glyphs[job->glyph] : NULL;
+		// Glyphs which were reset or finished on this thread in the meantime are skipped.
+		if (glyph != NULL && glyph->pending && job->data != NULL) {
+			for (y = 0; y < job->gh; y++)
+				memcpy(&stash->texData[glyph->x0 + (glyph->y0 + y) * stash->params.width], &job->data[y * job->gw], job->gw);
+			fons__dirtyGlyph(stash, glyph);
+			glyph->pending = 0;
+			npacked++;
+		} else if (glyph != NULL && glyph->pending) {
+			fons__finishGlyph(stash, stash->fonts[job->font], glyph);
+			npacked++;
+		}
+		free(job->data);
+		job->data = NULL;
+	}
+	// Drop the finished jobs from the front of the queue.
+	for (ndone = 0; ndone < stash->jobNext && stash->jobs[ndone].done; ndone++);
+	if (ndone > 0) {
+		memmove(stash->jobs, &stash->jobs[ndone], sizeof(FONSglyphJob) * (stash->njobs - ndone));
+		stash->njobs -= ndone;
+		stash->jobNext -= ndone;
+		stash->jobBase += ndone;
+	}
+#ifdef FONS_THREADS
+	pthread_mutex_unlock(&stash->lock);
+#endif
+	return npacked;
+}
+
+int fonsPendingGlyphs(FONScontext* stash)
+{
+	int i, n = 0;
+#ifdef FONS_THREADS
+	if (stash->njobs > 0) pthread_mutex_lock(&stash->lock);
+#endif
+	for (i = 0; i < stash->njobs; i++)
+		n += !stash->jobs[i].done;
+#ifdef FONS_THREADS
+	if (stash->njobs > 0) pthread_mutex_unlock(&stash->lock);
+#endif
+	return n;
+}
+
+void fonsBeginFrame(FONScontext* stash)
+{
+	stash->frame++;
+}
+
+void fonsTouchPages(FONScontext* stash, unsigned int pageMask)
 {
 	int i;
+	for (i = 0; i < stash->npages; i++) {
+		if (pageMask & (1u << (i & 31)))
+			stash->pages[i].lastUsed = stash->frame;
+	}
+}
+
+int fonsAtlasGeneration(FONScontext* stash)
+{
+	return stash->generation;
+}
+
+int fonsAtlasEvictions(FONScontext* stash)
+{
+	return stash->evictions;
+}
+
+int fonsPageEvictions(FONScontext* stash, unsigned int pageMask)
+{
+	int i, n = 0;
+	for (i = 0; i < stash->npages; i++) {
+		if (pageMask & (1u << (i & 31)))
+			n += stash->pages[i].evictions;
+	}
+	return n;
+}
+
+void fonsGetAtlasStats(FONScontext* stash, FONSatlasStats* stats)
+{
+	int i, j;
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < stash->npages; i++) {
+		FONSatlas* atlas = stash->pages[i].atlas;
+		int area = atlas->width * atlas->height;
+		stats->pages++;
+		stats->area += area;
+		stats->used += atlas->used;
+		if (atlas->rects != NULL) {
+			// The free rectangles cover everything not used.
+			stats->free += area - atlas->used;
+			for (j = 0; j < atlas->nrects; j++)
+				stats->largestFree = fons__maxi(stats->largestFree, atlas->rects[j].width * atlas->rects[j].height);
+			stats->freeRects += atlas->nrects;
+		} else {
+			// Only the area above the skyline can be used.
+			for (j = 0; j < atlas->nnodes; j++) {
+				int a = atlas->nodes[j].width * (atlas->height - atlas->nodes[j].y);
+				stats->free += a;
+				stats->largestFree = fons__maxi(stats->largestFree, a);
+			}
+			stats->freeRects += atlas->nnodes;
+		}
+	}
+}
+
+// Identifies font contents in cache files. The table directory at the start of a font holds a checksum
+// of every table, so the size and a hash of the first bytes stand for the whole file.
+static void fons__fontKey(FONSfont* font, unsigned int* key)
+{
+	int i, n = fons__mini(font->dataSize, FONS_CACHE_KEY_BYTES);
+	unsigned int h = 2166136261u;
+	for (i = 0; i < n; i++) {
+		h ^= font->data[i];
+		h *= 16777619u;
+	}
+	key[0] = (unsigned int)font->dataSize;
+	key[1] = (unsigned int)font->index;
+	key[2] = h;
+}
+
+static int fons__writeInts(FILE* fp, const int* v, int n)
+{
+	return fwrite(v, sizeof(int), n, fp) == (size_t)n;
+}
+
+int fonsSaveCache(FONScontext* stash, const char* path)
+{
+	FILE* fp = NULL;
+	char* tmp = NULL;
+	int i, j, header[9];
+	unsigned int key[3];
+	FONSglyph* glyphs = NULL;
+	int cglyphs = 0;
+
+	if (stash == NULL) return 0;
+	// The file is written next to the cache and renamed over it, so that processes which have the old
+	// file mapped keep reading it whole.
+	tmp = (char*)malloc(strlen(path) + 32);
+	if (tmp == NULL) return 0;
+	sprintf(tmp, "%s.tmp.%d", path, (int)fons__getpid());
+	fp = fopen(tmp, "wb");
+	if (fp == NULL) {
+		free(tmp);
+		return 0;
+	}
+
+	header[0] = FONS_CACHE_VERSION;
+	header[1] = (int)sizeof(FONSglyph);
+	header[2] = FONS_SUBPIXEL_UNITS;
+	header[3] = FONS_PAGE_SIZE;
+	header[4] = stash->params.width;
+	header[5] = stash->params.height;
+	header[6] = stash->npages;
+	header[7] = stash->nfonts;
+	header[8] = stash->params.flags & FONS_PACK_MAXRECTS;
+	if (fwrite("FONC", 1, 4, fp) != 4 || !fons__writeInts(fp, header, 9)) goto error;
+
+	for (i = 0; i < stash->npages; i++) {
+		FONSatlas* atlas = stash->pages[i].atlas;
+		if (!fons__writeInts(fp, &atlas->nnodes, 1)) goto error;
+		if (fwrite(atlas->nodes, sizeof(FONSatlasNode), atlas->nnodes, fp) != (size_t)atlas->nnodes) goto error;
+		if (!fons__writeInts(fp, &atlas->used, 1) || !fons__writeInts(fp, &atlas->nrects, 1)) goto error;
+		if (fwrite(atlas->rects, sizeof(FONSatlasRect), atlas->nrects, fp) != (size_t)atlas->nrects) goto error;
+		if (!fons__writeInts(fp, &stash->pages[i].span, 1)) goto error;
+	}
+
+	for (i = 0; i < stash->nfonts; i++) {
+		FONSfont* font = stash->fonts[i];
+		fons__fontKey(font, key);
+		if (fwrite(key, sizeof(key), 1, fp) != 1) goto error;
+		if (!fons__writeInts(fp, &font->sdf, 1) || !fons__writeInts(fp, &font->nfallbacks, 1)) goto error;
+		for (j = 0; j < font->nfallbacks; j++) {
+			fons__fontKey(stash->fonts[font->fallbacks[j]], key);
+			if (fwrite(key, sizeof(key), 1, fp) != 1) goto error;
+		}
+		if (!fons__writeInts(fp, &font->nglyphs, 1)) goto error;
+
+		// Glyphs still with the workers are saved without bitmap.
+		if (font->nglyphs > cglyphs) {
+			FONSglyph* g = (FONSglyph*)realloc(glyphs, sizeof(FONSglyph) * font->nglyphs);
+			if (g == NULL) goto error;
+			glyphs = g;
+			cglyphs = font->nglyphs;
+		}
+		memcpy(glyphs, font->glyphs, sizeof(FONSglyph) * font->nglyphs);
+		for (j = 0; j < font->nglyphs; j++) {
+			FONSglyph* glyph = &glyphs[j];
+			if (!glyph->pending) continue;
+			glyph->x1 = (short)(glyph->x1 - glyph->x0 - 1);
+			glyph->y1 = (short)(glyph->y1 - glyph->y0 - 1);
+			glyph->x0 = -1;
+			glyph->y0 = -1;
+			glyph->pending = 0;
+		}
+		if (fwrite(glyphs, sizeof(FONSglyph), font->nglyphs, fp) != (size_t)font->nglyphs) goto error;
+	}
+
+	if (fwrite(stash->texData, 1, stash->params.width * stash->params.height, fp) != (size_t)(stash->params.width * stash->params.height)) goto error;
+
+	if (glyphs) free(glyphs);
+	glyphs = NULL;
+	if (fflush(fp) != 0) goto error;
+	i = fclose(fp);
+	fp = NULL;
+	if (i != 0) goto error;
+#ifdef _WIN32
+	remove(path);	// rename does not replace files on Windows.
+#endif
+	if (rename(tmp, path) != 0) goto error;
+	free(tmp);
+	return 1;
+
+error:
+	if (glyphs) free(glyphs);
+	if (fp) fclose(fp);
+	remove(tmp);
+	free(tmp);
+	return 0;
+}
+
+struct FONScacheReader
+{
+	const unsigned char* data;
+	int size, pos;
+};
+typedef struct FONScacheReader FONScacheReader;
+
+static const void* fons__cacheRead(FONScacheReader* r, int n)
+{
+	const void* ptr;
+	if (n < 0 || r->size - r->pos < n) return NULL;
+	ptr = r->data + r->pos;
+	r->pos += n;
+	return ptr;
+}
+
+static int fons__cacheInt(FONScacheReader* r, int* v)
+{
+	const void* ptr = fons__cacheRead(r, sizeof(int));
+	if (ptr == NULL) return 0;
+	memcpy(v, ptr, sizeof(int));
+	return 1;
+}
+
+// Rectangle of page p in a cache file as x0,y0,x1,y1, pages are laid out in rows of cols pages.
+static void fons__cachePageRect(int p, int cols, int width, int height, int* rect)
+{
+	rect[0] = (p % cols) * FONS_PAGE_SIZE;
+	rect[1] = (p / cols) * FONS_PAGE_SIZE;
+	rect[2] = rect[0] + fons__mini(FONS_PAGE_SIZE, width - rect[0]);
+	rect[3] = rect[1] + fons__mini(FONS_PAGE_SIZE, height - rect[1]);
+}
+
+// Walks the font records of a cache file. When restore is set, the glyphs of matching fonts are copied in,
+// otherwise the records are only validated. Returns the number of matching fonts, or -1 if the file is broken.
+static int fons__readCacheFonts(FONScontext* stash, FONScacheReader* r, int nfonts, int width, int height,
+								const int* spans, int restore, unsigned char* done)
+{
+	int i, j, k, sdf, nfallbacks, nglyphs, count = 0;
+	int cols = (width + FONS_PAGE_SIZE-1) / FONS_PAGE_SIZE;
+	int npages = cols * ((height + FONS_PAGE_SIZE-1) / FONS_PAGE_SIZE);
+	unsigned int key[3], saved[3];
+	const unsigned char* ptr;
+
+	memset(done, 0, stash->nfonts);
+	for (i = 0; i < nfonts; i++) {
+		const unsigned char* keys;
+		const unsigned char* glyphs;
+		int match = -1;
+
+		if ((ptr = (const unsigned char*)fons__cacheRead(r, sizeof(saved))) == NULL) return -1;
+		memcpy(saved, ptr, sizeof(saved));
+		if (!fons__cacheInt(r, &sdf) || !fons__cacheInt(r, &nfallbacks)) return -1;
+		if (nfallbacks < 0 || nfallbacks > FONS_MAX_FALLBACKS) return -1;
+		if ((keys = (const unsigned char*)fons__cacheRead(r, nfallbacks * (int)sizeof(key))) == NULL) return -1;
+		if (!fons__cacheInt(r, &nglyphs) || nglyphs < 0 || nglyphs > 0x7fffffff / (int)sizeof(FONSglyph)) return -1;
+		if ((glyphs = (const unsigned char*)fons__cacheRead(r, nglyphs * (int)sizeof(FONSglyph))) == NULL) return -1;
+
+		for (j = 0; j < nglyphs; j++) {
+			FONSglyph g;
+			memcpy(&g, glyphs + j * sizeof(FONSglyph), sizeof(FONSglyph));
+			if (g.page < 0 || g.page >= npages) return -1;
+			// Glyphs with a bitmap must lie inside their page, or the block of pages starting at it.
+			if (g.x0 >= 0) {
+				int rect[4], b[4];
+				fons__cachePageRect(g.page, cols, width, height, rect);
+				for (k = 0; spans[g.page] == g.page && k < npages; k++) {
+					if (spans[k] != g.page) continue;
+					fons__cachePageRect(k, cols, width, height, b);
+					rect[2] = fons__maxi(rect[2], b[2]);
+					rect[3] = fons__maxi(rect[3], b[3]);
+				}
+				if (g.x0 < rect[0] || g.x1 <= g.x0 || g.x1 > rect[2] || g.y0 < rect[1] || g.y1 <= g.y0 || g.y1 > rect[3])
+					return -1;
+			}
+		}
+
+		for (j = 0; j < stash->nfonts && match == -1; j++) {
+			FONSfont* font = stash->fonts[j];
+			if (done[j] || font->sdf != sdf || font->nfallbacks != nfallbacks) continue;
+			fons__fontKey(font, key);
+			if (memcmp(key, saved, sizeof(key)) != 0) continue;
+			for (k = 0; k < nfallbacks; k++) {
+				fons__fontKey(stash->fonts[font->fallbacks[k]], key);
+				if (memcmp(key, keys + k * sizeof(key), sizeof(key)) != 0) break;
+			}
+			if (k == nfallbacks) match = j;
+		}
+		if (match == -1) continue;
+		done[match] = 1;
+		count++;
+
+		if (restore) {
+			FONSfont* font = stash->fonts[match];
+			if (nglyphs > font->cglyphs) {
+				FONSglyph* g = (FONSglyph*)realloc(font->glyphs, sizeof(FONSglyph) * nglyphs);
+				if (g == NULL) return -1;
+				font->glyphs = g;
+				font->cglyphs = nglyphs;
+			}
+			memcpy(font->glyphs, glyphs, sizeof(FONSglyph) * nglyphs);
+			font->nglyphs = nglyphs;
+			// The hash is rebuilt rather than saved, so that it does not depend on the table size.
+			for (k = 0; k < nglyphs; k++)
+				if (!fons__hashGlyph(font, k)) return -1;
+		}
+	}
+	return count;
+}
+
+int fonsLoadCache(FONScontext* stash, const char* path)
+{
+	FONScacheReader r;
+	unsigned char* data = NULL;
+	unsigned char* done = NULL;
+	int* spans = NULL;
+	const unsigned char* ptr;
+	int i, size = 0, mapped = 0, header[9], cols, pages, fonts, count = -1;
+
+	if (stash == NULL) return -1;
+	data = fons__mapFile(path, &size, &mapped);
+	if (data == NULL) return -1;
+	done = (unsigned char*)malloc(stash->nfonts + 1);
+	if (done == NULL) goto error;
+
+	r.data = data;
+	r.size = size;
+	r.pos = 0;
+	if ((ptr = (const unsigned char*)fons__cacheRead(&r, 4)) == NULL || memcmp(ptr, "FONC", 4) != 0) goto error;
+	for (i = 0; i < 9; i++)
+		if (!fons__cacheInt(&r, &header[i])) goto error;
+	if (header[0] != FONS_CACHE_VERSION || header[1] != (int)sizeof(FONSglyph) ||
+		header[2] != FONS_SUBPIXEL_UNITS || header[3] != FONS_PAGE_SIZE ||
+		header[8] != (stash->params.flags & FONS_PACK_MAXRECTS)) goto error;
+	if (header[4] <= 0 || header[5] <= 0 || header[4] > 0x7fff || header[5] > 0x7fff) goto error;
+
+	// Pages are laid out in rows, the same way fons__addPages creates them.
+	cols = (header[4] + FONS_PAGE_SIZE-1) / FONS_PAGE_SIZE;
+	if (header[6] != cols * ((header[5] + FONS_PAGE_SIZE-1) / FONS_PAGE_SIZE)) goto error;
+	spans = (int*)malloc(sizeof(int) * header[6]);
+	if (spans == NULL) goto error;
+	pages = r.pos;
+	for (i = 0; i < header[6]; i++) {
+		int j, nnodes, used, nrects, pw = fons__mini(FONS_PAGE_SIZE, header[4] - (i % cols) * FONS_PAGE_SIZE);
+		int ph = fons__mini(FONS_PAGE_SIZE, header[5] - (i / cols) * FONS_PAGE_SIZE);
+		if (!fons__cacheInt(&r, &nnodes) || nnodes < 1 || nnodes > pw + 1) goto error;
+		if ((ptr = (const unsigned char*)fons__cacheRead(&r, nnodes * (int)sizeof(FONSatlasNode))) == NULL) goto error;
+		for (j = 0; j < nnodes; j++) {
+			FONSatlasNode n;
+			memcpy(&n, ptr + j * sizeof(FONSatlasNode), sizeof(n));
+			if (n.x < 0 || n.width < 0 || n.x + n.width > pw || n.y < 0) goto error;
+		}
+		if (!fons__cacheInt(&r, &used) || used < 0 || used > pw * ph) goto error;
+		if (!fons__cacheInt(&r, &nrects) || nrects < 0 || nrects > pw * ph || (nrects > 0) != (header[8] != 0)) goto error;
+		if ((ptr = (const unsigned char*)fons__cacheRead(&r, nrects * (int)sizeof(FONSatlasRect))) == NULL) goto error;
+		for (j = 0; j < nrects; j++) {
+			FONSatlasRect n;
+			memcpy(&n, ptr + j * sizeof(FONSatlasRect), sizeof(n));
+			if (n.x < 0 || n.y < 0 || n.width <= 0 || n.height <= 0 || n.x + n.width > pw || n.y + n.height > ph) goto error;
+		}
+		if (!fons__cacheInt(&r, &spans[i]) || spans[i] < -1 || spans[i] >= header[6]) goto error;
+	}
+	for (i = 0; i < header[6]; i++)
+		if (spans[i] != -1 && spans[spans[i]] != spans[i]) goto error;
+
+	// Validate everything before touching the stash.
+	fonts = r.pos;
+	count = fons__readCacheFonts(stash, &r, header[7], header[4], header[5], spans, 0, done);
+	if (count == -1 || fons__cacheRead(&r, header[4] * header[5]) == NULL) {
+		count = -1;
+		goto error;
+	}
+
+	if (!fonsResetAtlas(stash, header[4], header[5])) {
+		count = -1;
+		goto error;
+	}
+
+	r.pos = pages;
+	for (i = 0; i < stash->npages; i++) {
+		FONSatlas* atlas = stash->pages[i].atlas;
+		int nnodes = 0, nrects = 0;
+		fons__cacheInt(&r, &nnodes);
+		if (nnodes > atlas->cnodes) {
+			FONSatlasNode* nodes = (FONSatlasNode*)realloc(atlas->nodes, sizeof(FONSatlasNode) * nnodes);
+			if (nodes == NULL) {
+				count = -1;
+				goto error;
+			}
+			atlas->nodes = nodes;
+			atlas->cnodes = nnodes;
+		}
+		memcpy(atlas->nodes, fons__cacheRead(&r, nnodes * (int)sizeof(FONSatlasNode)), sizeof(FONSatlasNode) * nnodes);
+		atlas->nnodes = nnodes;
+		fons__cacheInt(&r, &atlas->used);
+		fons__cacheInt(&r, &nrects);
+		if (nrects > atlas->crects) {
+			FONSatlasRect* rects = (FONSatlasRect*)realloc(atlas->rects, sizeof(FONSatlasRect) * nrects);
+			if (rects == NULL) {
+				count = -1;
+				goto error;
+			}
+			atlas->rects = rects;
+			atlas->crects = nrects;
+		}
+		if (nrects > 0)
+			memcpy(atlas->rects, fons__cacheRead(&r, nrects * (int)sizeof(FONSatlasRect)), sizeof(FONSatlasRect) * nrects);
+		atlas->nrects = nrects;
+		fons__cacheInt(&r, &stash->pages[i].span);
+	}
+
+	r.pos = fonts;
+	if (fons__readCacheFonts(stash, &r, header[7], header[4], header[5], spans, 1, done) == -1) {
+		fonsResetAtlas(stash, header[4], header[5]);
+		count = -1;
+		goto error;
+	}
+	memcpy(stash->texData, fons__cacheRead(&r, header[4] * header[5]), header[4] * header[5]);
+
+	stash->ndirty = 0;
+	fons__addDirty(stash, 0, 0, stash->params.width, stash->params.height);
+
+error:
+	if (spans) free(spans);
+	if (done) free(done);
+	fons__unmapFile(data, size, mapped);
+	return count;
+}
+
+void fonsDrawDebug(FONScontext* stash, float x, float y)
+{
+	int i, j;
 	int w = stash->params.width;
 	int h = stash->params.height;
 	float u = w == 0 ? 0 : (1.0f / w);
@@ -1487,19 +3624,23 @@ void fonsDrawDebug(FONScontext* stash, float x, float y)
 	fons__vertex(stash, x+w, y+h, 1, 1, 0xffffffff);
 
 	// Drawbug draw atlas
-	for (i = 0; i < stash->atlas->nnodes; i++) {
-		FONSatlasNode* n = &stash->atlas->nodes[i];
+	for (j = 0; j < stash->npages; j++) {
+		FONSpage* page = &stash->pages[j];
+		float px = x + page->x, py = y + page->y;
+		for (i = 0; i < page->atlas->nnodes; i++) {
+			FONSatlasNode* n = &page->atlas->nodes[i];
 
-		if (stash->nverts+6 > FONS_VERTEX_COUNT)
-			fons__flush(stash);
+			if (stash->nverts+6 > FONS_VERTEX_COUNT)
+				fons__flush(stash);
 
-		fons__vertex(stash, x+n->x+0, y+n->y+0, u, v, 0xc00000ff);
-		fons__vertex(stash, x+n->x+n->width, y+n->y+1, u, v, 0xc00000ff);
-		fons__vertex(stash, x+n->x+n->width, y+n->y+0, u, v, 0xc00000ff);
+			fons__vertex(stash, px+n->x+0, py+n->y+0, u, v, 0xc00000ff);
+			fons__vertex(stash, px+n->x+n->width, py+n->y+1, u, v, 0xc00000ff);
+			fons__vertex(stash, px+n->x+n->width, py+n->y+0, u, v, 0xc00000ff);
 
-		fons__vertex(stash, x+n->x+0, y+n->y+0, u, v, 0xc00000ff);
-		fons__vertex(stash, x+n->x+0, y+n->y+1, u, v, 0xc00000ff);
-		fons__vertex(stash, x+n->x+n->width, y+n->y+1, u, v, 0xc00000ff);
+			fons__vertex(stash, px+n->x+0, py+n->y+0, u, v, 0xc00000ff);
+			fons__vertex(stash, px+n->x+0, py+n->y+1, u, v, 0xc00000ff);
+			fons__vertex(stash, px+n->x+n->width, py+n->y+1, u, v, 0xc00000ff);
+		}
 	}
 
 	fons__flush(stash);
@@ -1516,6 +3657,7 @@ float fonsTextBounds(FONScontext* stash,
 	FONSquad q;
 	FONSglyph* glyph = NULL;
 	int prevGlyphIndex = -1;
+	unsigned int prevCodepoint = 0;
 	short isize = (short)(state->size*10.0f);
 	short iblur = (short)state->blur;
 	float scale;
@@ -1532,6 +3674,7 @@ float fonsTextBounds(FONScontext* stash,
 
 	// Align vertically.
 	y += fons__getVertAlign(stash, font, state->align, isize);
+	x = fons__snapPhase(stash, x);
 
 	minx = maxx = x;
 	miny = maxy = y;
@@ -1543,9 +3686,10 @@ float fonsTextBounds(FONScontext* stash,
 	for (; str != end; ++str) {
 		if (fons__decutf8(&utf8state, &codepoint, *(const unsigned char*)str))
 			continue;
-		glyph = fons__getGlyph(stash, font, codepoint, isize, iblur, FONS_GLYPH_BITMAP_OPTIONAL);
+		glyph = fons__getGlyph(stash, font, codepoint, isize, iblur, 0, FONS_GLYPH_BITMAP_OPTIONAL);
 		if (glyph != NULL) {
-			fons__getQuad(stash, font, prevGlyphIndex, glyph, scale, state->spacing, &x, &y, &q);
+			glyph = fons__getQuad(stash, font, prevGlyphIndex, prevCodepoint, glyph, isize, scale, state->spacing,
+								  FONS_GLYPH_BITMAP_OPTIONAL, &x, &y, &q);
 			if (q.x0 < minx) minx = q.x0;
 			if (q.x1 > maxx) maxx = q.x1;
 			if (stash->params.flags & FONS_ZERO_TOPLEFT) {
@@ -1557,6 +3701,7 @@ float fonsTextBounds(FONScontext* stash,
 			}
 		}
 		prevGlyphIndex = glyph != NULL ? glyph->index : -1;
+		prevCodepoint = codepoint;
 	}
 
 	advance = x - startx;
@@ -1637,19 +3782,31 @@ const unsigned char* fonsGetTextureData(FONScontext* stash, int* width, int* hei
 
 int fonsValidateTexture(FONScontext* stash, int* dirty)
 {
-	if (stash->dirtyRect[0] < stash->dirtyRect[2] && stash->dirtyRect[1] < stash->dirtyRect[3]) {
-		dirty[0] = stash->dirtyRect[0];
-		dirty[1] = stash->dirtyRect[1];
-		dirty[2] = stash->dirtyRect[2];
-		dirty[3] = stash->dirtyRect[3];
-		// Reset dirty rect
-		stash->dirtyRect[0] = stash->params.width;
-		stash->dirtyRect[1] = stash->params.height;
-		stash->dirtyRect[2] = 0;
-		stash->dirtyRect[3] = 0;
-		return 1;
+	int i;
+	if (stash->ndirty == 0)
+		return 0;
+	// Returns the bounds of all changed areas.
+	dirty[0] = stash->params.width;
+	dirty[1] = stash->params.height;
+	dirty[2] = 0;
+	dirty[3] = 0;
+	for (i = 0; i < stash->ndirty; i++) {
+		dirty[0] = fons__mini(dirty[0], stash->dirtyRects[i][0]);
+		dirty[1] = fons__mini(dirty[1], stash->dirtyRects[i][1]);
+		dirty[2] = fons__maxi(dirty[2], stash->dirtyRects[i][2]);
+		dirty[3] = fons__maxi(dirty[3], stash->dirtyRects[i][3]);
 	}
-	return 0;
+	stash->ndirty = 0;
+	return 1;
+}
+
+int fonsGetDirtyRects(FONScontext* stash, int* rects, int maxRects)
+{
+	int n = fons__mini(stash->ndirty, maxRects);
+	if (n <= 0) return 0;
+	stash->ndirty -= n;
+	memcpy(rects, stash->dirtyRects[stash->ndirty], sizeof(int)*4 * n);
+	return n;
 }
 
 void fonsDeleteInternal(FONScontext* stash)
@@ -1660,10 +3817,21 @@ void fonsDeleteInternal(FONScontext* stash)
 	if (stash->params.renderDelete)
 		stash->params.renderDelete(stash->params.userPtr);
 
+#ifdef FONS_THREADS
+	if (stash->threadsInit) {
+		fons__stopWorkers(stash);
+		pthread_cond_destroy(&stash->wake);
+		pthread_mutex_destroy(&stash->lock);
+	}
+#endif
+	fons__clearJobs(stash);
+	if (stash->jobs) free(stash->jobs);
+
 	for (i = 0; i < stash->nfonts; ++i)
 		fons__freeFont(stash->fonts[i]);
 
-	if (stash->atlas) fons__deleteAtlas(stash->atlas);
+	fons__deletePages(stash);
+	if (stash->pages) free(stash->pages);
 	if (stash->fonts) free(stash->fonts);
 	if (stash->texData) free(stash->texData);
 	if (stash->scratch) free(stash->scratch);
@@ -1687,7 +3855,7 @@ void fonsGetAtlasSize(FONScontext* stash, int* width, int* height)
 
 int fonsExpandAtlas(FONScontext* stash, int width, int height)
 {
-	int i, maxy = 0;
+	int i;
 	unsigned char* data = NULL;
 	if (stash == NULL) return 0;
 
@@ -1723,15 +3891,12 @@ int fonsExpandAtlas(FONScontext* stash, int width, int height)
 	stash->texData = data;
 
 	// Increase atlas size
-	fons__atlasExpand(stash->atlas, width, height);
+	if (!fons__addPages(stash, stash->params.width, stash->params.height, width, height))
+		return 0;
 
 	// Add existing data as dirty.
-	for (i = 0; i < stash->atlas->nnodes; i++)
-		maxy = fons__maxi(maxy, stash->atlas->nodes[i].y);
-	stash->dirtyRect[0] = 0;
-	stash->dirtyRect[1] = 0;
-	stash->dirtyRect[2] = stash->params.width;
-	stash->dirtyRect[3] = maxy;
+	stash->ndirty = 0;
+	fons__addDirty(stash, 0, 0, stash->params.width, stash->params.height);
 
 	stash->params.width = width;
 	stash->params.height = height;
@@ -1756,25 +3921,26 @@ int fonsResetAtlas(FONScontext* stash, int width, int height)
 	}
 
 	// Reset atlas
-	fons__atlasReset(stash->atlas, width, height);
+	fons__deletePages(stash);
+	if (!fons__addPages(stash, 0, 0, width, height)) return 0;
 
 	// Clear texture data.
 	stash->texData = (unsigned char*)realloc(stash->texData, width * height);
 	if (stash->texData == NULL) return 0;
 	memset(stash->texData, 0, width * height);
 
-	// Reset dirty rect
-	stash->dirtyRect[0] = width;
-	stash->dirtyRect[1] = height;
-	stash->dirtyRect[2] = 0;
-	stash->dirtyRect[3] = 0;
+	// Reset dirty rects
+	stash->ndirty = 0;
 
 	// Reset cached glyphs
+	stash->generation++;
 	for (i = 0; i < stash->nfonts; i++) {
 		FONSfont* font = stash->fonts[i];
+		for (j = 0; j < font->nglyphs; j++) {
+			if (font->glyphs[j].x0 >= 0) font->evicted++;
+		}
 		font->nglyphs = 0;
-		for (j = 0; j < FONS_HASH_LUT_SIZE; j++)
-			font->lut[j] = -1;
+		fons__clearGlyphHash(font);
 	}
 
 	stash->params.width = width;
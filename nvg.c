@@ -60,10 +60,18 @@
 #define NVG_INIT_POINTS_SIZE 128
 #define NVG_INIT_PATHS_SIZE 16
 #define NVG_INIT_VERTS_SIZE 256
+#define NVG_INIT_STATES_SIZE 32
+#define NVG_INIT_UNDO_SIZE 1024
+#define NVG_MAX_CAP_DIVS 128
 
-#ifndef NVG_MAX_STATES
-#define NVG_MAX_STATES 32
-#endif
+#define NVG_TEXT_CACHE_SIZE 256			// Number of glyph runs kept by the text cache.
+#define NVG_TEXT_CACHE_HASH 512			// Number of hash buckets, must be power of two.
+#define NVG_TEXT_CACHE_MAX_LEN 256		// Longer strings are not cached.
+
+#define NVG_QUALITY_SAMPLES 8			// Frames averaged before the quality level is adjusted.
+#define NVG_QUALITY_RECOVER 4			// Averages under the headroom needed before raising quality.
+#define NVG_QUALITY_HEADROOM 0.7f		// Fraction of the frame budget which counts as headroom.
+#define NVG_QUALITY_HISTORY_SIZE 32
 
 #define NVG_KAPPA90 0.5522847493f	// Length proportional to radius of a cubic bezier handle for 90deg arcs.
 
@@ -84,6 +92,7 @@ enum NVGpointFlags
 	NVG_PT_LEFT = 0x02,
 	NVG_PT_BEVEL = 0x04,
 	NVG_PR_INNERBEVEL = 0x08,
+	NVG_PT_KEEP = 0x10,
 };
 
 struct NVGstate {
@@ -98,6 +107,8 @@ struct NVGstate {
 	float alpha;
 	float xform[6];
 	NVGscissor scissor;
+	int simplify;
+	float simplifyTol;
 	float fontSize;
 	float letterSpacing;
 	float lineHeight;
@@ -107,6 +118,47 @@ struct NVGstate {
 };
 typedef struct NVGstate NVGstate;
 
+// The state is split into groups which are saved on first modification
+// after nvgSave(), each group is a contiguous range of NVGstate.
+enum NVGstateGroups {
+	NVG_STATE_COMPOSITE = 0,
+	NVG_STATE_ANTIALIAS,
+	NVG_STATE_FILL,
+	NVG_STATE_STROKE,
+	NVG_STATE_STROKESTYLE,
+	NVG_STATE_ALPHA,
+	NVG_STATE_XFORM,
+	NVG_STATE_SCISSOR,
+	NVG_STATE_SIMPLIFY,
+	NVG_STATE_FONT,
+	NVG_STATE_COUNT
+};
+
+struct NVGstateGroup {
+	int offset;
+	int size;
+};
+typedef struct NVGstateGroup NVGstateGroup;
+
+static const NVGstateGroup nvg__stateGroups[NVG_STATE_COUNT] = {
+	{ offsetof(NVGstate, compositeOperation), sizeof(NVGcompositeOperationState) },
+	{ offsetof(NVGstate, shapeAntiAlias), sizeof(int) },
+	{ offsetof(NVGstate, fill), sizeof(NVGpaint) },
+	{ offsetof(NVGstate, stroke), sizeof(NVGpaint) },
+	{ offsetof(NVGstate, strokeWidth), offsetof(NVGstate, alpha) - offsetof(NVGstate, strokeWidth) },
+	{ offsetof(NVGstate, alpha), sizeof(float) },
+	{ offsetof(NVGstate, xform), sizeof(float)*6 },
+	{ offsetof(NVGstate, scissor), sizeof(NVGscissor) },
+	{ offsetof(NVGstate, simplify), offsetof(NVGstate, fontSize) - offsetof(NVGstate, simplify) },
+	{ offsetof(NVGstate, fontSize), sizeof(NVGstate) - offsetof(NVGstate, fontSize) },
+};
+
+struct NVGsaveMark {
+	int undo;			// Size of the undo log when nvgSave() was called.
+	int saved;			// Mask of state groups already in the undo log.
+};
+typedef struct NVGsaveMark NVGsaveMark;
+
 struct NVGpoint {
 	float x,y;
 	float dx, dy;
@@ -126,30 +178,226 @@ struct NVGpathCache {
 	NVGvertex* verts;
 	int nverts;
 	int cverts;
+	int* stack;
+	int cstack;
 	float bounds[4];
 };
 typedef struct NVGpathCache NVGpathCache;
 
+// Positioned glyph quads of a string, relative to the floored start of the aligned text.
+struct NVGtextRun {
+	unsigned int hash;
+	int len;
+	int fontId;
+	float size;
+	float spacing;
+	float blur;
+	int align;
+	int flipped;
+	int generation;
+	unsigned int pageMask;	// Atlas pages used by the quads.
+	int evictions;			// Evictions of those pages when the quads were laid out.
+	int phase;				// Subpixel phase of the start.
+	int scaled;				// The quads are scaled, they depend on the fractions of the start.
+	float fracx, fracy;		// Fractions of the start of scaled quads.
+	float alignx, aligny;
+	float advance;
+	float miny, maxy;		// Vertical extent of the quads.
+	int nquads;
+	int cdata;
+	unsigned char* data;	// Quads, culling bounds and the string.
+	int next;				// Next run in the hash bucket.
+	int lruPrev, lruNext;
+};
+typedef struct NVGtextRun NVGtextRun;
+
+struct NVGtextCache {
+	NVGtextRun runs[NVG_TEXT_CACHE_SIZE];
+	int buckets[NVG_TEXT_CACHE_HASH];
+	int lruHead, lruTail;	// Most and least recently used.
+	FONSquad quads[NVG_TEXT_CACHE_MAX_LEN];	// Quads of the run being laid out.
+};
+typedef struct NVGtextCache NVGtextCache;
+
+struct NVGparagraphRow {
+	int start, end, next;		// Byte offsets of the row in the paragraph text.
+	float width;				// Logical width of the row.
+	float minx, maxx;			// Actual bounds of the row.
+	int glyph, nglyphs;			// Positioned glyphs of the row.
+};
+typedef struct NVGparagraphRow NVGparagraphRow;
+
+// Glyph positions are in pixels of the layout scale, relative to the start of the row.
+struct NVGparagraphGlyph {
+	int str;					// Byte offset of the glyph in the paragraph text.
+	float x;					// Logical position of the glyph.
+	float minx, maxx;			// Bounds of the glyph shape.
+	FONSquad quad;				// Relative to the floored row start.
+};
+typedef struct NVGparagraphGlyph NVGparagraphGlyph;
+
+struct NVGparagraph {
+	char* text;
+	int len;
+	int ctext;
+	float width;
+	// Pending edit since the last layout: first changed byte, end of the changed bytes in the
+	// laid out text (-1 if unknown) and the change of length.
+	int editStart, editEnd, editDelta;
+	// Text style of the layout, fontId is FONS_INVALID when there is no layout.
+	int fontId;
+	float size, spacing, blur;
+	int valign;
+	int subpixel, sizeBuckets;	// Advance mode, the rows break differently when it changes.
+	float layoutWidth;
+	float lineh;				// Line height in local units.
+	float rminy, rmaxy;			// Vertical bounds of a row relative to its y, in local units.
+	float aligny;				// Vertical offset of the glyphs from the row y, in pixels.
+	int generation;				// Atlas generation of the quads.
+	unsigned int pageMask;		// Atlas pages used by the quads.
+	int evictions;				// Evictions of those pages when the quads were laid out.
+	NVGparagraphRow* rows;
+	int nrows;
+	int crows;
+	NVGparagraphGlyph* glyphs;
+	int nglyphs;
+	int cglyphs;
+};
+
+struct NVGdocumentLine {
+	char* text;
+	int len;
+	int nrows;					// Rows of the line in the row index.
+	int* rowStarts;				// Offsets where breaking of each row starts, NULL for lines with one row.
+	int dirty;					// The line is in the list of lines to wrap.
+};
+typedef struct NVGdocumentLine NVGdocumentLine;
+
+struct NVGdocument {
+	NVGdocumentLine* lines;
+	int nlines;
+	int clines;
+	int open;					// The last line was not terminated by a new line.
+	int* rowIndex;				// Fenwick tree of the row counts of the lines, 1-based.
+	int* dirty;					// Lines changed since the last layout.
+	int ndirty;
+	int cdirty;
+	float width;
+	// Text style of the layout, fontId is FONS_INVALID when all lines need to be wrapped.
+	int fontId;
+	float size, spacing;		// Font size and letter spacing in local units.
+	float layoutWidth;
+	float lineh;				// Line height in local units.
+	float rminy, rmaxy;			// Vertical bounds of a row relative to its y, in local units.
+};
+
+#define NVG_GRID_COLORS 256
+
+// Draw call of the grid, the quads of each color are stored together.
+struct NVGgridCall {
+	int color;					// Palette index.
+	int glyphs;					// Draws glyphs rather than backgrounds.
+	int offset, count;			// Vertices of the call.
+};
+typedef struct NVGgridCall NVGgridCall;
+
+struct NVGgrid {
+	int rows, cols;
+	int top;					// Storage row of the first row, scrolling moves it.
+	NVGgridCell* cells;			// Cells by storage row.
+	NVGcolor palette[NVG_GRID_COLORS];
+	unsigned char* dirty;		// Storage rows to lay out again.
+	int changed;				// Cells or scroll position changed since the last draw.
+	// Layout of each storage row, in pixels of the layout scale relative to the row origin.
+	FONSquad* quads;			// Glyph quads, cols per row.
+	unsigned char* quadColors;
+	int* nquads;
+	int* runs;					// Background runs as first and last column, cols per row.
+	unsigned char* runColors;
+	int* nruns;
+	// Text style of the layout, fontId is FONS_INVALID when there is no layout.
+	int fontId;
+	float size, blur;
+	int generation;
+	unsigned int pageMask;
+	int evictions;				// Evictions of the pages when the quads were laid out.
+	float advance;				// Cell width in pixels.
+	float aligny;				// Offset of the glyphs from the row top in pixels.
+	FONSquad latin[256];		// Quads of the codepoints below 256 relative to the cell origin.
+	unsigned char latinState[256];	// 0 not looked up, 1 has a glyph, 2 has none.
+	// Vertices of the last draw, reused while the grid and its placement do not change.
+	NVGvertex* verts;
+	int nverts, cverts;
+	NVGgridCall calls[NVG_GRID_COLORS*2];
+	int ncalls;
+	float drawXform[6], drawx, drawy, drawRowh;
+};
+
 struct NVGcontext {
 	NVGparams params;
 	float* commands;
 	int ccommands;
 	int ncommands;
 	float commandx, commandy;
-	NVGstate states[NVG_MAX_STATES];
-	int nstates;
+	NVGstate state;
+	NVGsaveMark* saves;
+	int nsaves;
+	int csaves;
+	int nlostSaves;
+	unsigned char* undo;
+	int nundo;
+	int cundo;
+	float* xforms;
+	int nxforms;
+	int cxforms;
+	int nlostXforms;			// Pushes above the stack which could not be stored, popped before it.
+	NVGscissor* scissors;
+	int nscissors;
+	int cscissors;
+	int nlostScissors;
+	NVGmemoryBuffer mem[NVG_MEMORY_BUFFER_COUNT];
+	int memFrame[NVG_MEMORY_BUFFER_COUNT];
+	int memWindow[NVG_MEMORY_BUFFER_COUNT];
+	int memBudget;
+	int memTrimFrames;
+	int memOverFrames;
+	int memTrimCount;
 	NVGpathCache* cache;
 	float tessTol;
 	float distTol;
+	float joinTol;
+	float capWidth;
+	float capTol;
+	int capDivs;
+	float* capTables[NVG_MAX_CAP_DIVS+1];
 	float fringeWidth;
 	float devicePxRatio;
+	float viewWidth, viewHeight;
 	struct FONScontext* fs;
 	int fontImages[NVG_MAX_FONTIMAGES];
 	int fontImageIdx;
+	int atlasGeneration;	// Combined with the font stash generation to validate cached text runs.
+	NVGtextCache* textCache;
 	int drawCallCount;
 	int fillTriCount;
 	int strokeTriCount;
 	int textTriCount;
+	int textUploadCount;	// Font atlas updates of the current frame.
+	int textUploadBytes;
+	int textGlyphCount;		// Glyphs drawn and culled by nvgText during the current frame.
+	int textCulledCount;
+	NVGtextStats textStats;
+	NVGtextUploadStats textUploads;
+	float qualityBudget;
+	int qualityMaxLevel;
+	int qualityFlags;
+	int qualityLevel;
+	int qualityFrame;
+	int qualityFrames;
+	float qualityTime;
+	int qualityRecover;
+	NVGqualityChange qualityHistory[NVG_QUALITY_HISTORY_SIZE];
+	int nqualityHistory;
 };
 
 static float nvg__sqrtf(float a) { return sqrtf(a); }
@@ -188,6 +436,7 @@ static void nvg__deletePathCache(NVGpathCache* c)
 	if (c->points != NULL) free(c->points);
 	if (c->paths != NULL) free(c->paths);
 	if (c->verts != NULL) free(c->verts);
+	if (c->stack != NULL) free(c->stack);
 	free(c);
 }
 
@@ -218,10 +467,23 @@ error:
 	return NULL;
 }
 
+// Returns true if the quality governor has turned the knob down.
+static int nvg__qualityReduced(NVGcontext* ctx, int knob, int level)
+{
+	return (ctx->qualityFlags & knob) && ctx->qualityLevel >= level;
+}
+
+static float nvg__qualityScale(NVGcontext* ctx, int knob)
+{
+	return nvg__qualityReduced(ctx, knob, 1) ? (float)(1 << ctx->qualityLevel) : 1.0f;
+}
+
 static void nvg__setDevicePixelRatio(NVGcontext* ctx, float ratio)
 {
-	ctx->tessTol = 0.25f / ratio;
-	ctx->distTol = 0.01f / ratio;
+	float tessScale = nvg__qualityScale(ctx, NVG_QUALITY_TESSELLATION);
+	ctx->tessTol = 0.25f*tessScale / ratio;
+	ctx->distTol = 0.01f*tessScale / ratio;
+	ctx->joinTol = 0.25f*nvg__qualityScale(ctx, NVG_QUALITY_ROUND_JOINS) / ratio;
 	ctx->fringeWidth = 1.0f / ratio;
 	ctx->devicePxRatio = ratio;
 }
@@ -301,7 +563,80 @@ static NVGcompositeOperationState nvg__compositeOperationState(int op)
 
 static NVGstate* nvg__getState(NVGcontext* ctx)
 {
-	return &ctx->states[ctx->nstates-1];
+	return &ctx->state;
+}
+
+static void nvg__trackMemory(NVGcontext* ctx, int buffer, int bytes)
+{
+	if (bytes > ctx->memFrame[buffer])
+		ctx->memFrame[buffer] = bytes;
+}
+
+static void nvg__trackPathMemory(NVGcontext* ctx)
+{
+	nvg__trackMemory(ctx, NVG_MEMORY_COMMANDS, ctx->ncommands*(int)sizeof(float));
+	nvg__trackMemory(ctx, NVG_MEMORY_POINTS, ctx->cache->npoints*(int)sizeof(NVGpoint));
+	nvg__trackMemory(ctx, NVG_MEMORY_PATHS, ctx->cache->npaths*(int)sizeof(NVGpath));
+}
+
+static int nvg__stateBytes(NVGcontext* ctx)
+{
+	return ctx->nsaves*(int)sizeof(NVGsaveMark) + ctx->nundo + ctx->nxforms*(int)sizeof(float)*6 + ctx->nscissors*(int)sizeof(NVGscissor);
+}
+
+static int nvg__saveStateGroup(NVGcontext* ctx, int group)
+{
+	const NVGstateGroup* g = &nvg__stateGroups[group];
+	int size = g->size + (int)sizeof(int);
+	if (ctx->nundo+size > ctx->cundo) {
+		unsigned char* undo;
+		int cundo = ctx->nundo+size + ctx->cundo/2;
+		undo = (unsigned char*)realloc(ctx->undo, cundo);
+		if (undo == NULL) return 0;
+		ctx->undo = undo;
+		ctx->cundo = cundo;
+	}
+	// Record is the saved bytes followed by the group, so that the log can be unwound from the end.
+	memcpy(&ctx->undo[ctx->nundo], (unsigned char*)&ctx->state + g->offset, g->size);
+	memcpy(&ctx->undo[ctx->nundo + g->size], &group, sizeof(int));
+	ctx->nundo += size;
+	return 1;
+}
+
+// Returns current state for writing, saving the specified group first if
+// it has not been saved since the last nvgSave(). Returns NULL if the group
+// could not be saved, the state must then be left as is.
+static NVGstate* nvg__modifyState(NVGcontext* ctx, int group)
+{
+	if (ctx->nsaves > 0) {
+		NVGsaveMark* mark = &ctx->saves[ctx->nsaves-1];
+		if ((mark->saved & (1 << group)) == 0) {
+			if (!nvg__saveStateGroup(ctx, group))
+				return NULL;
+			mark->saved |= 1 << group;
+		}
+	}
+	return &ctx->state;
+}
+
+static NVGtextCache* nvg__allocTextCache(void)
+{
+	NVGtextCache* tc = (NVGtextCache*)malloc(sizeof(NVGtextCache));
+	int i;
+	if (tc == NULL) return NULL;
+	memset(tc, 0, sizeof(NVGtextCache));
+	for (i = 0; i < NVG_TEXT_CACHE_HASH; i++)
+		tc->buckets[i] = -1;
+	// All runs start unused in the LRU list, len -1 marks them not being in any bucket.
+	for (i = 0; i < NVG_TEXT_CACHE_SIZE; i++) {
+		tc->runs[i].next = -1;
+		tc->runs[i].len = -1;
+		tc->runs[i].lruPrev = i-1;
+		tc->runs[i].lruNext = i+1 < NVG_TEXT_CACHE_SIZE ? i+1 : -1;
+	}
+	tc->lruHead = 0;
+	tc->lruTail = NVG_TEXT_CACHE_SIZE-1;
+	return tc;
 }
 
 NVGcontext* nvgCreateInternal(NVGparams* params)
@@ -324,7 +659,19 @@ NVGcontext* nvgCreateInternal(NVGparams* params)
 	ctx->cache = nvg__allocPathCache();
 	if (ctx->cache == NULL) goto error;
 
-	nvgSave(ctx);
+	ctx->saves = (NVGsaveMark*)malloc(sizeof(NVGsaveMark)*NVG_INIT_STATES_SIZE);
+	if (!ctx->saves) goto error;
+	ctx->nsaves = 0;
+	ctx->csaves = NVG_INIT_STATES_SIZE;
+
+	ctx->undo = (unsigned char*)malloc(NVG_INIT_UNDO_SIZE);
+	if (!ctx->undo) goto error;
+	ctx->nundo = 0;
+	ctx->cundo = NVG_INIT_UNDO_SIZE;
+
+	ctx->textCache = nvg__allocTextCache();
+	if (ctx->textCache == NULL) goto error;
+
 	nvgReset(ctx);
 
 	nvg__setDevicePixelRatio(ctx, 1.0f);
@@ -335,7 +682,7 @@ NVGcontext* nvgCreateInternal(NVGparams* params)
 	memset(&fontParams, 0, sizeof(fontParams));
 	fontParams.width = NVG_INIT_FONTIMAGE_SIZE;
 	fontParams.height = NVG_INIT_FONTIMAGE_SIZE;
-	fontParams.flags = FONS_ZERO_TOPLEFT;
+	fontParams.flags = FONS_ZERO_TOPLEFT | (params->fontAtlasMaxRects ? FONS_PACK_MAXRECTS : 0);
 	fontParams.renderCreate = NULL;
 	fontParams.renderUpdate = NULL;
 	fontParams.renderDraw = NULL;
@@ -367,6 +714,19 @@ void nvgDeleteInternal(NVGcontext* ctx)
 	if (ctx == NULL) return;
 	if (ctx->commands != NULL) free(ctx->commands);
 	if (ctx->cache != NULL) nvg__deletePathCache(ctx->cache);
+	if (ctx->saves != NULL) free(ctx->saves);
+	if (ctx->undo != NULL) free(ctx->undo);
+	if (ctx->xforms != NULL) free(ctx->xforms);
+	if (ctx->scissors != NULL) free(ctx->scissors);
+	for (i = 0; i <= NVG_MAX_CAP_DIVS; i++) {
+		if (ctx->capTables[i] != NULL)
+			free(ctx->capTables[i]);
+	}
+	if (ctx->textCache != NULL) {
+		for (i = 0; i < NVG_TEXT_CACHE_SIZE; i++)
+			free(ctx->textCache->runs[i].data);
+		free(ctx->textCache);
+	}
 
 	if (ctx->fs)
 		fonsDeleteInternal(ctx->fs);
@@ -386,11 +746,18 @@ void nvgDeleteInternal(NVGcontext* ctx)
 
 void nvgBeginFrame(NVGcontext* ctx, float windowWidth, float windowHeight, float devicePixelRatio)
 {
-	ctx->nstates = 0;
-	nvgSave(ctx);
+	ctx->nsaves = 0;
+	ctx->nlostSaves = 0;
+	ctx->nundo = 0;
+	ctx->nxforms = 0;
+	ctx->nlostXforms = 0;
+	ctx->nscissors = 0;
+	ctx->nlostScissors = 0;
 	nvgReset(ctx);
 
 	nvg__setDevicePixelRatio(ctx, devicePixelRatio);
+	ctx->viewWidth = windowWidth;
+	ctx->viewHeight = windowHeight;
 
 	ctx->params.renderViewport(ctx->params.userPtr, windowWidth, windowHeight, devicePixelRatio);
 
@@ -398,8 +765,242 @@ void nvgBeginFrame(NVGcontext* ctx, float windowWidth, float windowHeight, float
 	ctx->fillTriCount = 0;
 	ctx->strokeTriCount = 0;
 	ctx->textTriCount = 0;
+
+	// Copy glyphs finished by the workers, they are uploaded with the next text.
+	fonsBeginFrame(ctx->fs);
+	fonsPackGlyphs(ctx->fs);
+}
+
+void nvgGetMemoryStats(NVGcontext* ctx, NVGmemoryStats* stats)
+{
+	NVGmemoryBuffer* buffers = stats->buffers;
+	int i, w = 0, h = 0;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < NVG_MEMORY_BUFFER_COUNT; i++)
+		buffers[i] = ctx->mem[i];
+
+	buffers[NVG_MEMORY_COMMANDS].capacity = ctx->ccommands*(int)sizeof(float);
+	buffers[NVG_MEMORY_POINTS].capacity = ctx->cache->cpoints*(int)sizeof(NVGpoint);
+	buffers[NVG_MEMORY_PATHS].capacity = ctx->cache->cpaths*(int)sizeof(NVGpath);
+	buffers[NVG_MEMORY_VERTS].capacity = ctx->cache->cverts*(int)sizeof(NVGvertex);
+	buffers[NVG_MEMORY_STATES].capacity = ctx->csaves*(int)sizeof(NVGsaveMark) + ctx->cundo +
+		ctx->cxforms*(int)sizeof(float)*6 + ctx->cscissors*(int)sizeof(NVGscissor);
+
+	fonsGetAtlasSize(ctx->fs, &w, &h);
+	buffers[NVG_MEMORY_FONT_ATLAS].current = w*h;
+	buffers[NVG_MEMORY_FONT_ATLAS].capacity = w*h;
+
+	if (ctx->params.renderMemoryStats != NULL)
+		ctx->params.renderMemoryStats(ctx->params.userPtr, buffers);
+
+	for (i = 0; i < NVG_MEMORY_BUFFER_COUNT; i++)
+		stats->capacity += buffers[i].capacity;
+	stats->budget = ctx->memBudget;
+	stats->trimCount = ctx->memTrimCount;
+}
+
+void nvgGetTextStats(NVGcontext* ctx, NVGtextStats* stats)
+{
+	*stats = ctx->textStats;
+}
+
+void nvgGetGlyphStats(NVGcontext* ctx, int font, NVGglyphStats* stats)
+{
+	FONSglyphStats fstats;
+	fonsGetGlyphStats(ctx->fs, font, &fstats);
+	stats->hits = fstats.hits;
+	stats->misses = fstats.misses;
+	stats->rasterized = fstats.rasterized;
+	stats->evicted = fstats.evicted;
+	stats->glyphs = fstats.glyphs;
+	stats->atlasBytes = fstats.atlasBytes;
+	stats->lookups = fstats.lookups;
+	stats->probes = fstats.probes;
+	stats->maxProbe = fstats.maxProbe;
+	stats->hashSlots = fstats.hashSlots;
+}
+
+void nvgGetFontAtlasStats(NVGcontext* ctx, NVGfontAtlasStats* stats)
+{
+	FONSatlasStats fstats;
+	fonsGetAtlasStats(ctx->fs, &fstats);
+	stats->pages = fstats.pages;
+	stats->area = fstats.area;
+	stats->used = fstats.used;
+	stats->free = fstats.free;
+	stats->largestFree = fstats.largestFree;
+	stats->freeRects = fstats.freeRects;
+}
+
+void nvgGetTextUploadStats(NVGcontext* ctx, NVGtextUploadStats* stats)
+{
+	*stats = ctx->textUploads;
+}
+
+void nvgMemoryBudget(NVGcontext* ctx, int budget, int trimFrames)
+{
+	ctx->memBudget = nvg__maxi(0, budget);
+	ctx->memTrimFrames = nvg__maxi(1, trimFrames);
+	ctx->memOverFrames = 0;
+}
+
+static void* nvg__shrinkBuffer(void* buf, int* cap, int n, int size, int target, int minCap)
+{
+	int c = nvg__maxi(nvg__maxi(target / size, n), minCap);
+	void* ptr;
+	if (buf == NULL || c >= *cap) return buf;
+	ptr = realloc(buf, size*c);
+	if (ptr == NULL) return buf;
+	*cap = c;
+	return ptr;
+}
+
+static void nvg__trimMemory(NVGcontext* ctx)
+{
+	NVGpathCache* cache = ctx->cache;
+	int sizes[NVG_MEMORY_BUFFER_COUNT];
+	int i;
+
+	// Leave some headroom so that the next frame will not need to grow the buffers again.
+	for (i = 0; i < NVG_MEMORY_BUFFER_COUNT; i++)
+		sizes[i] = ctx->memWindow[i] + ctx->memWindow[i]/4;
+
+	ctx->commands = (float*)nvg__shrinkBuffer(ctx->commands, &ctx->ccommands, ctx->ncommands,
+		sizeof(float), sizes[NVG_MEMORY_COMMANDS], NVG_INIT_COMMANDS_SIZE);
+	cache->points = (NVGpoint*)nvg__shrinkBuffer(cache->points, &cache->cpoints, cache->npoints,
+		sizeof(NVGpoint), sizes[NVG_MEMORY_POINTS], NVG_INIT_POINTS_SIZE);
+	cache->paths = (NVGpath*)nvg__shrinkBuffer(cache->paths, &cache->cpaths, cache->npaths,
+		sizeof(NVGpath), sizes[NVG_MEMORY_PATHS], NVG_INIT_PATHS_SIZE);
+	cache->verts = (NVGvertex*)nvg__shrinkBuffer(cache->verts, &cache->cverts, cache->nverts,
+		sizeof(NVGvertex), sizes[NVG_MEMORY_VERTS], NVG_INIT_VERTS_SIZE);
+
+	// The state buffers share one budget, none of them can use more than the whole.
+	ctx->saves = (NVGsaveMark*)nvg__shrinkBuffer(ctx->saves, &ctx->csaves, ctx->nsaves,
+		sizeof(NVGsaveMark), sizes[NVG_MEMORY_STATES], NVG_INIT_STATES_SIZE);
+	ctx->undo = (unsigned char*)nvg__shrinkBuffer(ctx->undo, &ctx->cundo, ctx->nundo,
+		1, sizes[NVG_MEMORY_STATES], NVG_INIT_UNDO_SIZE);
+	ctx->xforms = (float*)nvg__shrinkBuffer(ctx->xforms, &ctx->cxforms, ctx->nxforms,
+		sizeof(float)*6, sizes[NVG_MEMORY_STATES], NVG_INIT_STATES_SIZE);
+	ctx->scissors = (NVGscissor*)nvg__shrinkBuffer(ctx->scissors, &ctx->cscissors, ctx->nscissors,
+		sizeof(NVGscissor), sizes[NVG_MEMORY_STATES], NVG_INIT_STATES_SIZE);
+
+	if (ctx->params.renderTrimMemory != NULL)
+		ctx->params.renderTrimMemory(ctx->params.userPtr, sizes);
+
+	ctx->memTrimCount++;
+}
+
+static void nvg__updateMemory(NVGcontext* ctx)
+{
+	NVGmemoryStats stats;
+	int i, w = 0, h = 0;
+
+	nvg__trackMemory(ctx, NVG_MEMORY_STATES, nvg__stateBytes(ctx));
+	fonsGetAtlasSize(ctx->fs, &w, &h);
+	nvg__trackMemory(ctx, NVG_MEMORY_FONT_ATLAS, w*h);
+	for (i = 0; i < NVG_MEMORY_BUFFER_COUNT; i++) {
+		ctx->mem[i].current = ctx->memFrame[i];
+		ctx->mem[i].peak = nvg__maxi(ctx->mem[i].peak, ctx->memFrame[i]);
+		ctx->memFrame[i] = 0;
+	}
+
+	if (ctx->memBudget <= 0)
+		return;
+
+	nvgGetMemoryStats(ctx, &stats);
+	if (stats.capacity <= ctx->memBudget) {
+		ctx->memOverFrames = 0;
+		return;
+	}
+
+	// Start measuring from the frame after the budget was exceeded,
+	// so that the spike which caused it is not included.
+	if (ctx->memOverFrames++ == 0) {
+		memset(ctx->memWindow, 0, sizeof(ctx->memWindow));
+		return;
+	}
+	for (i = 0; i < NVG_MEMORY_BUFFER_COUNT; i++)
+		ctx->memWindow[i] = nvg__maxi(ctx->memWindow[i], stats.buffers[i].current);
+
+	if (ctx->memOverFrames > ctx->memTrimFrames) {
+		nvg__trimMemory(ctx);
+		ctx->memOverFrames = 0;
+	}
+}
+
+static void nvg__setQualityLevel(NVGcontext* ctx, int level, float frameTime)
+{
+	NVGqualityChange* change;
+	if (ctx->nqualityHistory >= NVG_QUALITY_HISTORY_SIZE) {
+		memmove(ctx->qualityHistory, ctx->qualityHistory+1, sizeof(NVGqualityChange)*(NVG_QUALITY_HISTORY_SIZE-1));
+		ctx->nqualityHistory--;
+	}
+	change = &ctx->qualityHistory[ctx->nqualityHistory++];
+	change->frame = ctx->qualityFrame;
+	change->level = level;
+	change->frameTime = frameTime;
+	ctx->qualityLevel = level;
+	ctx->qualityRecover = 0;
+}
+
+void nvgQualityGovernor(NVGcontext* ctx, float frameBudget, int maxLevel, int flags)
+{
+	// Full quality is restored when the governor is disabled, as nothing would raise it back later.
+	int level = frameBudget > 0.0f ? nvg__mini(ctx->qualityLevel, nvg__clampi(maxLevel, 0, NVG_QUALITY_MAX_LEVEL)) : 0;
+	ctx->qualityBudget = frameBudget;
+	ctx->qualityMaxLevel = nvg__clampi(maxLevel, 0, NVG_QUALITY_MAX_LEVEL);
+	ctx->qualityFlags = flags;
+	if (level != ctx->qualityLevel)
+		nvg__setQualityLevel(ctx, level, 0.0f);
+	ctx->qualityFrames = 0;
+	ctx->qualityTime = 0.0f;
+	ctx->qualityRecover = 0;
+}
+
+void nvgQualityFrameTime(NVGcontext* ctx, float frameTime)
+{
+	float avg;
+
+	ctx->qualityFrame++;
+	if (ctx->qualityBudget <= 0.0f)
+		return;
+
+	ctx->qualityTime += frameTime;
+	if (++ctx->qualityFrames < NVG_QUALITY_SAMPLES)
+		return;
+	avg = ctx->qualityTime / ctx->qualityFrames;
+	ctx->qualityTime = 0.0f;
+	ctx->qualityFrames = 0;
+
+	// Lower quality as soon as the budget is exceeded, but require sustained headroom before raising it back.
+	if (avg > ctx->qualityBudget) {
+		ctx->qualityRecover = 0;
+		if (ctx->qualityLevel < ctx->qualityMaxLevel)
+			nvg__setQualityLevel(ctx, ctx->qualityLevel+1, avg);
+	} else if (avg < ctx->qualityBudget*NVG_QUALITY_HEADROOM && ctx->qualityLevel > 0) {
+		if (++ctx->qualityRecover >= NVG_QUALITY_RECOVER)
+			nvg__setQualityLevel(ctx, ctx->qualityLevel-1, avg);
+	} else {
+		ctx->qualityRecover = 0;
+	}
+}
+
+int nvgQualityLevel(NVGcontext* ctx)
+{
+	return ctx->qualityLevel;
+}
+
+int nvgQualityHistory(NVGcontext* ctx, NVGqualityChange* changes, int maxChanges)
+{
+	int n = nvg__clampi(maxChanges, 0, ctx->nqualityHistory);
+	if (n > 0)
+		memcpy(changes, &ctx->qualityHistory[ctx->nqualityHistory-n], sizeof(NVGqualityChange)*n);
+	return n;
 }
 
+static void nvg__flushTextTexture(NVGcontext* ctx);
+
 void nvgCancelFrame(NVGcontext* ctx)
 {
 	ctx->params.renderCancel(ctx->params.userPtr);
@@ -407,7 +1008,19 @@ void nvgCancelFrame(NVGcontext* ctx)
 
 void nvgEndFrame(NVGcontext* ctx)
 {
+	// Upload the glyphs added during the frame before the draw calls are submitted.
+	nvg__flushTextTexture(ctx);
+	ctx->textStats.glyphs = ctx->textGlyphCount;
+	ctx->textStats.culledGlyphs = ctx->textCulledCount;
+	ctx->textGlyphCount = 0;
+	ctx->textCulledCount = 0;
+	ctx->textUploads.uploads = ctx->textUploadCount;
+	ctx->textUploads.bytes = ctx->textUploadBytes;
+	ctx->textUploads.peakBytes = nvg__maxi(ctx->textUploads.peakBytes, ctx->textUploadBytes);
+	ctx->textUploadCount = 0;
+	ctx->textUploadBytes = 0;
 	ctx->params.renderFlush(ctx->params.userPtr);
+	nvg__updateMemory(ctx);
 	if (ctx->fontImageIdx != 0) {
 		int fontImage = ctx->fontImages[ctx->fontImageIdx];
 		ctx->fontImages[ctx->fontImageIdx] = 0;
@@ -641,23 +1254,58 @@ static void nvg__setPaintColor(NVGpaint* p, NVGcolor color)
 // State handling
 void nvgSave(NVGcontext* ctx)
 {
-	if (ctx->nstates >= NVG_MAX_STATES)
+	NVGsaveMark* mark;
+	// Once a save is lost the ones above it are lost too, so that the restores match them in order.
+	if (ctx->nlostSaves > 0) {
+		ctx->nlostSaves++;
 		return;
-	if (ctx->nstates > 0)
-		memcpy(&ctx->states[ctx->nstates], &ctx->states[ctx->nstates-1], sizeof(NVGstate));
-	ctx->nstates++;
+	}
+	if (ctx->nsaves+1 > ctx->csaves) {
+		NVGsaveMark* saves;
+		int csaves = ctx->nsaves+1 + ctx->csaves/2;
+		saves = (NVGsaveMark*)realloc(ctx->saves, sizeof(NVGsaveMark)*csaves);
+		if (saves == NULL) {
+			ctx->nlostSaves++;
+			return;
+		}
+		ctx->saves = saves;
+		ctx->csaves = csaves;
+	}
+	mark = &ctx->saves[ctx->nsaves++];
+	mark->undo = ctx->nundo;
+	mark->saved = 0;
 }
 
 void nvgRestore(NVGcontext* ctx)
 {
-	if (ctx->nstates <= 1)
+	NVGsaveMark* mark;
+	if (ctx->nlostSaves > 0) {
+		ctx->nlostSaves--;
 		return;
-	ctx->nstates--;
+	}
+	if (ctx->nsaves <= 0)
+		return;
+	nvg__trackMemory(ctx, NVG_MEMORY_STATES, nvg__stateBytes(ctx));
+	mark = &ctx->saves[--ctx->nsaves];
+	while (ctx->nundo > mark->undo) {
+		const NVGstateGroup* g;
+		int group;
+		memcpy(&group, &ctx->undo[ctx->nundo - sizeof(int)], sizeof(int));
+		g = &nvg__stateGroups[group];
+		ctx->nundo -= g->size + (int)sizeof(int);
+		memcpy((unsigned char*)&ctx->state + g->offset, &ctx->undo[ctx->nundo], g->size);
+	}
 }
 
 void nvgReset(NVGcontext* ctx)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state;
+	int i;
+	for (i = 0; i < NVG_STATE_COUNT; i++) {
+		if (nvg__modifyState(ctx, i) == NULL)
+			return;
+	}
+	state = nvg__getState(ctx);
 	memset(state, 0, sizeof(*state));
 
 	nvg__setPaintColor(&state->fill, nvgRGBA(255,255,255,255));
@@ -674,6 +1322,9 @@ void nvgReset(NVGcontext* ctx)
 	state->scissor.extent[0] = -1.0f;
 	state->scissor.extent[1] = -1.0f;
 
+	state->simplify = NVG_SIMPLIFY_NONE;
+	state->simplifyTol = 1.0f;
+
 	state->fontSize = 16.0f;
 	state->letterSpacing = 0.0f;
 	state->lineHeight = 1.0f;
@@ -685,56 +1336,73 @@ void nvgReset(NVGcontext* ctx)
 // State setting
 void nvgShapeAntiAlias(NVGcontext* ctx, int enabled)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_ANTIALIAS);
+	if (state == NULL) return;
 	state->shapeAntiAlias = enabled;
 }
 
 void nvgStrokeWidth(NVGcontext* ctx, float width)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_STROKESTYLE);
+	if (state == NULL) return;
 	state->strokeWidth = width;
 }
 
 void nvgMiterLimit(NVGcontext* ctx, float limit)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_STROKESTYLE);
+	if (state == NULL) return;
 	state->miterLimit = limit;
 }
 
 void nvgLineCap(NVGcontext* ctx, int cap)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_STROKESTYLE);
+	if (state == NULL) return;
 	state->lineCap = cap;
 }
 
 void nvgLineJoin(NVGcontext* ctx, int join)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_STROKESTYLE);
+	if (state == NULL) return;
 	state->lineJoin = join;
 }
 
+void nvgPathSimplify(NVGcontext* ctx, int mode, float tolerance)
+{
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_SIMPLIFY);
+	if (state == NULL) return;
+	state->simplify = mode;
+	state->simplifyTol = tolerance;
+}
+
 void nvgGlobalAlpha(NVGcontext* ctx, float alpha)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_ALPHA);
+	if (state == NULL) return;
 	state->alpha = alpha;
 }
 
 void nvgTransform(NVGcontext* ctx, float a, float b, float c, float d, float e, float f)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_XFORM);
+	if (state == NULL) return;
 	float t[6] = { a, b, c, d, e, f };
 	nvgTransformPremultiply(state->xform, t);
 }
 
 void nvgResetTransform(NVGcontext* ctx)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_XFORM);
+	if (state == NULL) return;
 	nvgTransformIdentity(state->xform);
 }
 
 void nvgTranslate(NVGcontext* ctx, float x, float y)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_XFORM);
+	if (state == NULL) return;
 	float t[6];
 	nvgTransformTranslate(t, x,y);
 	nvgTransformPremultiply(state->xform, t);
@@ -742,7 +1410,8 @@ void nvgTranslate(NVGcontext* ctx, float x, float y)
 
 void nvgRotate(NVGcontext* ctx, float angle)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_XFORM);
+	if (state == NULL) return;
 	float t[6];
 	nvgTransformRotate(t, angle);
 	nvgTransformPremultiply(state->xform, t);
@@ -750,7 +1419,8 @@ void nvgRotate(NVGcontext* ctx, float angle)
 
 void nvgSkewX(NVGcontext* ctx, float angle)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_XFORM);
+	if (state == NULL) return;
 	float t[6];
 	nvgTransformSkewX(t, angle);
 	nvgTransformPremultiply(state->xform, t);
@@ -758,7 +1428,8 @@ void nvgSkewX(NVGcontext* ctx, float angle)
 
 void nvgSkewY(NVGcontext* ctx, float angle)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_XFORM);
+	if (state == NULL) return;
 	float t[6];
 	nvgTransformSkewY(t, angle);
 	nvgTransformPremultiply(state->xform, t);
@@ -766,7 +1437,8 @@ void nvgSkewY(NVGcontext* ctx, float angle)
 
 void nvgScale(NVGcontext* ctx, float x, float y)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_XFORM);
+	if (state == NULL) return;
 	float t[6];
 	nvgTransformScale(t, x,y);
 	nvgTransformPremultiply(state->xform, t);
@@ -779,28 +1451,71 @@ void nvgCurrentTransform(NVGcontext* ctx, float* xform)
 	memcpy(xform, state->xform, sizeof(float)*6);
 }
 
-void nvgStrokeColor(NVGcontext* ctx, NVGcolor color)
+void nvgPushTransform(NVGcontext* ctx)
 {
 	NVGstate* state = nvg__getState(ctx);
+	if (ctx->nlostXforms > 0) {
+		ctx->nlostXforms++;
+		return;
+	}
+	if (ctx->nxforms+1 > ctx->cxforms) {
+		float* xforms;
+		int cxforms = nvg__maxi(ctx->nxforms+1, NVG_INIT_STATES_SIZE) + ctx->cxforms/2;
+		xforms = (float*)realloc(ctx->xforms, sizeof(float)*6*cxforms);
+		if (xforms == NULL) {
+			ctx->nlostXforms++;
+			return;
+		}
+		ctx->xforms = xforms;
+		ctx->cxforms = cxforms;
+	}
+	memcpy(&ctx->xforms[ctx->nxforms*6], state->xform, sizeof(float)*6);
+	ctx->nxforms++;
+	nvg__trackMemory(ctx, NVG_MEMORY_STATES, nvg__stateBytes(ctx));
+}
+
+void nvgPopTransform(NVGcontext* ctx)
+{
+	NVGstate* state;
+	if (ctx->nlostXforms > 0) {
+		ctx->nlostXforms--;
+		return;
+	}
+	if (ctx->nxforms <= 0)
+		return;
+	// The entry is popped even if the transform cannot be saved for undo and stays as is.
+	ctx->nxforms--;
+	state = nvg__modifyState(ctx, NVG_STATE_XFORM);
+	if (state == NULL) return;
+	memcpy(state->xform, &ctx->xforms[ctx->nxforms*6], sizeof(float)*6);
+}
+
+void nvgStrokeColor(NVGcontext* ctx, NVGcolor color)
+{
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_STROKE);
+	if (state == NULL) return;
 	nvg__setPaintColor(&state->stroke, color);
 }
 
 void nvgStrokePaint(NVGcontext* ctx, NVGpaint paint)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_STROKE);
+	if (state == NULL) return;
 	state->stroke = paint;
 	nvgTransformMultiply(state->stroke.xform, state->xform);
 }
 
 void nvgFillColor(NVGcontext* ctx, NVGcolor color)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_FILL);
+	if (state == NULL) return;
 	nvg__setPaintColor(&state->fill, color);
 }
 
 void nvgFillPaint(NVGcontext* ctx, NVGpaint paint)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_FILL);
+	if (state == NULL) return;
 	state->fill = paint;
 	nvgTransformMultiply(state->fill.xform, state->xform);
 }
@@ -975,7 +1690,8 @@ NVGpaint nvgImagePattern(NVGcontext* ctx,
 // Scissoring
 void nvgScissor(NVGcontext* ctx, float x, float y, float w, float h)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_SCISSOR);
+	if (state == NULL) return;
 
 	w = nvg__maxf(0.0f, w);
 	h = nvg__maxf(0.0f, h);
@@ -1034,16 +1750,90 @@ void nvgIntersectScissor(NVGcontext* ctx, float x, float y, float w, float h)
 
 void nvgResetScissor(NVGcontext* ctx)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_SCISSOR);
+	if (state == NULL) return;
 	memset(state->scissor.xform, 0, sizeof(state->scissor.xform));
 	state->scissor.extent[0] = -1.0f;
 	state->scissor.extent[1] = -1.0f;
 }
 
+// Returns the axis aligned bounds of the part of the viewport inside the current scissor, in local coordinates.
+static void nvg__visibleBounds(NVGcontext* ctx, float* bounds)
+{
+	NVGstate* state = nvg__getState(ctx);
+	float minx = 0.0f, miny = 0.0f, maxx = ctx->viewWidth, maxy = ctx->viewHeight;
+	float inv[6], px, py;
+	int i;
+
+	if (state->scissor.extent[0] >= 0.0f) {
+		float sminx = 1e6f, sminy = 1e6f, smaxx = -1e6f, smaxy = -1e6f;
+		for (i = 0; i < 4; i++) {
+			float ex = (i & 1) ? state->scissor.extent[0] : -state->scissor.extent[0];
+			float ey = (i & 2) ? state->scissor.extent[1] : -state->scissor.extent[1];
+			nvgTransformPoint(&px, &py, state->scissor.xform, ex, ey);
+			sminx = nvg__minf(sminx, px); sminy = nvg__minf(sminy, py);
+			smaxx = nvg__maxf(smaxx, px); smaxy = nvg__maxf(smaxy, py);
+		}
+		minx = nvg__maxf(minx, sminx); miny = nvg__maxf(miny, sminy);
+		maxx = nvg__minf(maxx, smaxx); maxy = nvg__minf(maxy, smaxy);
+	}
+
+	if (!nvgTransformInverse(inv, state->xform)) {
+		bounds[0] = bounds[1] = -1e6f;
+		bounds[2] = bounds[3] = 1e6f;
+		return;
+	}
+	bounds[0] = bounds[1] = 1e6f;
+	bounds[2] = bounds[3] = -1e6f;
+	for (i = 0; i < 4; i++) {
+		nvgTransformPoint(&px, &py, inv, (i & 1) ? maxx : minx, (i & 2) ? maxy : miny);
+		bounds[0] = nvg__minf(bounds[0], px); bounds[1] = nvg__minf(bounds[1], py);
+		bounds[2] = nvg__maxf(bounds[2], px); bounds[3] = nvg__maxf(bounds[3], py);
+	}
+}
+
+void nvgPushScissor(NVGcontext* ctx)
+{
+	NVGstate* state = nvg__getState(ctx);
+	if (ctx->nlostScissors > 0) {
+		ctx->nlostScissors++;
+		return;
+	}
+	if (ctx->nscissors+1 > ctx->cscissors) {
+		NVGscissor* scissors;
+		int cscissors = nvg__maxi(ctx->nscissors+1, NVG_INIT_STATES_SIZE) + ctx->cscissors/2;
+		scissors = (NVGscissor*)realloc(ctx->scissors, sizeof(NVGscissor)*cscissors);
+		if (scissors == NULL) {
+			ctx->nlostScissors++;
+			return;
+		}
+		ctx->scissors = scissors;
+		ctx->cscissors = cscissors;
+	}
+	ctx->scissors[ctx->nscissors++] = state->scissor;
+	nvg__trackMemory(ctx, NVG_MEMORY_STATES, nvg__stateBytes(ctx));
+}
+
+void nvgPopScissor(NVGcontext* ctx)
+{
+	NVGstate* state;
+	if (ctx->nlostScissors > 0) {
+		ctx->nlostScissors--;
+		return;
+	}
+	if (ctx->nscissors <= 0)
+		return;
+	ctx->nscissors--;
+	state = nvg__modifyState(ctx, NVG_STATE_SCISSOR);
+	if (state == NULL) return;
+	state->scissor = ctx->scissors[ctx->nscissors];
+}
+
 // Global composite operation.
 void nvgGlobalCompositeOperation(NVGcontext* ctx, int op)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_COMPOSITE);
+	if (state == NULL) return;
 	state->compositeOperation = nvg__compositeOperationState(op);
 }
 
@@ -1060,7 +1850,8 @@ void nvgGlobalCompositeBlendFuncSeparate(NVGcontext* ctx, int srcRGB, int dstRGB
 	op.srcAlpha = srcAlpha;
 	op.dstAlpha = dstAlpha;
 
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_COMPOSITE);
+	if (state == NULL) return;
 	state->compositeOperation = op;
 }
 
@@ -1238,6 +2029,7 @@ static float nvg__getAverageScale(float *t)
 
 static NVGvertex* nvg__allocTempVerts(NVGcontext* ctx, int nverts)
 {
+	nvg__trackMemory(ctx, NVG_MEMORY_VERTS, nverts*(int)sizeof(NVGvertex));
 	if (nverts > ctx->cache->cverts) {
 		NVGvertex* verts;
 		int cverts = (nverts + 0xff) & ~0xff; // Round up to prevent allocations when things change just slightly.
@@ -1337,10 +2129,120 @@ static void nvg__tesselateBezier(NVGcontext* ctx,
 	nvg__tesselateBezier(ctx, x1234,y1234, x234,y234, x34,y34, x4,y4, level+1, type);
 }
 
+// Keeps the first, last, and the lowest and highest point of each run of consecutive points
+// which fall into the same pixel column. Points are compacted in place, dst may alias src.
+static int nvg__decimateColumns(NVGpoint* dst, NVGpoint* src, int npts, float colw)
+{
+	int i = 0, n = 0, last = -1;
+	while (i < npts) {
+		float col = floorf(src[i].x / colw);
+		int imin = i, imax = i, end = i+1, k;
+		int keep[4];
+		while (end < npts && floorf(src[end].x / colw) == col) {
+			if (src[end].y < src[imin].y) imin = end;
+			if (src[end].y > src[imax].y) imax = end;
+			end++;
+		}
+		keep[0] = i;
+		keep[1] = nvg__mini(imin, imax);
+		keep[2] = nvg__maxi(imin, imax);
+		keep[3] = end-1;
+		for (k = 0; k < 4; k++) {
+			if (keep[k] > last) {
+				dst[n++] = src[keep[k]];
+				last = keep[k];
+			}
+		}
+		i = end;
+	}
+	return n;
+}
+
+// Ramer-Douglas-Peucker simplification, tol is squared distance.
+// Points are compacted in place, dst may alias src.
+static int nvg__simplifyRDP(NVGcontext* ctx, NVGpoint* dst, NVGpoint* src, int npts, float tol)
+{
+	NVGpathCache* cache = ctx->cache;
+	int i, n, nstack = 0;
+
+	if (npts < 3) {
+		memmove(dst, src, sizeof(NVGpoint)*npts);
+		return npts;
+	}
+	if (npts*2 > cache->cstack) {
+		int* stack;
+		int cstack = npts*2 + cache->cstack/2;
+		stack = (int*)realloc(cache->stack, sizeof(int)*cstack);
+		if (stack == NULL) {
+			memmove(dst, src, sizeof(NVGpoint)*npts);
+			return npts;
+		}
+		cache->stack = stack;
+		cache->cstack = cstack;
+	}
+
+	src[0].flags |= NVG_PT_KEEP;
+	src[npts-1].flags |= NVG_PT_KEEP;
+	cache->stack[nstack++] = 0;
+	cache->stack[nstack++] = npts-1;
+	while (nstack > 0) {
+		int last = cache->stack[--nstack];
+		int first = cache->stack[--nstack];
+		int imax = -1;
+		float dmax = tol;
+		for (i = first+1; i < last; i++) {
+			float d = nvg__distPtSeg(src[i].x, src[i].y, src[first].x, src[first].y, src[last].x, src[last].y);
+			if (d > dmax) {
+				dmax = d;
+				imax = i;
+			}
+		}
+		if (imax != -1) {
+			src[imax].flags |= NVG_PT_KEEP;
+			cache->stack[nstack++] = first;
+			cache->stack[nstack++] = imax;
+			cache->stack[nstack++] = imax;
+			cache->stack[nstack++] = last;
+		}
+	}
+
+	for (i = n = 0; i < npts; i++) {
+		if (src[i].flags & NVG_PT_KEEP) {
+			dst[n] = src[i];
+			dst[n].flags &= ~NVG_PT_KEEP;
+			n++;
+		}
+	}
+	return n;
+}
+
+static void nvg__simplifyPaths(NVGcontext* ctx, int mode, float tol)
+{
+	NVGpathCache* cache = ctx->cache;
+	int j, n, first = 0;
+
+	// Tolerance is in device pixels.
+	tol = nvg__maxf(tol, 0.01f) * ctx->fringeWidth;
+
+	for (j = 0; j < cache->npaths; j++) {
+		NVGpath* path = &cache->paths[j];
+		NVGpoint* src = &cache->points[path->first];
+		NVGpoint* dst = &cache->points[first];
+		if (mode == NVG_SIMPLIFY_MINMAX)
+			n = nvg__decimateColumns(dst, src, path->count, tol);
+		else
+			n = nvg__simplifyRDP(ctx, dst, src, path->count, tol*tol);
+		path->first = first;
+		path->count = n;
+		first += n;
+	}
+	cache->npoints = first;
+}
+
 static void nvg__flattenPaths(NVGcontext* ctx)
 {
 	NVGpathCache* cache = ctx->cache;
-//	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__getState(ctx);
 	NVGpoint* last;
 	NVGpoint* p0;
 	NVGpoint* p1;
@@ -1394,6 +2296,9 @@ static void nvg__flattenPaths(NVGcontext* ctx)
 		}
 	}
 
+	if (state->simplify != NVG_SIMPLIFY_NONE)
+		nvg__simplifyPaths(ctx, state->simplify, state->simplifyTol);
+
 	cache->bounds[0] = cache->bounds[1] = 1e6f;
 	cache->bounds[2] = cache->bounds[3] = -1e6f;
 
@@ -1442,8 +2347,25 @@ static int nvg__curveDivs(float r, float arc, float tol)
 	return nvg__maxi(2, (int)ceilf(arc / da));
 }
 
-static void nvg__chooseBevel(int bevel, NVGpoint* p0, NVGpoint* p1, float w,
-							float* x0, float* y0, float* x1, float* y1)
+// Returns cached cos/sin pairs of n angles evenly spaced over a half circle.
+static const float* nvg__capTable(NVGcontext* ctx, int n)
+{
+	float* table = ctx->capTables[n];
+	int i;
+	if (table != NULL) return table;
+	table = (float*)malloc(sizeof(float)*2*n);
+	if (table == NULL) return NULL;
+	for (i = 0; i < n; i++) {
+		float a = i/(float)(n-1)*NVG_PI;
+		table[i*2+0] = cosf(a);
+		table[i*2+1] = sinf(a);
+	}
+	ctx->capTables[n] = table;
+	return table;
+}
+
+static void nvg__chooseBevel(int bevel, NVGpoint* p0, NVGpoint* p1, float w,
+							float* x0, float* y0, float* x1, float* y1)
 {
 	if (bevel) {
 		*x0 = p1->x + p0->dy * w;
@@ -1467,6 +2389,7 @@ static NVGvertex* nvg__roundJoin(NVGvertex* dst, NVGpoint* p0, NVGpoint* p1,
 	float dly0 = -p0->dx;
 	float dlx1 = p1->dy;
 	float dly1 = -p1->dx;
+	float da, cda, sda, cx, cy;
 	NVG_NOTUSED(fringe);
 
 	if (p1->flags & NVG_PT_LEFT) {
@@ -1479,12 +2402,19 @@ static NVGvertex* nvg__roundJoin(NVGvertex* dst, NVGpoint* p0, NVGpoint* p1,
 		nvg__vset(dst, lx0, ly0, lu,1); dst++;
 		nvg__vset(dst, p1->x - dlx0*rw, p1->y - dly0*rw, ru,1); dst++;
 
+		// Rotate the start direction incrementally instead of evaluating cos/sin per vertex.
 		n = nvg__clampi((int)ceilf(((a0 - a1) / NVG_PI) * ncap), 2, ncap);
+		da = (a1 - a0) / (float)(n-1);
+		cda = cosf(da);
+		sda = sinf(da);
+		cx = -dlx0;
+		cy = -dly0;
 		for (i = 0; i < n; i++) {
-			float u = i/(float)(n-1);
-			float a = a0 + u*(a1-a0);
-			float rx = p1->x + cosf(a) * rw;
-			float ry = p1->y + sinf(a) * rw;
+			float rx = p1->x + cx * rw;
+			float ry = p1->y + cy * rw;
+			float t = cx*cda - cy*sda;
+			cy = cy*cda + cx*sda;
+			cx = t;
 			nvg__vset(dst, p1->x, p1->y, 0.5f,1); dst++;
 			nvg__vset(dst, rx, ry, ru,1); dst++;
 		}
@@ -1503,11 +2433,17 @@ static NVGvertex* nvg__roundJoin(NVGvertex* dst, NVGpoint* p0, NVGpoint* p1,
 		nvg__vset(dst, rx0, ry0, ru,1); dst++;
 
 		n = nvg__clampi((int)ceilf(((a1 - a0) / NVG_PI) * ncap), 2, ncap);
+		da = (a1 - a0) / (float)(n-1);
+		cda = cosf(da);
+		sda = sinf(da);
+		cx = dlx0;
+		cy = dly0;
 		for (i = 0; i < n; i++) {
-			float u = i/(float)(n-1);
-			float a = a0 + u*(a1-a0);
-			float lx = p1->x + cosf(a) * lw;
-			float ly = p1->y + sinf(a) * lw;
+			float lx = p1->x + cx * lw;
+			float ly = p1->y + cy * lw;
+			float t = cx*cda - cy*sda;
+			cy = cy*cda + cx*sda;
+			cx = t;
 			nvg__vset(dst, lx, ly, lu,1); dst++;
 			nvg__vset(dst, p1->x, p1->y, 0.5f,1); dst++;
 		}
@@ -1624,7 +2560,7 @@ static NVGvertex* nvg__buttCapEnd(NVGvertex* dst, NVGpoint* p,
 
 
 static NVGvertex* nvg__roundCapStart(NVGvertex* dst, NVGpoint* p,
-									 float dx, float dy, float w, int ncap,
+									 float dx, float dy, float w, const float* trig, int ncap,
 									 float aa, float u0, float u1)
 {
 	int i;
@@ -1634,8 +2570,7 @@ static NVGvertex* nvg__roundCapStart(NVGvertex* dst, NVGpoint* p,
 	float dly = -dx;
 	NVG_NOTUSED(aa);
 	for (i = 0; i < ncap; i++) {
-		float a = i/(float)(ncap-1)*NVG_PI;
-		float ax = cosf(a) * w, ay = sinf(a) * w;
+		float ax = trig[i*2+0] * w, ay = trig[i*2+1] * w;
 		nvg__vset(dst, px - dlx*ax - dx*ay, py - dly*ax - dy*ay, u0,1); dst++;
 		nvg__vset(dst, px, py, 0.5f,1); dst++;
 	}
@@ -1645,7 +2580,7 @@ static NVGvertex* nvg__roundCapStart(NVGvertex* dst, NVGpoint* p,
 }
 
 static NVGvertex* nvg__roundCapEnd(NVGvertex* dst, NVGpoint* p,
-								   float dx, float dy, float w, int ncap,
+								   float dx, float dy, float w, const float* trig, int ncap,
 								   float aa, float u0, float u1)
 {
 	int i;
@@ -1657,8 +2592,7 @@ static NVGvertex* nvg__roundCapEnd(NVGvertex* dst, NVGpoint* p,
 	nvg__vset(dst, px + dlx*w, py + dly*w, u0,1); dst++;
 	nvg__vset(dst, px - dlx*w, py - dly*w, u1,1); dst++;
 	for (i = 0; i < ncap; i++) {
-		float a = i/(float)(ncap-1)*NVG_PI;
-		float ax = cosf(a) * w, ay = sinf(a) * w;
+		float ax = trig[i*2+0] * w, ay = trig[i*2+1] * w;
 		nvg__vset(dst, px, py, 0.5f,1); dst++;
 		nvg__vset(dst, px - dlx*ax + dx*ay, py - dly*ax + dy*ay, u0,1); dst++;
 	}
@@ -1744,7 +2678,18 @@ static int nvg__expandStroke(NVGcontext* ctx, float w, float fringe, int lineCap
 	int cverts, i, j;
 	float aa = fringe;//ctx->fringeWidth;
 	float u0 = 0.0f, u1 = 1.0f;
-	int ncap = nvg__curveDivs(w, NVG_PI, ctx->tessTol);	// Calculate divisions per half circle.
+	const float* trig;
+	int ncap;
+
+	// Calculate divisions per half circle, consecutive strokes usually share the width.
+	if (w != ctx->capWidth || ctx->joinTol != ctx->capTol) {
+		ctx->capDivs = nvg__mini(nvg__curveDivs(w, NVG_PI, ctx->joinTol), NVG_MAX_CAP_DIVS);
+		ctx->capWidth = w;
+		ctx->capTol = ctx->joinTol;
+	}
+	ncap = ctx->capDivs;
+	trig = nvg__capTable(ctx, ncap);
+	if (trig == NULL) return 0;
 
 	w += aa * 0.5f;
 
@@ -1818,7 +2763,7 @@ static int nvg__expandStroke(NVGcontext* ctx, float w, float fringe, int lineCap
 			else if (lineCap == NVG_BUTT || lineCap == NVG_SQUARE)
 				dst = nvg__buttCapStart(dst, p0, dx, dy, w, w-aa, aa, u0, u1);
 			else if (lineCap == NVG_ROUND)
-				dst = nvg__roundCapStart(dst, p0, dx, dy, w, ncap, aa, u0, u1);
+				dst = nvg__roundCapStart(dst, p0, dx, dy, w, trig, ncap, aa, u0, u1);
 		}
 
 		for (j = s; j < e; ++j) {
@@ -1849,7 +2794,7 @@ static int nvg__expandStroke(NVGcontext* ctx, float w, float fringe, int lineCap
 			else if (lineCap == NVG_BUTT || lineCap == NVG_SQUARE)
 				dst = nvg__buttCapEnd(dst, p1, dx, dy, w, w-aa, aa, u0, u1);
 			else if (lineCap == NVG_ROUND)
-				dst = nvg__roundCapEnd(dst, p1, dx, dy, w, ncap, aa, u0, u1);
+				dst = nvg__roundCapEnd(dst, p1, dx, dy, w, trig, ncap, aa, u0, u1);
 		}
 
 		path->nstroke = (int)(dst - verts);
@@ -2090,6 +3035,7 @@ void nvgArc(NVGcontext* ctx, float cx, float cy, float r, float a0, float a1, in
 	float a = 0, da = 0, hda = 0, kappa = 0;
 	float dx = 0, dy = 0, x = 0, y = 0, tanx = 0, tany = 0;
 	float px = 0, py = 0, ptanx = 0, ptany = 0;
+	float chda, shda, cda, sda;
 	float vals[3 + 5*7 + 100];
 	int i, ndivs, nvals;
 	int move = ctx->ncommands > 0 ? NVG_LINETO : NVG_MOVETO;
@@ -2113,16 +3059,26 @@ void nvgArc(NVGcontext* ctx, float cx, float cy, float r, float a0, float a1, in
 	// Split arc into max 90 degree segments.
 	ndivs = nvg__maxi(1, nvg__mini((int)(nvg__absf(da) / (NVG_PI*0.5f) + 0.5f), 5));
 	hda = (da / (float)ndivs) / 2.0f;
-	kappa = nvg__absf(4.0f / 3.0f * (1.0f - nvg__cosf(hda)) / nvg__sinf(hda));
+	chda = nvg__cosf(hda);
+	shda = nvg__sinf(hda);
+	kappa = nvg__absf(4.0f / 3.0f * (1.0f - chda) / shda);
 
 	if (dir == NVG_CCW)
 		kappa = -kappa;
 
+	// Step the direction by rotation, using double angle of the half step.
+	cda = chda*chda - shda*shda;
+	sda = 2.0f*chda*shda;
+	dx = nvg__cosf(a0);
+	dy = nvg__sinf(a0);
+
 	nvals = 0;
 	for (i = 0; i <= ndivs; i++) {
-		a = a0 + da * (i/(float)ndivs);
-		dx = nvg__cosf(a);
-		dy = nvg__sinf(a);
+		if (i > 0) {
+			a = dx*cda - dy*sda;
+			dy = dy*cda + dx*sda;
+			dx = a;
+		}
 		x = cx + dx*r;
 		y = cy + dy*r;
 		tanx = -dy*r*kappa;
@@ -2243,7 +3199,7 @@ void nvgFill(NVGcontext* ctx)
 	int i;
 
 	nvg__flattenPaths(ctx);
-	if (ctx->params.edgeAntiAlias && state->shapeAntiAlias)
+	if (ctx->params.edgeAntiAlias && state->shapeAntiAlias && !nvg__qualityReduced(ctx, NVG_QUALITY_ANTIALIAS, 3))
 		nvg__expandFill(ctx, ctx->fringeWidth, NVG_MITER, 2.4f);
 	else
 		nvg__expandFill(ctx, 0.0f, NVG_MITER, 2.4f);
@@ -2262,6 +3218,8 @@ void nvgFill(NVGcontext* ctx)
 		ctx->fillTriCount += path->nstroke-2;
 		ctx->drawCallCount += 2;
 	}
+
+	nvg__trackPathMemory(ctx);
 }
 
 void nvgStroke(NVGcontext* ctx)
@@ -2289,7 +3247,7 @@ void nvgStroke(NVGcontext* ctx)
 
 	nvg__flattenPaths(ctx);
 
-	if (ctx->params.edgeAntiAlias && state->shapeAntiAlias)
+	if (ctx->params.edgeAntiAlias && state->shapeAntiAlias && !nvg__qualityReduced(ctx, NVG_QUALITY_ANTIALIAS, 3))
 		nvg__expandStroke(ctx, strokeWidth*0.5f, ctx->fringeWidth, state->lineCap, state->lineJoin, state->miterLimit);
 	else
 		nvg__expandStroke(ctx, strokeWidth*0.5f, 0.0f, state->lineCap, state->lineJoin, state->miterLimit);
@@ -2303,6 +3261,8 @@ void nvgStroke(NVGcontext* ctx)
 		ctx->strokeTriCount += path->nstroke-2;
 		ctx->drawCallCount++;
 	}
+
+	nvg__trackPathMemory(ctx);
 }
 
 // Add fonts
@@ -2332,6 +3292,11 @@ int nvgFindFont(NVGcontext* ctx, const char* name)
 	return fonsGetFontByName(ctx->fs, name);
 }
 
+void nvgFontMemory(NVGcontext* ctx, size_t* mapped, size_t* resident, size_t* heap)
+{
+	fonsFontMemory(ctx->fs, mapped, resident, heap);
+}
+
 
 int nvgAddFallbackFontId(NVGcontext* ctx, int baseFont, int fallbackFont)
 {
@@ -2354,46 +3319,157 @@ void nvgResetFallbackFonts(NVGcontext* ctx, const char* baseFont)
 	nvgResetFallbackFontsId(ctx, nvgFindFont(ctx, baseFont));
 }
 
+int nvgFontSDFId(NVGcontext* ctx, int font, int enabled)
+{
+	if (font == -1) return 0;
+	if (enabled && ctx->params.renderSDFTriangles == NULL) return 0;
+	if (!fonsSetFontSDF(ctx->fs, font, enabled)) return 0;
+	// Cached text runs of the font refer to the other kind of glyphs.
+	ctx->atlasGeneration++;
+	return 1;
+}
+
+int nvgFontSDF(NVGcontext* ctx, const char* name, int enabled)
+{
+	return nvgFontSDFId(ctx, nvgFindFont(ctx, name), enabled);
+}
+
+int nvgTextSubpixel(NVGcontext* ctx, int phases)
+{
+	phases = fonsSetSubpixel(ctx->fs, phases);
+	// Cached text was laid out with the other advances.
+	ctx->atlasGeneration++;
+	return phases;
+}
+
+int nvgTextSubpixelUsage(NVGcontext* ctx, int* glyphs, int* area, int maxPhases)
+{
+	return fonsSubpixelUsage(ctx->fs, glyphs, area, maxPhases);
+}
+
+void nvgTextSizeBuckets(NVGcontext* ctx, int perOctave)
+{
+	if (fonsGetSizeBuckets(ctx->fs) == perOctave) return;
+	fonsSetSizeBuckets(ctx->fs, perOctave);
+	// Cached text was laid out with glyphs of the other sizes.
+	ctx->atlasGeneration++;
+}
+
+int nvgTextRasterizer(NVGcontext* ctx, int rasterizer)
+{
+	return fonsSetRasterizer(ctx->fs, rasterizer == NVG_RASTER_COVERAGE ? FONS_RASTER_COVERAGE : FONS_RASTER_SCANLINE) ==
+		FONS_RASTER_COVERAGE ? NVG_RASTER_COVERAGE : NVG_RASTER_SCANLINE;
+}
+
+int nvgTextWorkers(NVGcontext* ctx, int nworkers)
+{
+	return fonsSetWorkers(ctx->fs, nworkers);
+}
+
+void nvgTextAsync(NVGcontext* ctx, int enabled)
+{
+	fonsSetAsync(ctx->fs, enabled);
+}
+
+int nvgTextPrewarm(NVGcontext* ctx, int font, const float* sizes, int nsizes, const unsigned int* ranges, int nranges)
+{
+	int i, n, count = 0, total = 0;
+	if (font == -1) return 0;
+
+	for (i = 0; i < nranges; i++)
+		total += (int)(ranges[i*2+1] - ranges[i*2]) + 1;
+
+	fonsSetBlur(ctx->fs, 0.0f);
+	fonsSetFont(ctx->fs, font);
+	for (i = 0; i < nsizes; i++) {
+		fonsSetSize(ctx->fs, sizes[i] * ctx->devicePxRatio);
+		n = fonsPrewarm(ctx->fs, ranges, nranges);
+		count += n;
+		if (n < total) break; // atlas full
+	}
+	return count;
+}
+
+int nvgTextPendingGlyphs(NVGcontext* ctx)
+{
+	return fonsPendingGlyphs(ctx->fs);
+}
+
+int nvgSaveFontCache(NVGcontext* ctx, const char* path)
+{
+	return fonsSaveCache(ctx->fs, path);
+}
+
+int nvgLoadFontCache(NVGcontext* ctx, const char* path)
+{
+	int w, h, iw, ih, image, count;
+	int fontImage = ctx->fontImages[ctx->fontImageIdx];
+
+	nvgImageSize(ctx, fontImage, &iw, &ih);
+	count = fonsLoadCache(ctx->fs, path);
+	if (count == -1) return -1;
+
+	// The saved atlas may have grown past the current texture.
+	fonsGetAtlasSize(ctx->fs, &w, &h);
+	if (w != iw || h != ih) {
+		image = ctx->params.renderCreateTexture(ctx->params.userPtr, NVG_TEXTURE_ALPHA, w, h, 0, NULL);
+		if (image == 0) {
+			fonsResetAtlas(ctx->fs, iw, ih);
+			return -1;
+		}
+		nvgDeleteImage(ctx, fontImage);
+		ctx->fontImages[ctx->fontImageIdx] = image;
+	}
+	return count;
+}
+
 // State setting
 void nvgFontSize(NVGcontext* ctx, float size)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_FONT);
+	if (state == NULL) return;
 	state->fontSize = size;
 }
 
 void nvgFontBlur(NVGcontext* ctx, float blur)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_FONT);
+	if (state == NULL) return;
 	state->fontBlur = blur;
 }
 
 void nvgTextLetterSpacing(NVGcontext* ctx, float spacing)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_FONT);
+	if (state == NULL) return;
 	state->letterSpacing = spacing;
 }
 
 void nvgTextLineHeight(NVGcontext* ctx, float lineHeight)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_FONT);
+	if (state == NULL) return;
 	state->lineHeight = lineHeight;
 }
 
 void nvgTextAlign(NVGcontext* ctx, int align)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_FONT);
+	if (state == NULL) return;
 	state->textAlign = align;
 }
 
 void nvgFontFaceId(NVGcontext* ctx, int font)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_FONT);
+	if (state == NULL) return;
 	state->fontId = font;
 }
 
 void nvgFontFace(NVGcontext* ctx, const char* font)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__modifyState(ctx, NVG_STATE_FONT);
+	if (state == NULL) return;
 	state->fontId = fonsGetFontByName(ctx->fs, font);
 }
 
@@ -2409,19 +3485,23 @@ static float nvg__getFontScale(NVGstate* state)
 
 static void nvg__flushTextTexture(NVGcontext* ctx)
 {
-	int dirty[4];
+	int i, n, dirty[4*8];
+	int fontImage = ctx->fontImages[ctx->fontImageIdx];
+	const unsigned char* data;
+	int iw, ih;
 
-	if (fonsValidateTexture(ctx->fs, dirty)) {
-		int fontImage = ctx->fontImages[ctx->fontImageIdx];
+	data = fonsGetTextureData(ctx->fs, &iw, &ih);
+	while ((n = fonsGetDirtyRects(ctx->fs, dirty, 8)) > 0) {
 		// Update texture
-		if (fontImage != 0) {
-			int iw, ih;
-			const unsigned char* data = fonsGetTextureData(ctx->fs, &iw, &ih);
-			int x = dirty[0];
-			int y = dirty[1];
-			int w = dirty[2] - dirty[0];
-			int h = dirty[3] - dirty[1];
+		if (fontImage == 0) continue;
+		for (i = 0; i < n; i++) {
+			int x = dirty[i*4+0];
+			int y = dirty[i*4+1];
+			int w = dirty[i*4+2] - dirty[i*4+0];
+			int h = dirty[i*4+3] - dirty[i*4+1];
 			ctx->params.renderUpdateTexture(ctx->params.userPtr, fontImage, x,y, w,h, data);
+			ctx->textUploadCount++;
+			ctx->textUploadBytes += w*h;
 		}
 	}
 }
@@ -2450,10 +3530,19 @@ static int nvg__allocTextAtlas(NVGcontext* ctx)
 	return 1;
 }
 
-static void nvg__renderText(NVGcontext* ctx, NVGvertex* verts, int nverts)
+// Returns the half width of the distance field edge for text of given pixel size and blur, or 0 for bitmap fonts.
+static float nvg__textSDFWidth(NVGcontext* ctx, int font, float size, float blur)
+{
+	// The field changes by 128/255 over FONS_SDF_PAD pixels of the reference size.
+	float d;
+	if (!fonsGetFontSDF(ctx->fs, font)) return 0.0f;
+	d = 128.0f / 255.0f / FONS_SDF_PAD * FONS_SDF_SIZE / nvg__maxf(size, 1.0f);
+	return nvg__minf(d * (0.5f + blur), 0.5f);
+}
+
+static void nvg__renderTextPaint(NVGcontext* ctx, NVGpaint paint, NVGvertex* verts, int nverts, float sdfWidth)
 {
 	NVGstate* state = nvg__getState(ctx);
-	NVGpaint paint = state->fill;
 
 	// Render triangles.
 	paint.image = ctx->fontImages[ctx->fontImageIdx];
@@ -2462,57 +3551,330 @@ static void nvg__renderText(NVGcontext* ctx, NVGvertex* verts, int nverts)
 	paint.innerColor.a *= state->alpha;
 	paint.outerColor.a *= state->alpha;
 
-	ctx->params.renderTriangles(ctx->params.userPtr, &paint, state->compositeOperation, &state->scissor, verts, nverts, ctx->fringeWidth);
+	if (sdfWidth > 0.0f)
+		ctx->params.renderSDFTriangles(ctx->params.userPtr, &paint, state->compositeOperation, &state->scissor, verts, nverts, ctx->fringeWidth, sdfWidth);
+	else
+		ctx->params.renderTriangles(ctx->params.userPtr, &paint, state->compositeOperation, &state->scissor, verts, nverts, ctx->fringeWidth);
 
 	ctx->drawCallCount++;
 	ctx->textTriCount += nverts/3;
 }
 
+static void nvg__renderText(NVGcontext* ctx, NVGvertex* verts, int nverts, float sdfWidth)
+{
+	nvg__renderTextPaint(ctx, nvg__getState(ctx)->fill, verts, nverts, sdfWidth);
+}
+
 static int nvg__isTransformFlipped(const float *xform)
 {
 	float det = xform[0] * xform[3] - xform[2] * xform[1];
 	return( det < 0);
 }
 
+static int nvg__textGeneration(NVGcontext* ctx)
+{
+	return ctx->atlasGeneration + fonsAtlasGeneration(ctx->fs);
+}
+
+// Cached quads stay valid until the atlas is reset or one of the pages they use is evicted.
+static int nvg__textQuadsValid(NVGcontext* ctx, int generation, unsigned int pageMask, int evictions)
+{
+	return generation == nvg__textGeneration(ctx) && evictions == fonsPageEvictions(ctx->fs, pageMask);
+}
+
+// Changes whenever glyphs are removed from the atlas, by a reset or by evicting a page.
+static int nvg__textEpoch(NVGcontext* ctx)
+{
+	return nvg__textGeneration(ctx) + fonsAtlasEvictions(ctx->fs);
+}
+
+// Records the atlas state of quads laid out since the given epoch. If glyphs were removed meanwhile
+// the quads placed before may be stale, and the generation is set to -1.
+static void nvg__stampTextQuads(NVGcontext* ctx, int* generation, int* pageEvictions, unsigned int pageMask, int epoch)
+{
+	*generation = epoch == nvg__textEpoch(ctx) ? nvg__textGeneration(ctx) : -1;
+	*pageEvictions = fonsPageEvictions(ctx->fs, pageMask);
+}
+
+// With subpixel glyph phases fontstash starts strings at the nearest phase, runs are reused at the same phase.
+static float nvg__snapTextPhase(NVGcontext* ctx, float x, int* phase)
+{
+	int n = fonsGetSubpixel(ctx->fs);
+	float sx = n > 1 ? floorf(x * n + 0.5f) / n : x;
+	if (phase != NULL) *phase = n > 1 ? (int)((sx - floorf(sx)) * n + 0.5f) : 0;
+	return sx;
+}
+
+static unsigned int nvg__hashText(const char* string, int len)
+{
+	unsigned int h = 2166136261u;
+	int i;
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char)string[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static void nvg__touchTextRun(NVGtextCache* tc, int idx)
+{
+	NVGtextRun* run = &tc->runs[idx];
+	if (tc->lruHead == idx) return;
+	// Unlink
+	tc->runs[run->lruPrev].lruNext = run->lruNext;
+	if (run->lruNext != -1)
+		tc->runs[run->lruNext].lruPrev = run->lruPrev;
+	else
+		tc->lruTail = run->lruPrev;
+	// Move to front
+	run->lruPrev = -1;
+	run->lruNext = tc->lruHead;
+	tc->runs[tc->lruHead].lruPrev = idx;
+	tc->lruHead = idx;
+}
+
+// Culling bounds of each quad: the largest right edge up to it and the smallest left edge from it on.
+static float* nvg__textRunBounds(NVGtextRun* run)
+{
+	return (float*)(run->data + run->nquads*sizeof(FONSquad));
+}
+
+static const char* nvg__textRunString(NVGtextRun* run)
+{
+	return (const char*)(run->data + run->nquads*(sizeof(FONSquad) + 2*sizeof(float)));
+}
+
+static NVGtextRun* nvg__findTextRun(NVGtextCache* tc, unsigned int hash, const char* string, int len,
+									int fontId, float size, float spacing, float blur, int align, int flipped)
+{
+	int idx = tc->buckets[hash & (NVG_TEXT_CACHE_HASH-1)];
+	while (idx != -1) {
+		NVGtextRun* run = &tc->runs[idx];
+		if (run->hash == hash && run->len == len && run->fontId == fontId && run->size == size &&
+			run->spacing == spacing && run->blur == blur && run->align == align && run->flipped == flipped &&
+			memcmp(nvg__textRunString(run), string, len) == 0) {
+			nvg__touchTextRun(tc, idx);
+			return run;
+		}
+		idx = run->next;
+	}
+	return NULL;
+}
+
+static void nvg__removeTextRun(NVGtextCache* tc, int idx)
+{
+	NVGtextRun* run = &tc->runs[idx];
+	int* link = &tc->buckets[run->hash & (NVG_TEXT_CACHE_HASH-1)];
+	while (*link != idx)
+		link = &tc->runs[*link].next;
+	*link = run->next;
+	run->next = -1;
+	run->len = -1;
+	// Unused runs are recycled first.
+	if (tc->lruTail == idx) return;
+	if (run->lruPrev != -1)
+		tc->runs[run->lruPrev].lruNext = run->lruNext;
+	else
+		tc->lruHead = run->lruNext;
+	tc->runs[run->lruNext].lruPrev = run->lruPrev;
+	run->lruPrev = tc->lruTail;
+	run->lruNext = -1;
+	tc->runs[tc->lruTail].lruNext = idx;
+	tc->lruTail = idx;
+}
+
+// Evicts the least recently used run and returns it with space for nquads and the string.
+static NVGtextRun* nvg__allocTextRun(NVGtextCache* tc, unsigned int hash, int len, int nquads)
+{
+	int idx = tc->lruTail;
+	NVGtextRun* run = &tc->runs[idx];
+	int size = nquads*(int)(sizeof(FONSquad) + 2*sizeof(float)) + len;
+
+	if (run->len != -1)
+		nvg__removeTextRun(tc, idx);
+	if (size > run->cdata) {
+		unsigned char* data = (unsigned char*)realloc(run->data, size);
+		if (data == NULL) return NULL;
+		run->data = data;
+		run->cdata = size;
+	}
+
+	run->hash = hash;
+	run->len = len;
+	run->nquads = nquads;
+	run->next = tc->buckets[hash & (NVG_TEXT_CACHE_HASH-1)];
+	tc->buckets[hash & (NVG_TEXT_CACHE_HASH-1)] = idx;
+	nvg__touchTextRun(tc, idx);
+	return run;
+}
+
+// Returns the number of leading culling bounds of a text run which are less than value, or equal if inclusive.
+static int nvg__countBounds(const float* bounds, int n, float value, int inclusive)
+{
+	int lo = 0, hi = n;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (bounds[mid*2] < value || (inclusive && bounds[mid*2] == value))
+			lo = mid+1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static float nvg__renderTextRun(NVGcontext* ctx, NVGtextRun* run, float x, float y, float scale)
+{
+	NVGstate* state = nvg__getState(ctx);
+	const FONSquad* quads = (const FONSquad*)run->data;
+	const float* bounds = nvg__textRunBounds(run);
+	float invscale = 1.0f / scale;
+	float ox = nvg__snapTextPhase(ctx, x*scale + run->alignx, NULL);
+	float oy = y*scale + run->aligny;
+	float fx = floorf(ox), fy = floorf(oy);
+	float vis[4];
+	NVGvertex* verts;
+	int i, first = 0, last = run->nquads, nverts = 0;
+
+	// Glyphs outside the scissor and the viewport are skipped, the bounds find the visible ones.
+	nvg__visibleBounds(ctx, vis);
+	if (fy + run->maxy < vis[1]*scale || fy + run->miny > vis[3]*scale) {
+		last = 0;
+	} else {
+		first = nvg__countBounds(bounds, run->nquads, vis[0]*scale - fx, 0);
+		last = nvg__countBounds(bounds+1, run->nquads, vis[2]*scale - fx, 1);
+	}
+	ctx->textGlyphCount += run->nquads;
+	ctx->textCulledCount += run->nquads - nvg__maxi(0, last - first);
+	if (first >= last)
+		return (ox + run->advance) / scale;
+
+	verts = nvg__allocTempVerts(ctx, (last - first) * 6);
+	if (verts == NULL) return x;
+
+	// Keep the glyphs from being evicted while they are drawn this frame.
+	fonsTouchPages(ctx->fs, run->pageMask);
+
+	for (i = first; i < last; i++) {
+		const FONSquad* q = &quads[i];
+		float x0 = (fx + q->x0) * invscale, y0 = (fy + q->y0) * invscale;
+		float x1 = (fx + q->x1) * invscale, y1 = (fy + q->y1) * invscale;
+		float c[4*2];
+		nvgTransformPoint(&c[0],&c[1], state->xform, x0, y0);
+		nvgTransformPoint(&c[2],&c[3], state->xform, x1, y0);
+		nvgTransformPoint(&c[4],&c[5], state->xform, x1, y1);
+		nvgTransformPoint(&c[6],&c[7], state->xform, x0, y1);
+		nvg__vset(&verts[nverts], c[0], c[1], q->s0, q->t0); nverts++;
+		nvg__vset(&verts[nverts], c[4], c[5], q->s1, q->t1); nverts++;
+		nvg__vset(&verts[nverts], c[2], c[3], q->s1, q->t0); nverts++;
+		nvg__vset(&verts[nverts], c[0], c[1], q->s0, q->t0); nverts++;
+		nvg__vset(&verts[nverts], c[6], c[7], q->s0, q->t1); nverts++;
+		nvg__vset(&verts[nverts], c[4], c[5], q->s1, q->t1); nverts++;
+	}
+
+	nvg__renderText(ctx, verts, nverts, nvg__textSDFWidth(ctx, run->fontId, run->size, run->blur));
+
+	return (ox + run->advance) / scale;
+}
+
+// Returns non-zero if the quad overlaps the visible bounds, blur and tall glyphs may reach past the line.
+static int nvg__quadVisible(const FONSquad* q, const float* vis)
+{
+	return nvg__maxf(q->x0, q->x1) >= vis[0] && nvg__minf(q->x0, q->x1) <= vis[2] &&
+		nvg__maxf(q->y0, q->y1) >= vis[1] && nvg__minf(q->y0, q->y1) <= vis[3];
+}
+
 float nvgText(NVGcontext* ctx, float x, float y, const char* string, const char* end)
 {
 	NVGstate* state = nvg__getState(ctx);
 	FONStextIter iter, prevIter;
 	FONSquad q;
 	NVGvertex* verts;
+	NVGtextRun* run;
 	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
 	float invscale = 1.0f / scale;
+	float blur = nvg__qualityReduced(ctx, NVG_QUALITY_TEXT_BLUR, 2) ? 0.0f : state->fontBlur*scale;
+	float sdfWidth;
+	float startx, starty, originx, originy;
+	float vis[4];
+	unsigned int hash = 0;
 	int cverts = 0;
 	int nverts = 0;
+	int nquads = 0;
 	int isFlipped = nvg__isTransformFlipped(state->xform);
+	int epoch = nvg__textEpoch(ctx);
+	int cacheable, len;
 
 	if (end == NULL)
 		end = string + strlen(string);
+	len = (int)(end - string);
 
 	if (state->fontId == FONS_INVALID) return x;
 
+	// Static labels are drawn with the same string and style every frame, reuse their quads.
+	sdfWidth = nvg__textSDFWidth(ctx, state->fontId, state->fontSize*scale, blur);
+	cacheable = len <= NVG_TEXT_CACHE_MAX_LEN;
+	if (cacheable) {
+		hash = nvg__hashText(string, len);
+		run = nvg__findTextRun(ctx->textCache, hash, string, len, state->fontId, state->fontSize*scale,
+							   state->letterSpacing*scale, blur, state->textAlign, isFlipped);
+		if (run != NULL) {
+			int phase;
+			float sx = nvg__snapTextPhase(ctx, x*scale + run->alignx, &phase), sy = y*scale + run->aligny;
+			int samePos = run->phase == phase &&
+				(!run->scaled || (sx - floorf(sx) == run->fracx && sy - floorf(sy) == run->fracy));
+			if (nvg__textQuadsValid(ctx, run->generation, run->pageMask, run->evictions) && samePos)
+				return nvg__renderTextRun(ctx, run, x, y, scale);
+			// Glyphs of the run have been evicted since it was cached, or it starts at another subpixel phase,
+			// or at another fraction of a pixel for scaled quads.
+			nvg__removeTextRun(ctx->textCache, (int)(run - ctx->textCache->runs));
+		}
+	}
+
 	fonsSetSize(ctx->fs, state->fontSize*scale);
 	fonsSetSpacing(ctx->fs, state->letterSpacing*scale);
-	fonsSetBlur(ctx->fs, state->fontBlur*scale);
+	fonsSetBlur(ctx->fs, blur);
 	fonsSetAlign(ctx->fs, state->textAlign);
 	fonsSetFont(ctx->fs, state->fontId);
 
-	cverts = nvg__maxi(2, (int)(end - string)) * 6; // conservative estimate.
+	cverts = nvg__maxi(2, len) * 6; // conservative estimate.
 	verts = nvg__allocTempVerts(ctx, cverts);
 	if (verts == NULL) return x;
 
+	// Glyphs outside the scissor and the viewport are not drawn. Cached runs are laid out completely,
+	// other strings are only measured outside the visible area, without rasterizing the glyphs.
+	nvg__visibleBounds(ctx, vis);
+	vis[0] *= scale; vis[1] *= scale; vis[2] *= scale; vis[3] *= scale;
+
 	fonsTextIterInit(ctx->fs, &iter, x*scale, y*scale, string, end, FONS_GLYPH_BITMAP_REQUIRED);
+	// Glyph advances are whole pixels, or the start is snapped to a subpixel phase, so the quads of glyphs drawn
+	// at their size relative to the floored start only depend on that phase. Quads scaled from SDF or bucketed
+	// glyphs are rounded from the exact pen position, and also depend on the fractions of the start.
+	startx = iter.x;
+	starty = iter.y;
+	originx = floorf(startx);
+	originy = floorf(starty);
 	prevIter = iter;
-	while (fonsTextIterNext(ctx->fs, &iter, &q)) {
+	for (;;) {
 		float c[4*2];
+		if (!cacheable)
+			iter.bitmapOption = FONS_GLYPH_BITMAP_OPTIONAL;
+		if (!fonsTextIterNext(ctx->fs, &iter, &q))
+			break;
+		if (!cacheable && !iter.bitmap && iter.prevGlyphIndex != -1 && nvg__quadVisible(&q, vis)) {
+			// The quad of the glyph is visible, step again and rasterize it.
+			iter = prevIter;
+			iter.bitmapOption = FONS_GLYPH_BITMAP_REQUIRED;
+			fonsTextIterNext(ctx->fs, &iter, &q);
+		}
 		if (iter.prevGlyphIndex == -1) { // can not retrieve glyph?
 			if (nverts != 0) {
-				nvg__renderText(ctx, verts, nverts);
+				nvg__renderText(ctx, verts, nverts, sdfWidth);
 				nverts = 0;
 			}
 			if (!nvg__allocTextAtlas(ctx))
 				break; // no memory :(
 			iter = prevIter;
+			iter.bitmapOption = FONS_GLYPH_BITMAP_REQUIRED;
 			fonsTextIterNext(ctx->fs, &iter, &q); // try again
 			if (iter.prevGlyphIndex == -1) // still can not find glyph?
 				break;
@@ -2524,6 +3886,17 @@ float nvgText(NVGcontext* ctx, float x, float y, const char* string, const char*
 			tmp = q.y0; q.y0 = q.y1; q.y1 = tmp;
 			tmp = q.t0; q.t0 = q.t1; q.t1 = tmp;
 		}
+		if (cacheable) {
+			FONSquad* rq = &ctx->textCache->quads[nquads++];
+			*rq = q;
+			rq->x0 -= originx; rq->x1 -= originx;
+			rq->y0 -= originy; rq->y1 -= originy;
+		}
+		ctx->textGlyphCount++;
+		if (!nvg__quadVisible(&q, vis)) {
+			ctx->textCulledCount++;
+			continue;
+		}
 		// Transform corners.
 		nvgTransformPoint(&c[0],&c[1], state->xform, q.x0*invscale, q.y0*invscale);
 		nvgTransformPoint(&c[2],&c[3], state->xform, q.x1*invscale, q.y0*invscale);
@@ -2540,10 +3913,49 @@ float nvgText(NVGcontext* ctx, float x, float y, const char* string, const char*
 		}
 	}
 
-	// TODO: add back-end bit to do this just once per frame.
-	nvg__flushTextTexture(ctx);
-
-	nvg__renderText(ctx, verts, nverts);
+	// The atlas is uploaded once in nvgEndFrame, or before it is reset for a new texture.
+	if (nverts > 0)
+		nvg__renderText(ctx, verts, nverts, sdfWidth);
+
+	// Cache the run if the whole string was laid out into the same atlas, without evicting pages meanwhile.
+	if (cacheable && iter.next == end && epoch == nvg__textEpoch(ctx)) {
+		run = nvg__allocTextRun(ctx->textCache, hash, len, nquads);
+		if (run != NULL) {
+			const FONSquad* quads = ctx->textCache->quads;
+			float* bounds = nvg__textRunBounds(run);
+			float sx, sy;
+			int i;
+			run->fontId = state->fontId;
+			run->size = state->fontSize*scale;
+			run->spacing = state->letterSpacing*scale;
+			run->blur = blur;
+			run->align = state->textAlign;
+			run->flipped = isFlipped;
+			run->generation = nvg__textGeneration(ctx);
+			run->pageMask = iter.pageMask;
+			run->evictions = fonsPageEvictions(ctx->fs, iter.pageMask);
+			nvg__snapTextPhase(ctx, startx, &run->phase);
+			run->alignx = startx - x*scale;
+			run->aligny = starty - y*scale;
+			// The fractions are computed like when the run is looked up.
+			run->scaled = iter.scaled;
+			sx = nvg__snapTextPhase(ctx, x*scale + run->alignx, NULL);
+			sy = y*scale + run->aligny;
+			run->fracx = sx - floorf(sx);
+			run->fracy = sy - floorf(sy);
+			run->advance = iter.nextx - startx;
+			run->miny = run->maxy = 0.0f;
+			for (i = 0; i < nquads; i++) {
+				run->miny = nvg__minf(run->miny, nvg__minf(quads[i].y0, quads[i].y1));
+				run->maxy = nvg__maxf(run->maxy, nvg__maxf(quads[i].y0, quads[i].y1));
+				bounds[i*2] = i > 0 ? nvg__maxf(bounds[i*2-2], quads[i].x1) : quads[i].x1;
+			}
+			for (i = nquads-1; i >= 0; i--)
+				bounds[i*2+1] = i < nquads-1 ? nvg__minf(bounds[i*2+3], quads[i].x0) : quads[i].x0;
+			memcpy(run->data, quads, sizeof(FONSquad)*nquads);
+			memcpy((char*)nvg__textRunString(run), string, len);
+		}
+	}
 
 	return iter.nextx / scale;
 }
@@ -2631,10 +4043,11 @@ enum NVGcodepointType {
 	NVG_CJK_CHAR,
 };
 
-int nvgTextBreakLines(NVGcontext* ctx, const char* string, const char* end, float breakRowWidth, NVGtextRow* rows, int maxRows)
+// Breaks the text into rows, measuring the glyphs at the given scale.
+static int nvg__textBreakLines(NVGcontext* ctx, const char* string, const char* end, float breakRowWidth,
+							   NVGtextRow* rows, int maxRows, float scale)
 {
 	NVGstate* state = nvg__getState(ctx);
-	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
 	float invscale = 1.0f / scale;
 	FONStextIter iter, prevIter;
 	FONSquad q;
@@ -2819,120 +4232,1484 @@ int nvgTextBreakLines(NVGcontext* ctx, const char* string, const char* end, floa
 			}
 		}
 
-		pcodepoint = iter.codepoint;
-		ptype = type;
+		pcodepoint = iter.codepoint;
+		ptype = type;
+	}
+
+	// Break the line from the end of the last word, and start new line from the beginning of the new.
+	if (rowStart != NULL) {
+		rows[nrows].start = rowStart;
+		rows[nrows].end = rowEnd;
+		rows[nrows].width = rowWidth * invscale;
+		rows[nrows].minx = rowMinX * invscale;
+		rows[nrows].maxx = rowMaxX * invscale;
+		rows[nrows].next = end;
+		nrows++;
+	}
+
+	return nrows;
+}
+
+int nvgTextBreakLines(NVGcontext* ctx, const char* string, const char* end, float breakRowWidth, NVGtextRow* rows, int maxRows)
+{
+	NVGstate* state = nvg__getState(ctx);
+	return nvg__textBreakLines(ctx, string, end, breakRowWidth, rows, maxRows, nvg__getFontScale(state) * ctx->devicePxRatio);
+}
+
+float nvgTextBounds(NVGcontext* ctx, float x, float y, const char* string, const char* end, float* bounds)
+{
+	NVGstate* state = nvg__getState(ctx);
+	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
+	float invscale = 1.0f / scale;
+	float width;
+
+	if (state->fontId == FONS_INVALID) return 0;
+
+	fonsSetSize(ctx->fs, state->fontSize*scale);
+	fonsSetSpacing(ctx->fs, state->letterSpacing*scale);
+	fonsSetBlur(ctx->fs, state->fontBlur*scale);
+	fonsSetAlign(ctx->fs, state->textAlign);
+	fonsSetFont(ctx->fs, state->fontId);
+
+	width = fonsTextBounds(ctx->fs, x*scale, y*scale, string, end, bounds);
+	if (bounds != NULL) {
+		// Use line bounds for height.
+		fonsLineBounds(ctx->fs, y*scale, &bounds[1], &bounds[3]);
+		bounds[0] *= invscale;
+		bounds[1] *= invscale;
+		bounds[2] *= invscale;
+		bounds[3] *= invscale;
+	}
+	return width * invscale;
+}
+
+void nvgTextBoxBounds(NVGcontext* ctx, float x, float y, float breakRowWidth, const char* string, const char* end, float* bounds)
+{
+	NVGstate* state = nvg__getState(ctx);
+	NVGtextRow rows[2];
+	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
+	float invscale = 1.0f / scale;
+	int nrows = 0, i;
+	int oldAlign = state->textAlign;
+	int halign = state->textAlign & (NVG_ALIGN_LEFT | NVG_ALIGN_CENTER | NVG_ALIGN_RIGHT);
+	int valign = state->textAlign & (NVG_ALIGN_TOP | NVG_ALIGN_MIDDLE | NVG_ALIGN_BOTTOM | NVG_ALIGN_BASELINE);
+	float lineh = 0, rminy = 0, rmaxy = 0;
+	float minx, miny, maxx, maxy;
+
+	if (state->fontId == FONS_INVALID) {
+		if (bounds != NULL)
+			bounds[0] = bounds[1] = bounds[2] = bounds[3] = 0.0f;
+		return;
+	}
+
+	nvgTextMetrics(ctx, NULL, NULL, &lineh);
+
+	state->textAlign = NVG_ALIGN_LEFT | valign;
+
+	minx = maxx = x;
+	miny = maxy = y;
+
+	fonsSetSize(ctx->fs, state->fontSize*scale);
+	fonsSetSpacing(ctx->fs, state->letterSpacing*scale);
+	fonsSetBlur(ctx->fs, state->fontBlur*scale);
+	fonsSetAlign(ctx->fs, state->textAlign);
+	fonsSetFont(ctx->fs, state->fontId);
+	fonsLineBounds(ctx->fs, 0, &rminy, &rmaxy);
+	rminy *= invscale;
+	rmaxy *= invscale;
+
+	while ((nrows = nvgTextBreakLines(ctx, string, end, breakRowWidth, rows, 2))) {
+		for (i = 0; i < nrows; i++) {
+			NVGtextRow* row = &rows[i];
+			float rminx, rmaxx, dx = 0;
+			// Horizontal bounds
+			if (halign & NVG_ALIGN_LEFT)
+				dx = 0;
+			else if (halign & NVG_ALIGN_CENTER)
+				dx = breakRowWidth*0.5f - row->width*0.5f;
+			else if (halign & NVG_ALIGN_RIGHT)
+				dx = breakRowWidth - row->width;
+			rminx = x + row->minx + dx;
+			rmaxx = x + row->maxx + dx;
+			minx = nvg__minf(minx, rminx);
+			maxx = nvg__maxf(maxx, rmaxx);
+			// Vertical bounds.
+			miny = nvg__minf(miny, y + rminy);
+			maxy = nvg__maxf(maxy, y + rmaxy);
+
+			y += lineh * state->lineHeight;
+		}
+		string = rows[nrows-1].next;
+	}
+
+	state->textAlign = oldAlign;
+
+	if (bounds != NULL) {
+		bounds[0] = minx;
+		bounds[1] = miny;
+		bounds[2] = maxx;
+		bounds[3] = maxy;
+	}
+}
+
+NVGparagraph* nvgCreateParagraph(void)
+{
+	NVGparagraph* para = (NVGparagraph*)malloc(sizeof(NVGparagraph));
+	if (para == NULL) goto error;
+	memset(para, 0, sizeof(NVGparagraph));
+
+	para->text = (char*)malloc(1);
+	if (para->text == NULL) goto error;
+	para->text[0] = '\0';
+	para->ctext = 1;
+	para->editStart = -1;
+	para->fontId = FONS_INVALID;
+
+	return para;
+
+error:
+	nvgDeleteParagraph(para);
+	return NULL;
+}
+
+void nvgDeleteParagraph(NVGparagraph* para)
+{
+	if (para == NULL) return;
+	free(para->text);
+	free(para->rows);
+	free(para->glyphs);
+	free(para);
+}
+
+int nvgParagraphSetText(NVGparagraph* para, const char* string, const char* end)
+{
+	int len, prefix = 0, suffix = 0;
+
+	if (end == NULL)
+		end = string + strlen(string);
+	len = (int)(end - string);
+
+	while (prefix < len && prefix < para->len && string[prefix] == para->text[prefix])
+		prefix++;
+	if (prefix == len && prefix == para->len)
+		return 1;
+	while (suffix < len - prefix && suffix < para->len - prefix && string[len-1-suffix] == para->text[para->len-1-suffix])
+		suffix++;
+
+	if (len+1 > para->ctext) {
+		int ctext = nvg__maxi(len+1, para->ctext*2);
+		char* text = (char*)realloc(para->text, ctext);
+		if (text == NULL) return 0;
+		para->text = text;
+		para->ctext = ctext;
+	}
+
+	if (para->editStart == -1) {
+		para->editStart = prefix;
+		para->editEnd = para->len - suffix;
+		para->editDelta = len - para->len;
+	} else {
+		// Several edits since the last layout, only the first changed byte is tracked.
+		para->editStart = nvg__mini(para->editStart, prefix);
+		para->editEnd = -1;
+	}
+
+	memcpy(para->text, string, len);
+	para->text[len] = '\0';
+	para->len = len;
+	return 1;
+}
+
+void nvgParagraphSetWidth(NVGparagraph* para, float breakRowWidth)
+{
+	para->width = breakRowWidth;
+}
+
+static int nvg__paragraphReserve(NVGparagraph* para, int nrows, int nglyphs)
+{
+	if (nrows > para->crows) {
+		int crows = nvg__maxi(nrows, para->crows*2);
+		NVGparagraphRow* rows = (NVGparagraphRow*)realloc(para->rows, sizeof(NVGparagraphRow)*crows);
+		if (rows == NULL) return 0;
+		para->rows = rows;
+		para->crows = crows;
+	}
+	if (nglyphs > para->cglyphs) {
+		int cglyphs = nvg__maxi(nglyphs, para->cglyphs*2);
+		NVGparagraphGlyph* glyphs = (NVGparagraphGlyph*)realloc(para->glyphs, sizeof(NVGparagraphGlyph)*cglyphs);
+		if (glyphs == NULL) return 0;
+		para->glyphs = glyphs;
+		para->cglyphs = cglyphs;
+	}
+	return 1;
+}
+
+// Returns the last row starting at or before the byte offset.
+static int nvg__paragraphFindRow(NVGparagraph* para, int offset)
+{
+	int lo = 0, hi = para->nrows-1;
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if (para->rows[mid].start <= offset)
+			lo = mid;
+		else
+			hi = mid-1;
+	}
+	return lo;
+}
+
+// Positions the glyphs of the rows starting from the given one, the glyphs of the earlier rows are kept.
+static void nvg__paragraphPlace(NVGcontext* ctx, NVGparagraph* para, int first, int last)
+{
+	FONStextIter iter, prevIter;
+	FONSquad q;
+	int i;
+
+	fonsSetSize(ctx->fs, para->size);
+	fonsSetSpacing(ctx->fs, para->spacing);
+	fonsSetBlur(ctx->fs, para->blur);
+	fonsSetAlign(ctx->fs, NVG_ALIGN_LEFT | para->valign);
+	fonsSetFont(ctx->fs, para->fontId);
+
+	para->nglyphs = first > 0 ? para->rows[first-1].glyph + para->rows[first-1].nglyphs : 0;
+	for (i = first; i < last; i++) {
+		NVGparagraphRow* row = &para->rows[i];
+		float originy;
+		row->glyph = para->nglyphs;
+		row->nglyphs = 0;
+		fonsTextIterInit(ctx->fs, &iter, 0, 0, para->text + row->start, para->text + row->end, FONS_GLYPH_BITMAP_REQUIRED);
+		originy = floorf(iter.y);
+		para->aligny = iter.y;
+		prevIter = iter;
+		memset(&q, 0, sizeof(q));
+		while (fonsTextIterNext(ctx->fs, &iter, &q)) {
+			NVGparagraphGlyph* g;
+			if (iter.prevGlyphIndex == -1 && nvg__allocTextAtlas(ctx)) { // can not retrieve glyph?
+				iter = prevIter;
+				fonsTextIterNext(ctx->fs, &iter, &q); // try again
+			}
+			prevIter = iter;
+			g = &para->glyphs[para->nglyphs++];
+			g->str = (int)(iter.str - para->text);
+			g->x = iter.x;
+			g->minx = nvg__minf(iter.x, q.x0);
+			g->maxx = nvg__maxf(iter.nextx, q.x1);
+			g->quad = q;
+			g->quad.y0 -= originy;
+			g->quad.y1 -= originy;
+			row->nglyphs++;
+			memset(&q, 0, sizeof(q));
+		}
+		para->pageMask |= iter.pageMask;
+	}
+}
+
+// Breaks the text into rows starting from the given row, the earlier rows are kept. The rows after
+// the pending edit are reused from the previous layout as soon as the new rows line up with them.
+static int nvg__paragraphBreak(NVGcontext* ctx, NVGparagraph* para, int first)
+{
+	NVGstate* state = nvg__getState(ctx);
+	NVGparagraphRow* tail = NULL;
+	NVGparagraphGlyph* tailGlyphs = NULL;
+	NVGtextRow row;
+	int ntail = 0, ntailGlyphs = 0, itail = 0, joined = 0, nrows, offset, i;
+	int oldAlign = state->textAlign;
+
+	if (para->editEnd >= 0 && first < para->nrows) {
+		// Keep the rows which start after the edit.
+		int k = first;
+		while (k < para->nrows && para->rows[k].start < para->editEnd)
+			k++;
+		ntail = para->nrows - k;
+		if (ntail > 0) {
+			ntailGlyphs = para->nglyphs - para->rows[k].glyph;
+			tail = (NVGparagraphRow*)malloc(sizeof(NVGparagraphRow)*ntail);
+			tailGlyphs = (NVGparagraphGlyph*)malloc(sizeof(NVGparagraphGlyph)*nvg__maxi(1, ntailGlyphs));
+			if (tail == NULL || tailGlyphs == NULL) {
+				ntail = 0;
+			} else {
+				memcpy(tail, &para->rows[k], sizeof(NVGparagraphRow)*ntail);
+				memcpy(tailGlyphs, &para->glyphs[para->rows[k].glyph], sizeof(NVGparagraphGlyph)*ntailGlyphs);
+			}
+		}
+	}
+
+	// Each row is broken on its own so that it only depends on the text from its start.
+	state->textAlign = NVG_ALIGN_LEFT | para->valign;
+	nrows = first;
+	offset = first > 0 ? para->rows[first-1].next : 0;
+	while (nvgTextBreakLines(ctx, para->text + offset, para->text + para->len, para->width, &row, 1)) {
+		NVGparagraphRow* r;
+		if (!nvg__paragraphReserve(para, nrows+1, 0)) break;
+		r = &para->rows[nrows++];
+		r->start = (int)(row.start - para->text);
+		r->end = (int)(row.end - para->text);
+		r->next = (int)(row.next - para->text);
+		r->width = row.width;
+		r->minx = row.minx;
+		r->maxx = row.maxx;
+		offset = r->next;
+		while (itail < ntail && tail[itail].start + para->editDelta < offset)
+			itail++;
+		if (itail < ntail && tail[itail].start + para->editDelta == offset) {
+			joined = 1;
+			break;
+		}
+	}
+	state->textAlign = oldAlign;
+
+	// There is at most one glyph per byte.
+	if (!nvg__paragraphReserve(para, nrows + (joined ? ntail - itail : 0), nvg__maxi(1, para->len))) {
+		free(tail);
+		free(tailGlyphs);
+		return 0;
+	}
+	nvg__paragraphPlace(ctx, para, first, nrows);
+
+	if (joined) {
+		int glyph0 = tail[itail].glyph;
+		int nglyphs = tail[ntail-1].glyph + tail[ntail-1].nglyphs - glyph0;
+		int base = tail[0].glyph;
+		for (i = itail; i < ntail; i++) {
+			NVGparagraphRow* r = &para->rows[nrows++];
+			*r = tail[i];
+			r->start += para->editDelta;
+			r->end += para->editDelta;
+			r->next += para->editDelta;
+			r->glyph += para->nglyphs - glyph0;
+		}
+		for (i = 0; i < nglyphs; i++) {
+			NVGparagraphGlyph* g = &para->glyphs[para->nglyphs++];
+			*g = tailGlyphs[glyph0 - base + i];
+			g->str += para->editDelta;
+		}
+	}
+	para->nrows = nrows;
+
+	free(tail);
+	free(tailGlyphs);
+	return 1;
+}
+
+// Lays out the paragraph again if the text, width or text style changed since the last layout.
+static int nvg__paragraphUpdate(NVGcontext* ctx, NVGparagraph* para)
+{
+	NVGstate* state = nvg__getState(ctx);
+	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
+	float blur = nvg__qualityReduced(ctx, NVG_QUALITY_TEXT_BLUR, 2) ? 0.0f : state->fontBlur*scale;
+	int valign = state->textAlign & (NVG_ALIGN_TOP | NVG_ALIGN_MIDDLE | NVG_ALIGN_BOTTOM | NVG_ALIGN_BASELINE);
+	int subpixel = fonsGetSubpixel(ctx->fs);
+	int sizeBuckets = fonsGetSizeBuckets(ctx->fs);
+	int epoch;
+
+	if (state->fontId == FONS_INVALID) return 0;
+
+	if (para->fontId != state->fontId || para->size != state->fontSize*scale || para->spacing != state->letterSpacing*scale ||
+		para->blur != blur || para->valign != valign || para->subpixel != subpixel || para->sizeBuckets != sizeBuckets ||
+		para->layoutWidth != para->width) {
+		para->fontId = state->fontId;
+		para->size = state->fontSize*scale;
+		para->spacing = state->letterSpacing*scale;
+		para->blur = blur;
+		para->valign = valign;
+		para->subpixel = subpixel;
+		para->sizeBuckets = sizeBuckets;
+		para->layoutWidth = para->width;
+		nvgTextMetrics(ctx, NULL, NULL, &para->lineh);
+		fonsSetAlign(ctx->fs, NVG_ALIGN_LEFT | valign);
+		fonsLineBounds(ctx->fs, 0, &para->rminy, &para->rmaxy);
+		para->rminy /= scale;
+		para->rmaxy /= scale;
+		para->nrows = 0;
+		para->nglyphs = 0;
+		para->editStart = 0;
+		para->editEnd = -1;
+		para->generation = -1;
+	}
+
+	if (para->editStart != -1) {
+		int first = 0;
+		if (para->nrows > 0) {
+			// The edit can pull words back to the row before the edited one.
+			first = nvg__maxi(0, nvg__paragraphFindRow(para, para->editStart) - 1);
+		}
+		epoch = nvg__textEpoch(ctx);
+		if (!nvg__textQuadsValid(ctx, para->generation, para->pageMask, para->evictions)) {
+			// The quads of the kept rows are stale.
+			first = 0;
+			para->editEnd = -1;
+		}
+		if (first == 0)
+			para->pageMask = 0;
+		para->editStart = -1;
+		if (!nvg__paragraphBreak(ctx, para, first)) {
+			para->fontId = FONS_INVALID;
+			para->nrows = para->nglyphs = 0;
+			return 0;
+		}
+		// The glyphs placed before a page was evicted are placed again below.
+		nvg__stampTextQuads(ctx, &para->generation, &para->evictions, para->pageMask, epoch);
+	}
+
+	if (!nvg__textQuadsValid(ctx, para->generation, para->pageMask, para->evictions)) {
+		epoch = nvg__textEpoch(ctx);
+		para->pageMask = 0;
+		nvg__paragraphPlace(ctx, para, 0, para->nrows);
+		nvg__stampTextQuads(ctx, &para->generation, &para->evictions, para->pageMask, epoch);
+	}
+
+	return 1;
+}
+
+static float nvg__paragraphRowX(NVGcontext* ctx, NVGparagraph* para, NVGparagraphRow* row, float x)
+{
+	NVGstate* state = nvg__getState(ctx);
+	int halign = state->textAlign & (NVG_ALIGN_LEFT | NVG_ALIGN_CENTER | NVG_ALIGN_RIGHT);
+	if (halign & NVG_ALIGN_CENTER)
+		return x + para->width*0.5f - row->width*0.5f;
+	else if (halign & NVG_ALIGN_RIGHT)
+		return x + para->width - row->width;
+	return x;
+}
+
+void nvgParagraph(NVGcontext* ctx, NVGparagraph* para, float x, float y)
+{
+	NVGstate* state = nvg__getState(ctx);
+	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
+	float invscale = 1.0f / scale;
+	int isFlipped = nvg__isTransformFlipped(state->xform);
+	NVGvertex* verts;
+	int i, j, nverts = 0;
+
+	if (!nvg__paragraphUpdate(ctx, para)) return;
+	if (para->nglyphs == 0) return;
+
+	verts = nvg__allocTempVerts(ctx, para->nglyphs * 6);
+	if (verts == NULL) return;
+
+	// Keep the glyphs from being evicted while they are drawn this frame.
+	fonsTouchPages(ctx->fs, para->pageMask);
+
+	for (i = 0; i < para->nrows; i++) {
+		NVGparagraphRow* row = &para->rows[i];
+		float fx = floorf(nvg__paragraphRowX(ctx, para, row, x) * scale);
+		float fy = floorf((y + i * para->lineh * state->lineHeight) * scale + para->aligny);
+		for (j = 0; j < row->nglyphs; j++) {
+			FONSquad q = para->glyphs[row->glyph + j].quad;
+			float x0, y0, x1, y1, c[4*2];
+			if (isFlipped) {
+				float tmp;
+				tmp = q.y0; q.y0 = q.y1; q.y1 = tmp;
+				tmp = q.t0; q.t0 = q.t1; q.t1 = tmp;
+			}
+			x0 = (fx + q.x0) * invscale; y0 = (fy + q.y0) * invscale;
+			x1 = (fx + q.x1) * invscale; y1 = (fy + q.y1) * invscale;
+			nvgTransformPoint(&c[0],&c[1], state->xform, x0, y0);
+			nvgTransformPoint(&c[2],&c[3], state->xform, x1, y0);
+			nvgTransformPoint(&c[4],&c[5], state->xform, x1, y1);
+			nvgTransformPoint(&c[6],&c[7], state->xform, x0, y1);
+			nvg__vset(&verts[nverts], c[0], c[1], q.s0, q.t0); nverts++;
+			nvg__vset(&verts[nverts], c[4], c[5], q.s1, q.t1); nverts++;
+			nvg__vset(&verts[nverts], c[2], c[3], q.s1, q.t0); nverts++;
+			nvg__vset(&verts[nverts], c[0], c[1], q.s0, q.t0); nverts++;
+			nvg__vset(&verts[nverts], c[6], c[7], q.s0, q.t1); nverts++;
+			nvg__vset(&verts[nverts], c[4], c[5], q.s1, q.t1); nverts++;
+		}
+	}
+
+	nvg__renderText(ctx, verts, nverts, nvg__textSDFWidth(ctx, para->fontId, para->size, para->blur));
+}
+
+void nvgParagraphBounds(NVGcontext* ctx, NVGparagraph* para, float x, float y, float* bounds)
+{
+	NVGstate* state = nvg__getState(ctx);
+	float minx = x, miny = y, maxx = x, maxy = y;
+	int i;
+
+	if (nvg__paragraphUpdate(ctx, para)) {
+		for (i = 0; i < para->nrows; i++) {
+			NVGparagraphRow* row = &para->rows[i];
+			float rx = nvg__paragraphRowX(ctx, para, row, x);
+			float ry = y + i * para->lineh * state->lineHeight;
+			minx = nvg__minf(minx, rx + row->minx);
+			maxx = nvg__maxf(maxx, rx + row->maxx);
+			miny = nvg__minf(miny, ry + para->rminy);
+			maxy = nvg__maxf(maxy, ry + para->rmaxy);
+		}
+	}
+
+	if (bounds != NULL) {
+		bounds[0] = minx;
+		bounds[1] = miny;
+		bounds[2] = maxx;
+		bounds[3] = maxy;
+	}
+}
+
+int nvgParagraphRows(NVGcontext* ctx, NVGparagraph* para, NVGtextRow* rows, int maxRows)
+{
+	int i;
+
+	if (!nvg__paragraphUpdate(ctx, para)) return 0;
+
+	for (i = 0; i < nvg__mini(para->nrows, maxRows); i++) {
+		NVGparagraphRow* row = &para->rows[i];
+		rows[i].start = para->text + row->start;
+		rows[i].end = para->text + row->end;
+		rows[i].next = para->text + row->next;
+		rows[i].width = row->width;
+		rows[i].minx = row->minx;
+		rows[i].maxx = row->maxx;
+	}
+	return para->nrows;
+}
+
+int nvgParagraphGlyphPositions(NVGcontext* ctx, NVGparagraph* para, int row, float x, NVGglyphPosition* positions, int maxPositions)
+{
+	NVGstate* state = nvg__getState(ctx);
+	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
+	float invscale = 1.0f / scale;
+	NVGparagraphRow* r;
+	float rx;
+	int i, npos;
+
+	if (!nvg__paragraphUpdate(ctx, para)) return 0;
+	if (row < 0 || row >= para->nrows) return 0;
+
+	r = &para->rows[row];
+	rx = nvg__paragraphRowX(ctx, para, r, x);
+	npos = nvg__mini(r->nglyphs, maxPositions);
+	for (i = 0; i < npos; i++) {
+		NVGparagraphGlyph* g = &para->glyphs[r->glyph + i];
+		positions[i].str = para->text + g->str;
+		positions[i].x = rx + g->x * invscale;
+		positions[i].minx = rx + g->minx * invscale;
+		positions[i].maxx = rx + g->maxx * invscale;
+	}
+	return npos;
+}
+
+int nvgParagraphCaret(NVGcontext* ctx, NVGparagraph* para, float x, float y, int offset, float* cx, float* cy)
+{
+	NVGstate* state = nvg__getState(ctx);
+	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
+	NVGparagraphRow* row;
+	float rx;
+	int i, irow;
+
+	if (!nvg__paragraphUpdate(ctx, para) || para->nrows == 0) {
+		if (cx != NULL) *cx = x;
+		if (cy != NULL) *cy = y;
+		return -1;
+	}
+
+	irow = nvg__paragraphFindRow(para, offset);
+	row = &para->rows[irow];
+	rx = nvg__paragraphRowX(ctx, para, row, x);
+	if (cy != NULL)
+		*cy = y + irow * para->lineh * state->lineHeight;
+	if (cx != NULL) {
+		*cx = rx + row->width;
+		for (i = 0; i < row->nglyphs; i++) {
+			NVGparagraphGlyph* g = &para->glyphs[row->glyph + i];
+			if (g->str >= offset) {
+				*cx = rx + g->x / scale;
+				break;
+			}
+		}
+	}
+	return irow;
+}
+
+int nvgParagraphHitTest(NVGcontext* ctx, NVGparagraph* para, float x, float y, float px, float py)
+{
+	NVGstate* state = nvg__getState(ctx);
+	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
+	float rowh, gx;
+	NVGparagraphRow* row;
+	int i, irow = 0;
+
+	if (!nvg__paragraphUpdate(ctx, para) || para->nrows == 0) return 0;
+
+	rowh = para->lineh * state->lineHeight;
+	if (rowh > 0.0f)
+		irow = (int)nvg__clampf(floorf((py - y - para->rminy) / rowh), 0.0f, (float)(para->nrows-1));
+	row = &para->rows[irow];
+
+	// Pick the glyph whose logical extent contains the point, the caret goes to the nearer side.
+	gx = (px - nvg__paragraphRowX(ctx, para, row, x)) * scale;
+	for (i = 0; i < row->nglyphs; i++) {
+		NVGparagraphGlyph* g = &para->glyphs[row->glyph + i];
+		float nextx = i+1 < row->nglyphs ? g[1].x : row->width * scale;
+		if (gx < (g->x + nextx) * 0.5f)
+			return g->str;
+	}
+	return row->end;
+}
+
+NVGdocument* nvgCreateDocument(void)
+{
+	NVGdocument* doc = (NVGdocument*)malloc(sizeof(NVGdocument));
+	if (doc == NULL) return NULL;
+	memset(doc, 0, sizeof(NVGdocument));
+	doc->fontId = FONS_INVALID;
+	return doc;
+}
+
+void nvgDeleteDocument(NVGdocument* doc)
+{
+	int i;
+	if (doc == NULL) return;
+	for (i = 0; i < doc->nlines; i++) {
+		free(doc->lines[i].text);
+		free(doc->lines[i].rowStarts);
+	}
+	free(doc->lines);
+	free(doc->rowIndex);
+	free(doc->dirty);
+	free(doc);
+}
+
+static int nvg__documentReserveDirty(NVGdocument* doc, int n)
+{
+	if (doc->ndirty+n > doc->cdirty) {
+		int cdirty = nvg__maxi(doc->ndirty+n, doc->cdirty*2);
+		int* dirty = (int*)realloc(doc->dirty, sizeof(int)*cdirty);
+		if (dirty == NULL) return 0;
+		doc->dirty = dirty;
+		doc->cdirty = cdirty;
+	}
+	return 1;
+}
+
+static int nvg__documentMarkDirty(NVGdocument* doc, int line)
+{
+	if (doc->lines[line].dirty) return 1;
+	if (!nvg__documentReserveDirty(doc, 1)) return 0;
+	doc->dirty[doc->ndirty++] = line;
+	doc->lines[line].dirty = 1;
+	return 1;
+}
+
+static int nvg__documentReserveLines(NVGdocument* doc, int n)
+{
+	if (doc->nlines+n > doc->clines) {
+		int clines = nvg__maxi(doc->nlines+n, doc->clines*2);
+		NVGdocumentLine* lines = (NVGdocumentLine*)realloc(doc->lines, sizeof(NVGdocumentLine)*clines);
+		int* rowIndex;
+		if (lines == NULL) return 0;
+		doc->lines = lines;
+		rowIndex = (int*)realloc(doc->rowIndex, sizeof(int)*(clines+1));
+		if (rowIndex == NULL) return 0;
+		doc->rowIndex = rowIndex;
+		doc->clines = clines;
+	}
+	return 1;
+}
+
+// Rebuilds the row index from the row counts of the lines in linear time.
+static void nvg__documentBuildIndex(NVGdocument* doc)
+{
+	int i;
+	for (i = 0; i < doc->nlines; i++)
+		doc->rowIndex[i+1] = doc->lines[i].nrows;
+	for (i = 1; i <= doc->nlines; i++) {
+		int j = i + (i & -i);
+		if (j <= doc->nlines)
+			doc->rowIndex[j] += doc->rowIndex[i];
+	}
+}
+
+static int nvg__documentAddLine(NVGdocument* doc)
+{
+	NVGdocumentLine* line;
+	int i, k;
+	if (!nvg__documentReserveLines(doc, 1)) return 0;
+	line = &doc->lines[doc->nlines++];
+	memset(line, 0, sizeof(NVGdocumentLine));
+	// The new node covers the lines below it which are not covered by the node before it.
+	i = doc->nlines;
+	doc->rowIndex[i] = 0;
+	for (k = 1; k < (i & -i); k <<= 1)
+		doc->rowIndex[i] += doc->rowIndex[i - k];
+	return nvg__documentMarkDirty(doc, doc->nlines-1);
+}
+
+static int nvg__documentAppendLine(NVGdocumentLine* line, const char* string, int len)
+{
+	char* text = (char*)realloc(line->text, line->len + len + 1);
+	if (text == NULL) return 0;
+	memcpy(text + line->len, string, len);
+	line->text = text;
+	line->len += len;
+	line->text[line->len] = '\0';
+	return 1;
+}
+
+int nvgDocumentAppend(NVGdocument* doc, const char* string, const char* end)
+{
+	if (end == NULL)
+		end = string + strlen(string);
+
+	while (string < end) {
+		const char* nl = (const char*)memchr(string, '\n', end - string);
+		const char* lineEnd = nl != NULL ? nl : end;
+		if (!doc->open && !nvg__documentAddLine(doc)) return 0;
+		if (!nvg__documentAppendLine(&doc->lines[doc->nlines-1], string, (int)(lineEnd - string))) return 0;
+		if (!nvg__documentMarkDirty(doc, doc->nlines-1)) return 0;
+		doc->open = nl == NULL;
+		string = nl != NULL ? nl+1 : end;
+	}
+	return 1;
+}
+
+int nvgDocumentSetLine(NVGdocument* doc, int line, const char* string, const char* end)
+{
+	NVGdocumentLine* l;
+	const char* nl;
+	if (line < 0 || line >= doc->nlines) return 0;
+	if (end == NULL)
+		end = string + strlen(string);
+	nl = (const char*)memchr(string, '\n', end - string);
+	l = &doc->lines[line];
+	l->len = 0;
+	if (!nvg__documentAppendLine(l, string, (int)((nl != NULL ? nl : end) - string))) return 0;
+	if (!nvg__documentMarkDirty(doc, line)) return 0;
+	// The text after a new-line goes to new lines below.
+	if (nl != NULL && nl+1 < end)
+		return nvgDocumentInsertLines(doc, line+1, nl+1, end);
+	return 1;
+}
+
+int nvgDocumentInsertLines(NVGdocument* doc, int line, const char* string, const char* end)
+{
+	const char* s;
+	int i, n = 1;
+	if (line < 0 || line > doc->nlines) return 0;
+	if (end == NULL)
+		end = string + strlen(string);
+	if (string < end && end[-1] == '\n')
+		end--;
+	for (s = string; (s = (const char*)memchr(s, '\n', end - s)) != NULL; s++)
+		n++;
+	if (!nvg__documentReserveLines(doc, n) || !nvg__documentReserveDirty(doc, n)) return 0;
+
+	memmove(&doc->lines[line+n], &doc->lines[line], sizeof(NVGdocumentLine)*(doc->nlines - line));
+	memset(&doc->lines[line], 0, sizeof(NVGdocumentLine)*n);
+	doc->nlines += n;
+	for (i = 0; i < doc->ndirty; i++) {
+		if (doc->dirty[i] >= line)
+			doc->dirty[i] += n;
+	}
+	// The new lines have no rows until they are wrapped.
+	for (i = line; i < line+n; i++)
+		nvg__documentMarkDirty(doc, i);
+	nvg__documentBuildIndex(doc);
+	if (line+n == doc->nlines)
+		doc->open = 0;
+
+	for (i = line; i < line+n; i++) {
+		const char* nl = (const char*)memchr(string, '\n', end - string);
+		const char* lineEnd = nl != NULL ? nl : end;
+		if (!nvg__documentAppendLine(&doc->lines[i], string, (int)(lineEnd - string))) return 0;
+		string = nl != NULL ? nl+1 : end;
+	}
+	return 1;
+}
+
+int nvgDocumentDeleteLines(NVGdocument* doc, int line, int count)
+{
+	int i, j;
+	if (line < 0 || count < 0 || count > doc->nlines - line) return 0;
+	if (count == 0) return 1;
+	for (i = line; i < line+count; i++) {
+		free(doc->lines[i].text);
+		free(doc->lines[i].rowStarts);
+	}
+	memmove(&doc->lines[line], &doc->lines[line+count], sizeof(NVGdocumentLine)*(doc->nlines - line - count));
+	doc->nlines -= count;
+	for (i = j = 0; i < doc->ndirty; i++) {
+		if (doc->dirty[i] >= line+count)
+			doc->dirty[j++] = doc->dirty[i] - count;
+		else if (doc->dirty[i] < line)
+			doc->dirty[j++] = doc->dirty[i];
+	}
+	doc->ndirty = j;
+	nvg__documentBuildIndex(doc);
+	if (line == doc->nlines)
+		doc->open = 0;
+	return 1;
+}
+
+int nvgDocumentLineCount(NVGdocument* doc)
+{
+	return doc->nlines;
+}
+
+const char* nvgDocumentLine(NVGdocument* doc, int line, const char** end)
+{
+	const char* text;
+	if (line < 0 || line >= doc->nlines) return NULL;
+	text = doc->lines[line].text != NULL ? doc->lines[line].text : "";
+	if (end != NULL)
+		*end = text + doc->lines[line].len;
+	return text;
+}
+
+void nvgDocumentSetWidth(NVGdocument* doc, float breakRowWidth)
+{
+	doc->width = breakRowWidth;
+}
+
+// Returns the number of rows before the line.
+static int nvg__documentRowsBefore(NVGdocument* doc, int line)
+{
+	int i, n = 0;
+	for (i = line; i > 0; i -= i & -i)
+		n += doc->rowIndex[i];
+	return n;
+}
+
+// Returns the line containing the row, and the first row of the line in firstRow.
+static int nvg__documentFindRow(NVGdocument* doc, int row, int* firstRow)
+{
+	int pos = 0, rem = row, step = 1;
+	while (step*2 <= doc->nlines)
+		step *= 2;
+	for (; step > 0; step >>= 1) {
+		if (pos + step <= doc->nlines && doc->rowIndex[pos + step] <= rem) {
+			pos += step;
+			rem -= doc->rowIndex[pos];
+		}
+	}
+	*firstRow = row - rem;
+	return pos;
+}
+
+static int nvg__documentWrap(NVGcontext* ctx, NVGdocument* doc, NVGdocumentLine* line)
+{
+	NVGtextRow row;
+	int* starts = NULL;
+	int nrows = 0, cstarts = 0, offset = 0;
+
+	free(line->rowStarts);
+	line->rowStarts = NULL;
+	line->nrows = 1;
+	if (doc->width <= 0.0f || line->len == 0)
+		return 1;
+
+	// Each row is broken on its own, so that visible rows can be measured again between their starts.
+	// The glyphs are measured at the font size in local units, the rows do not depend on the scale.
+	while (nvg__textBreakLines(ctx, line->text + offset, line->text + line->len, doc->width, &row, 1, 1.0f)) {
+		if (nrows+1 > cstarts) {
+			int* s;
+			cstarts = nvg__maxi(8, cstarts*2);
+			s = (int*)realloc(starts, sizeof(int)*cstarts);
+			if (s == NULL) {
+				free(starts);
+				return 0;
+			}
+			starts = s;
+		}
+		starts[nrows++] = offset;
+		offset = (int)(row.next - line->text);
+	}
+
+	if (nrows > 1) {
+		line->rowStarts = starts;
+		line->nrows = nrows;
+	} else {
+		free(starts);
+	}
+	return 1;
+}
+
+// Wraps the lines changed since the last layout, or all lines if the width or text style changed.
+static int nvg__documentUpdate(NVGcontext* ctx, NVGdocument* doc)
+{
+	NVGstate* state = nvg__getState(ctx);
+	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
+	int oldAlign = state->textAlign;
+	int valign = state->textAlign & (NVG_ALIGN_TOP | NVG_ALIGN_MIDDLE | NVG_ALIGN_BOTTOM | NVG_ALIGN_BASELINE);
+	int i, ok = 1;
+
+	if (state->fontId == FONS_INVALID) return 0;
+
+	nvgTextMetrics(ctx, NULL, NULL, &doc->lineh);
+	fonsSetAlign(ctx->fs, NVG_ALIGN_LEFT | valign);
+	fonsLineBounds(ctx->fs, 0, &doc->rminy, &doc->rmaxy);
+	doc->rminy /= scale;
+	doc->rmaxy /= scale;
+
+	state->textAlign = NVG_ALIGN_LEFT | valign;
+	if (doc->fontId != state->fontId || doc->size != state->fontSize || doc->spacing != state->letterSpacing ||
+		doc->layoutWidth != doc->width) {
+		doc->fontId = state->fontId;
+		doc->size = state->fontSize;
+		doc->spacing = state->letterSpacing;
+		doc->layoutWidth = doc->width;
+		// Wrap all lines and rebuild the row index in linear time.
+		for (i = 0; i < doc->nlines; i++) {
+			if (!nvg__documentWrap(ctx, doc, &doc->lines[i])) ok = 0;
+			doc->lines[i].dirty = 0;
+		}
+		nvg__documentBuildIndex(doc);
+		doc->ndirty = 0;
+	}
+	for (i = 0; i < doc->ndirty; i++) {
+		NVGdocumentLine* line = &doc->lines[doc->dirty[i]];
+		int nrows = line->nrows, j;
+		if (!nvg__documentWrap(ctx, doc, line)) ok = 0;
+		line->dirty = 0;
+		for (j = doc->dirty[i]+1; j <= doc->nlines; j += j & -j)
+			doc->rowIndex[j] += line->nrows - nrows;
+	}
+	doc->ndirty = 0;
+	state->textAlign = oldAlign;
+
+	return ok;
+}
+
+static float nvg__documentRowX(NVGcontext* ctx, NVGdocument* doc, float x, float rowWidth)
+{
+	NVGstate* state = nvg__getState(ctx);
+	int halign = state->textAlign & (NVG_ALIGN_LEFT | NVG_ALIGN_CENTER | NVG_ALIGN_RIGHT);
+	if (halign & NVG_ALIGN_CENTER)
+		return x + doc->width*0.5f - rowWidth*0.5f;
+	else if (halign & NVG_ALIGN_RIGHT)
+		return x + doc->width - rowWidth;
+	return x;
+}
+
+// Returns the text of a row and its x position. Lines which are not wrapped keep the text alignment.
+static int nvg__documentRow(NVGcontext* ctx, NVGdocument* doc, int line, int rowInLine, float x, NVGtextRow* row, float* rx)
+{
+	NVGstate* state = nvg__getState(ctx);
+	NVGdocumentLine* l = &doc->lines[line];
+	const char* text = nvgDocumentLine(doc, line, NULL);
+	int offset = l->rowStarts != NULL ? l->rowStarts[rowInLine] : 0;
+	int next = l->rowStarts != NULL && rowInLine+1 < l->nrows ? l->rowStarts[rowInLine+1] : l->len;
+	int oldAlign = state->textAlign, n;
+
+	if (doc->width <= 0.0f) {
+		row->start = text;
+		row->end = row->next = text + l->len;
+		*rx = x;
+		return 1;
 	}
 
-	// Break the line from the end of the last word, and start new line from the beginning of the new.
-	if (rowStart != NULL) {
-		rows[nrows].start = rowStart;
-		rows[nrows].end = rowEnd;
-		rows[nrows].width = rowWidth * invscale;
-		rows[nrows].minx = rowMinX * invscale;
-		rows[nrows].maxx = rowMaxX * invscale;
-		rows[nrows].next = end;
-		nrows++;
+	state->textAlign = NVG_ALIGN_LEFT | (oldAlign & (NVG_ALIGN_TOP | NVG_ALIGN_MIDDLE | NVG_ALIGN_BOTTOM | NVG_ALIGN_BASELINE));
+	// The row ends where the next one starts, it is only measured at the current scale.
+	n = nvgTextBreakLines(ctx, text + offset, text + next, 1e30f, row, 1);
+	state->textAlign = oldAlign;
+	if (n == 0) return 0;
+	*rx = nvg__documentRowX(ctx, doc, x, row->width);
+	return 1;
+}
+
+void nvgDocument(NVGcontext* ctx, NVGdocument* doc, float x, float y)
+{
+	NVGstate* state = nvg__getState(ctx);
+	int oldAlign = state->textAlign;
+	int valign = state->textAlign & (NVG_ALIGN_TOP | NVG_ALIGN_MIDDLE | NVG_ALIGN_BOTTOM | NVG_ALIGN_BASELINE);
+	float rowh, vis[4];
+	int first, last, row, line, lineRow, nrows;
+
+	if (!nvg__documentUpdate(ctx, doc)) return;
+	nrows = nvg__documentRowsBefore(doc, doc->nlines);
+	rowh = doc->lineh * state->lineHeight;
+	if (nrows == 0 || rowh <= 0.0f) return;
+
+	// Only the rows overlapping the scissor and the viewport are laid out.
+	nvg__visibleBounds(ctx, vis);
+	first = (int)nvg__clampf(floorf((vis[1] - y - doc->rmaxy) / rowh), 0.0f, (float)nrows);
+	last = (int)nvg__clampf(ceilf((vis[3] - y - doc->rminy) / rowh), -1.0f, (float)(nrows-1));
+	if (first > last) return;
+
+	line = nvg__documentFindRow(doc, first, &lineRow);
+	for (row = first; row <= last; line++) {
+		int nlineRows = doc->lines[line].nrows;
+		for (; row <= last && row - lineRow < nlineRows; row++) {
+			NVGtextRow r;
+			float rx;
+			if (!nvg__documentRow(ctx, doc, line, row - lineRow, x, &r, &rx)) continue;
+			if (doc->width > 0.0f)
+				state->textAlign = NVG_ALIGN_LEFT | valign;
+			nvgText(ctx, rx, y + row * rowh, r.start, r.end);
+			state->textAlign = oldAlign;
+		}
+		lineRow += nlineRows;
 	}
+}
 
-	return nrows;
+int nvgDocumentRowCount(NVGcontext* ctx, NVGdocument* doc)
+{
+	if (!nvg__documentUpdate(ctx, doc)) return 0;
+	return nvg__documentRowsBefore(doc, doc->nlines);
 }
 
-float nvgTextBounds(NVGcontext* ctx, float x, float y, const char* string, const char* end, float* bounds)
+float nvgDocumentRowHeight(NVGcontext* ctx, NVGdocument* doc)
 {
 	NVGstate* state = nvg__getState(ctx);
-	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
-	float invscale = 1.0f / scale;
-	float width;
+	if (!nvg__documentUpdate(ctx, doc)) return 0.0f;
+	return doc->lineh * state->lineHeight;
+}
 
-	if (state->fontId == FONS_INVALID) return 0;
+int nvgDocumentLineRow(NVGcontext* ctx, NVGdocument* doc, int line)
+{
+	if (!nvg__documentUpdate(ctx, doc)) return 0;
+	return nvg__documentRowsBefore(doc, nvg__clampi(line, 0, doc->nlines));
+}
+
+int nvgDocumentRowLine(NVGcontext* ctx, NVGdocument* doc, int row, int* rowInLine)
+{
+	int line, lineRow = 0;
+	if (!nvg__documentUpdate(ctx, doc) || doc->nlines == 0) {
+		if (rowInLine != NULL) *rowInLine = 0;
+		return -1;
+	}
+	row = nvg__clampi(row, 0, nvg__documentRowsBefore(doc, doc->nlines)-1);
+	line = nvg__documentFindRow(doc, row, &lineRow);
+	if (rowInLine != NULL) *rowInLine = row - lineRow;
+	return line;
+}
+
+int nvgDocumentHitTest(NVGcontext* ctx, NVGdocument* doc, float x, float y, float px, float py, int* line)
+{
+	NVGstate* state = nvg__getState(ctx);
+	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
+	float rowh, rx;
+	FONStextIter iter;
+	FONSquad q;
+	NVGtextRow r;
+	const char* text;
+	int row = 0, lineRow = 0, l, align = state->textAlign;
+
+	if (line != NULL) *line = -1;
+	if (!nvg__documentUpdate(ctx, doc) || doc->nlines == 0) return 0;
+
+	rowh = doc->lineh * state->lineHeight;
+	if (rowh > 0.0f)
+		row = (int)nvg__clampf(floorf((py - y - doc->rminy) / rowh), 0.0f, (float)(nvg__documentRowsBefore(doc, doc->nlines)-1));
+	l = nvg__documentFindRow(doc, row, &lineRow);
+	if (line != NULL) *line = l;
+	text = nvgDocumentLine(doc, l, NULL);
+	if (!nvg__documentRow(ctx, doc, l, row - lineRow, x, &r, &rx))
+		return 0;
 
+	// Pick the glyph whose logical extent contains the point, the caret goes to the nearer side.
+	if (doc->width > 0.0f)
+		align = NVG_ALIGN_LEFT;
 	fonsSetSize(ctx->fs, state->fontSize*scale);
 	fonsSetSpacing(ctx->fs, state->letterSpacing*scale);
 	fonsSetBlur(ctx->fs, state->fontBlur*scale);
-	fonsSetAlign(ctx->fs, state->textAlign);
+	fonsSetAlign(ctx->fs, align);
 	fonsSetFont(ctx->fs, state->fontId);
+	fonsTextIterInit(ctx->fs, &iter, rx*scale, 0, r.start, r.end, FONS_GLYPH_BITMAP_OPTIONAL);
+	while (fonsTextIterNext(ctx->fs, &iter, &q)) {
+		if (px*scale < (iter.x + iter.nextx) * 0.5f)
+			return (int)(iter.str - text);
+	}
+	return (int)(r.end - text);
+}
 
-	width = fonsTextBounds(ctx->fs, x*scale, y*scale, string, end, bounds);
-	if (bounds != NULL) {
-		// Use line bounds for height.
-		fonsLineBounds(ctx->fs, y*scale, &bounds[1], &bounds[3]);
-		bounds[0] *= invscale;
-		bounds[1] *= invscale;
-		bounds[2] *= invscale;
-		bounds[3] *= invscale;
+NVGgrid* nvgCreateGrid(int rows, int cols)
+{
+	NVGgrid* grid = NULL;
+	int i;
+
+	if (rows <= 0 || cols <= 0) goto error;
+	grid = (NVGgrid*)malloc(sizeof(NVGgrid));
+	if (grid == NULL) goto error;
+	memset(grid, 0, sizeof(NVGgrid));
+	grid->rows = rows;
+	grid->cols = cols;
+	grid->fontId = FONS_INVALID;
+
+	grid->cells = (NVGgridCell*)malloc(sizeof(NVGgridCell)*rows*cols);
+	if (grid->cells == NULL) goto error;
+	memset(grid->cells, 0, sizeof(NVGgridCell)*rows*cols);
+	grid->dirty = (unsigned char*)malloc(rows);
+	if (grid->dirty == NULL) goto error;
+	memset(grid->dirty, 1, rows);
+	grid->quads = (FONSquad*)malloc(sizeof(FONSquad)*rows*cols);
+	if (grid->quads == NULL) goto error;
+	grid->quadColors = (unsigned char*)malloc(rows*cols);
+	if (grid->quadColors == NULL) goto error;
+	grid->nquads = (int*)malloc(sizeof(int)*rows);
+	if (grid->nquads == NULL) goto error;
+	grid->runs = (int*)malloc(sizeof(int)*2*rows*cols);
+	if (grid->runs == NULL) goto error;
+	grid->runColors = (unsigned char*)malloc(rows*cols);
+	if (grid->runColors == NULL) goto error;
+	grid->nruns = (int*)malloc(sizeof(int)*rows);
+	if (grid->nruns == NULL) goto error;
+	memset(grid->nquads, 0, sizeof(int)*rows);
+	memset(grid->nruns, 0, sizeof(int)*rows);
+
+	// Index 0 is the default background, the other colors default to white.
+	grid->palette[0] = nvgRGBA(0,0,0,0);
+	for (i = 1; i < NVG_GRID_COLORS; i++)
+		grid->palette[i] = nvgRGBA(255,255,255,255);
+	grid->changed = 1;
+
+	return grid;
+
+error:
+	nvgDeleteGrid(grid);
+	return NULL;
+}
+
+void nvgDeleteGrid(NVGgrid* grid)
+{
+	if (grid == NULL) return;
+	free(grid->cells);
+	free(grid->dirty);
+	free(grid->quads);
+	free(grid->quadColors);
+	free(grid->nquads);
+	free(grid->runs);
+	free(grid->runColors);
+	free(grid->nruns);
+	free(grid->verts);
+	free(grid);
+}
+
+void nvgGridSetPalette(NVGgrid* grid, int index, NVGcolor color)
+{
+	if (index < 0 || index >= NVG_GRID_COLORS) return;
+	grid->palette[index] = color;
+}
+
+static NVGgridCell* nvg__gridRow(NVGgrid* grid, int row)
+{
+	return &grid->cells[((grid->top + row) % grid->rows) * grid->cols];
+}
+
+void nvgGridSetCell(NVGgrid* grid, int row, int col, unsigned int codepoint, int fg, int bg)
+{
+	NVGgridCell* cell;
+	if (row < 0 || row >= grid->rows || col < 0 || col >= grid->cols) return;
+	cell = &nvg__gridRow(grid, row)[col];
+	if (cell->codepoint == codepoint && cell->fg == (unsigned char)fg && cell->bg == (unsigned char)bg) return;
+	cell->codepoint = codepoint;
+	cell->fg = (unsigned char)fg;
+	cell->bg = (unsigned char)bg;
+	grid->dirty[(grid->top + row) % grid->rows] = 1;
+	grid->changed = 1;
+}
+
+void nvgGridSetRow(NVGgrid* grid, int row, const NVGgridCell* cells, int ncells)
+{
+	NVGgridCell* dst;
+	int i, changed = 0;
+	if (row < 0 || row >= grid->rows || ncells <= 0) return;
+	dst = nvg__gridRow(grid, row);
+	ncells = nvg__mini(ncells, grid->cols);
+	// The fields are compared and copied one by one, the padding of the cells of the caller is not read.
+	for (i = 0; i < ncells; i++) {
+		if (dst[i].codepoint == cells[i].codepoint && dst[i].fg == cells[i].fg && dst[i].bg == cells[i].bg)
+			continue;
+		dst[i].codepoint = cells[i].codepoint;
+		dst[i].fg = cells[i].fg;
+		dst[i].bg = cells[i].bg;
+		changed = 1;
 	}
-	return width * invscale;
+	if (!changed) return;
+	grid->dirty[(grid->top + row) % grid->rows] = 1;
+	grid->changed = 1;
 }
 
-void nvgTextBoxBounds(NVGcontext* ctx, float x, float y, float breakRowWidth, const char* string, const char* end, float* bounds)
+const NVGgridCell* nvgGridGetRow(NVGgrid* grid, int row)
 {
-	NVGstate* state = nvg__getState(ctx);
-	NVGtextRow rows[2];
-	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
-	float invscale = 1.0f / scale;
-	int nrows = 0, i;
-	int oldAlign = state->textAlign;
-	int halign = state->textAlign & (NVG_ALIGN_LEFT | NVG_ALIGN_CENTER | NVG_ALIGN_RIGHT);
-	int valign = state->textAlign & (NVG_ALIGN_TOP | NVG_ALIGN_MIDDLE | NVG_ALIGN_BOTTOM | NVG_ALIGN_BASELINE);
-	float lineh = 0, rminy = 0, rmaxy = 0;
-	float minx, miny, maxx, maxy;
+	if (row < 0 || row >= grid->rows) return NULL;
+	return nvg__gridRow(grid, row);
+}
 
-	if (state->fontId == FONS_INVALID) {
-		if (bounds != NULL)
-			bounds[0] = bounds[1] = bounds[2] = bounds[3] = 0.0f;
-		return;
+void nvgGridScroll(NVGgrid* grid, int n)
+{
+	int i, p;
+	if (n == 0) return;
+	if (n >= grid->rows || n <= -grid->rows) {
+		n = grid->rows;
+	} else {
+		// The rows keep their layout, only the rows scrolled in are cleared.
+		grid->top = ((grid->top + n) % grid->rows + grid->rows) % grid->rows;
+	}
+	for (i = 0; i < (n > 0 ? n : -n); i++) {
+		p = n > 0 ? (grid->top + grid->rows - 1 - i) % grid->rows : (grid->top + i) % grid->rows;
+		memset(&grid->cells[p * grid->cols], 0, sizeof(NVGgridCell)*grid->cols);
+		grid->dirty[p] = 1;
 	}
+	grid->changed = 1;
+}
 
-	nvgTextMetrics(ctx, NULL, NULL, &lineh);
+static char* nvg__encodeUTF8(unsigned int cp, char* str)
+{
+	if (cp < 0x80) {
+		*str++ = (char)cp;
+	} else if (cp < 0x800) {
+		*str++ = (char)(0xc0 | (cp >> 6));
+		*str++ = (char)(0x80 | (cp & 0x3f));
+	} else if (cp < 0x10000) {
+		*str++ = (char)(0xe0 | (cp >> 12));
+		*str++ = (char)(0x80 | ((cp >> 6) & 0x3f));
+		*str++ = (char)(0x80 | (cp & 0x3f));
+	} else {
+		*str++ = (char)(0xf0 | ((cp >> 18) & 0x07));
+		*str++ = (char)(0x80 | ((cp >> 12) & 0x3f));
+		*str++ = (char)(0x80 | ((cp >> 6) & 0x3f));
+		*str++ = (char)(0x80 | (cp & 0x3f));
+	}
+	return str;
+}
 
-	state->textAlign = NVG_ALIGN_LEFT | valign;
+// Looks up the quad of a codepoint relative to the cell origin, without kerning.
+static int nvg__gridGlyph(NVGcontext* ctx, NVGgrid* grid, unsigned int codepoint, FONSquad* q)
+{
+	FONStextIter iter;
+	char str[4], *end;
 
-	minx = maxx = x;
-	miny = maxy = y;
+	if (codepoint < 256 && grid->latinState[codepoint] != 0) {
+		*q = grid->latin[codepoint];
+		return grid->latinState[codepoint] == 1;
+	}
+
+	end = nvg__encodeUTF8(codepoint, str);
+	fonsTextIterInit(ctx->fs, &iter, 0, 0, str, end, FONS_GLYPH_BITMAP_REQUIRED);
+	if (!fonsTextIterNext(ctx->fs, &iter, q) || iter.prevGlyphIndex == -1) {
+		// The atlas is full, continue in a new one and lay out the grid again.
+		if (nvg__allocTextAtlas(ctx))
+			return 0;
+		memset(q, 0, sizeof(*q));
+	} else {
+		q->y0 -= floorf(iter.y);
+		q->y1 -= floorf(iter.y);
+	}
+	grid->pageMask |= iter.pageMask;
+	if (codepoint < 256) {
+		grid->latin[codepoint] = *q;
+		grid->latinState[codepoint] = q->x0 != q->x1 ? 1 : 2;
+	}
+	return q->x0 != q->x1;
+}
+
+static void nvg__gridLayoutRow(NVGcontext* ctx, NVGgrid* grid, int p)
+{
+	const NVGgridCell* cells = &grid->cells[p * grid->cols];
+	FONSquad* quads = &grid->quads[p * grid->cols];
+	unsigned char* quadColors = &grid->quadColors[p * grid->cols];
+	int* runs = &grid->runs[p * grid->cols * 2];
+	unsigned char* runColors = &grid->runColors[p * grid->cols];
+	int c, nquads = 0, nruns = 0;
+
+	for (c = 0; c < grid->cols; c++) {
+		const NVGgridCell* cell = &cells[c];
+		// Neighbouring cells of the same background are drawn as one quad.
+		if (nruns > 0 && runColors[nruns-1] == cell->bg) {
+			runs[nruns*2-1] = c+1;
+		} else {
+			runs[nruns*2] = c;
+			runs[nruns*2+1] = c+1;
+			runColors[nruns] = cell->bg;
+			nruns++;
+		}
+		if (cell->codepoint > 32 && nvg__gridGlyph(ctx, grid, cell->codepoint, &quads[nquads])) {
+			quads[nquads].x0 += c * grid->advance;
+			quads[nquads].x1 += c * grid->advance;
+			quadColors[nquads] = cell->fg;
+			nquads++;
+		}
+	}
+	grid->nquads[p] = nquads;
+	grid->nruns[p] = nruns;
+	grid->dirty[p] = 0;
+}
+
+// Lays out the rows which changed since the last draw, or all rows if the text style or the atlas changed.
+static int nvg__gridUpdate(NVGcontext* ctx, NVGgrid* grid)
+{
+	NVGstate* state = nvg__getState(ctx);
+	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
+	float blur = nvg__qualityReduced(ctx, NVG_QUALITY_TEXT_BLUR, 2) ? 0.0f : state->fontBlur*scale;
+	int i, pass, epoch;
+
+	if (state->fontId == FONS_INVALID) return 0;
 
 	fonsSetSize(ctx->fs, state->fontSize*scale);
-	fonsSetSpacing(ctx->fs, state->letterSpacing*scale);
-	fonsSetBlur(ctx->fs, state->fontBlur*scale);
-	fonsSetAlign(ctx->fs, state->textAlign);
+	fonsSetSpacing(ctx->fs, 0.0f);
+	fonsSetBlur(ctx->fs, blur);
+	fonsSetAlign(ctx->fs, NVG_ALIGN_LEFT | NVG_ALIGN_TOP);
 	fonsSetFont(ctx->fs, state->fontId);
-	fonsLineBounds(ctx->fs, 0, &rminy, &rmaxy);
-	rminy *= invscale;
-	rmaxy *= invscale;
 
-	while ((nrows = nvgTextBreakLines(ctx, string, end, breakRowWidth, rows, 2))) {
-		for (i = 0; i < nrows; i++) {
-			NVGtextRow* row = &rows[i];
-			float rminx, rmaxx, dx = 0;
-			// Horizontal bounds
-			if (halign & NVG_ALIGN_LEFT)
-				dx = 0;
-			else if (halign & NVG_ALIGN_CENTER)
-				dx = breakRowWidth*0.5f - row->width*0.5f;
-			else if (halign & NVG_ALIGN_RIGHT)
-				dx = breakRowWidth - row->width;
-			rminx = x + row->minx + dx;
-			rmaxx = x + row->maxx + dx;
-			minx = nvg__minf(minx, rminx);
-			maxx = nvg__maxf(maxx, rmaxx);
-			// Vertical bounds.
-			miny = nvg__minf(miny, y + rminy);
-			maxy = nvg__maxf(maxy, y + rmaxy);
+	for (pass = 0; pass < 2; pass++) {
+		if (grid->fontId != state->fontId || grid->size != state->fontSize*scale || grid->blur != blur ||
+			!nvg__textQuadsValid(ctx, grid->generation, grid->pageMask, grid->evictions)) {
+			FONStextIter iter;
+			FONSquad q;
+			grid->fontId = state->fontId;
+			grid->size = state->fontSize*scale;
+			grid->blur = blur;
+			// The white rectangle at the atlas origin is used for the backgrounds.
+			grid->pageMask = 1;
+			memset(grid->latinState, 0, sizeof(grid->latinState));
+			memset(grid->dirty, 1, grid->rows);
+			// All cells have the advance of the widest of the common glyphs, in whole pixels so that
+			// the glyphs laid out at phase 0 stay on the pixel grid when subpixel phases are enabled.
+			fonsTextIterInit(ctx->fs, &iter, 0, 0, "M", NULL, FONS_GLYPH_BITMAP_OPTIONAL);
+			fonsTextIterNext(ctx->fs, &iter, &q);
+			grid->advance = floorf(iter.nextx - iter.x + 0.5f);
+			grid->aligny = iter.y;
+			grid->changed = 1;
+		}
+		epoch = nvg__textEpoch(ctx);
+		for (i = 0; i < grid->rows; i++) {
+			if (grid->dirty[i])
+				nvg__gridLayoutRow(ctx, grid, i);
+		}
+		nvg__stampTextQuads(ctx, &grid->generation, &grid->evictions, grid->pageMask, epoch);
+		if (grid->generation != -1)
+			break;
+	}
 
-			y += lineh * state->lineHeight;
+	return 1;
+}
+
+static void nvg__gridQuad(NVGvertex* verts, const float* xform, float x0, float y0, float x1, float y1,
+						  float s0, float t0, float s1, float t1)
+{
+	float c[4*2];
+	nvgTransformPoint(&c[0],&c[1], xform, x0, y0);
+	nvgTransformPoint(&c[2],&c[3], xform, x1, y0);
+	nvgTransformPoint(&c[4],&c[5], xform, x1, y1);
+	nvgTransformPoint(&c[6],&c[7], xform, x0, y1);
+	nvg__vset(&verts[0], c[0], c[1], s0, t0);
+	nvg__vset(&verts[1], c[4], c[5], s1, t1);
+	nvg__vset(&verts[2], c[2], c[3], s1, t0);
+	nvg__vset(&verts[3], c[0], c[1], s0, t0);
+	nvg__vset(&verts[4], c[6], c[7], s0, t1);
+	nvg__vset(&verts[5], c[4], c[5], s1, t1);
+}
+
+// Builds the vertices of all cells, grouped by color into one call per background and glyph color.
+static int nvg__gridBuild(NVGcontext* ctx, NVGgrid* grid, float x, float y, float rowh)
+{
+	NVGstate* state = nvg__getState(ctx);
+	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
+	float invscale = 1.0f / scale;
+	int counts[NVG_GRID_COLORS*2], offsets[NVG_GRID_COLORS*2];
+	int i, r, nquads = 0, atlasw = 1, atlash = 1;
+	float fx = floorf(x*scale), wu, wv;
+
+	memset(counts, 0, sizeof(counts));
+	for (r = 0; r < grid->rows; r++) {
+		int p = (grid->top + r) % grid->rows;
+		for (i = 0; i < grid->nruns[p]; i++)
+			counts[grid->runColors[p * grid->cols + i]]++;
+		for (i = 0; i < grid->nquads[p]; i++)
+			counts[NVG_GRID_COLORS + grid->quadColors[p * grid->cols + i]]++;
+	}
+	grid->ncalls = 0;
+	for (i = 0; i < NVG_GRID_COLORS*2; i++) {
+		offsets[i] = nquads*6;
+		if (counts[i] == 0) continue;
+		grid->calls[grid->ncalls].color = i % NVG_GRID_COLORS;
+		grid->calls[grid->ncalls].glyphs = i >= NVG_GRID_COLORS;
+		grid->calls[grid->ncalls].offset = nquads*6;
+		grid->calls[grid->ncalls].count = counts[i]*6;
+		grid->ncalls++;
+		nquads += counts[i];
+	}
+
+	if (nquads*6 > grid->cverts) {
+		int cverts = (nquads*6 + 0xff) & ~0xff;
+		NVGvertex* verts = (NVGvertex*)realloc(grid->verts, sizeof(NVGvertex)*cverts);
+		if (verts == NULL) return 0;
+		grid->verts = verts;
+		grid->cverts = cverts;
+	}
+	grid->nverts = nquads*6;
+
+	// Backgrounds sample the middle of the white rectangle.
+	fonsGetAtlasSize(ctx->fs, &atlasw, &atlash);
+	wu = 1.0f / atlasw;
+	wv = 1.0f / atlash;
+
+	for (r = 0; r < grid->rows; r++) {
+		int p = (grid->top + r) % grid->rows;
+		float ry0 = y + r * rowh, ry1 = y + (r+1) * rowh;
+		float fy = floorf(ry0*scale + grid->aligny);
+		const int* runs = &grid->runs[p * grid->cols * 2];
+		const FONSquad* quads = &grid->quads[p * grid->cols];
+		for (i = 0; i < grid->nruns[p]; i++) {
+			int* o = &offsets[grid->runColors[p * grid->cols + i]];
+			float x0 = (fx + runs[i*2] * grid->advance) * invscale;
+			float x1 = (fx + runs[i*2+1] * grid->advance) * invscale;
+			nvg__gridQuad(&grid->verts[*o], state->xform, x0, ry0, x1, ry1, wu, wv, wu, wv);
+			*o += 6;
+		}
+		for (i = 0; i < grid->nquads[p]; i++) {
+			const FONSquad* q = &quads[i];
+			int* o = &offsets[NVG_GRID_COLORS + grid->quadColors[p * grid->cols + i]];
+			nvg__gridQuad(&grid->verts[*o], state->xform, (fx + q->x0) * invscale, (fy + q->y0) * invscale,
+						  (fx + q->x1) * invscale, (fy + q->y1) * invscale, q->s0, q->t0, q->s1, q->t1);
+			*o += 6;
 		}
-		string = rows[nrows-1].next;
 	}
 
-	state->textAlign = oldAlign;
+	memcpy(grid->drawXform, state->xform, sizeof(float)*6);
+	grid->drawx = x;
+	grid->drawy = y;
+	grid->drawRowh = rowh;
+	grid->changed = 0;
+	return 1;
+}
 
-	if (bounds != NULL) {
-		bounds[0] = minx;
-		bounds[1] = miny;
-		bounds[2] = maxx;
-		bounds[3] = maxy;
+void nvgGrid(NVGcontext* ctx, NVGgrid* grid, float x, float y)
+{
+	NVGstate* state = nvg__getState(ctx);
+	float lineh = 0.0f, rowh, sdfWidth;
+	int i;
+
+	if (!nvg__gridUpdate(ctx, grid)) return;
+	nvgTextMetrics(ctx, NULL, NULL, &lineh);
+	rowh = lineh * state->lineHeight;
+
+	// Unchanged grids drawn at the same place reuse the vertices of the last draw.
+	if (grid->changed || x != grid->drawx || y != grid->drawy || rowh != grid->drawRowh ||
+		memcmp(state->xform, grid->drawXform, sizeof(float)*6) != 0) {
+		if (!nvg__gridBuild(ctx, grid, x, y, rowh)) return;
+	}
+
+	// Keep the glyphs from being evicted while they are drawn this frame.
+	fonsTouchPages(ctx->fs, grid->pageMask);
+
+	sdfWidth = nvg__textSDFWidth(ctx, grid->fontId, grid->size, grid->blur);
+	for (i = 0; i < grid->ncalls; i++) {
+		NVGgridCall* call = &grid->calls[i];
+		NVGpaint paint;
+		if (grid->palette[call->color].a <= 0.0f) continue;
+		nvg__setPaintColor(&paint, grid->palette[call->color]);
+		nvg__renderTextPaint(ctx, paint, &grid->verts[call->offset], call->count, call->glyphs ? sdfWidth : 0.0f);
 	}
 }
 
+void nvgGridCellSize(NVGcontext* ctx, NVGgrid* grid, float* w, float* h)
+{
+	NVGstate* state = nvg__getState(ctx);
+	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
+	float lineh = 0.0f;
+
+	if (!nvg__gridUpdate(ctx, grid)) {
+		if (w != NULL) *w = 0.0f;
+		if (h != NULL) *h = 0.0f;
+		return;
+	}
+	nvgTextMetrics(ctx, NULL, NULL, &lineh);
+	if (w != NULL) *w = grid->advance / scale;
+	if (h != NULL) *h = lineh * state->lineHeight;
+}
+
 void nvgTextMetrics(NVGcontext* ctx, float* ascender, float* descender, float* lineh)
 {
 	NVGstate* state = nvg__getState(ctx);
@@ -3110,6 +5887,7 @@ struct GLNVGcontext {
 	unsigned char* uniforms;
 	int cuniforms;
 	int nuniforms;
+	NVGmemoryBuffer mem[NVG_MEMORY_BUFFER_COUNT];
 
 	// cached state
 	#if NANOVG_GL_USE_STATE_FILTER
@@ -3127,6 +5905,12 @@ typedef struct GLNVGcontext GLNVGcontext;
 
 static int glnvg__maxi(int a, int b) { return a > b ? a : b; }
 
+static void glnvg__trackMemory(NVGmemoryBuffer* buffer, int bytes)
+{
+	buffer->current = bytes;
+	buffer->peak = glnvg__maxi(buffer->peak, bytes);
+}
+
 #ifdef NANOVG_GLES2
 static unsigned int glnvg__nearestPow2(unsigned int num)
 {
@@ -3519,6 +6303,7 @@ static int glnvg__renderCreate(void* uptr)
 		"#endif\n"
 		"		if (texType == 1) color = vec4(color.xyz*color.w,color.w);"
 		"		if (texType == 2) color = vec4(color.x);"
+		"		if (texType == 3) color = vec4(smoothstep(0.5-radius, 0.5+radius, color.x));\n"
 		"		color *= scissor;\n"
 		"		result = color * innerCol;\n"
 		"	}\n"
@@ -4075,6 +6860,11 @@ static void glnvg__renderFlush(void* uptr)
 		glnvg__bindTexture(gl, 0);
 	}
 
+	glnvg__trackMemory(&gl->mem[NVG_MEMORY_RENDER_CALLS], gl->ncalls*(int)sizeof(GLNVGcall));
+	glnvg__trackMemory(&gl->mem[NVG_MEMORY_RENDER_PATHS], gl->npaths*(int)sizeof(GLNVGpath));
+	glnvg__trackMemory(&gl->mem[NVG_MEMORY_RENDER_VERTS], gl->nverts*(int)sizeof(NVGvertex));
+	glnvg__trackMemory(&gl->mem[NVG_MEMORY_RENDER_UNIFORMS], gl->nuniforms*gl->fragSize);
+
 	// Reset calls
 	gl->nverts = 0;
 	gl->npaths = 0;
@@ -4082,6 +6872,56 @@ static void glnvg__renderFlush(void* uptr)
 	gl->nuniforms = 0;
 }
 
+static void glnvg__renderMemoryStats(void* uptr, NVGmemoryBuffer* buffers)
+{
+	GLNVGcontext* gl = (GLNVGcontext*)uptr;
+	NVGmemoryBuffer* textures = &buffers[NVG_MEMORY_TEXTURES];
+	int i;
+
+	for (i = NVG_MEMORY_RENDER_CALLS; i <= NVG_MEMORY_RENDER_UNIFORMS; i++)
+		buffers[i] = gl->mem[i];
+	buffers[NVG_MEMORY_RENDER_CALLS].capacity = gl->ccalls*(int)sizeof(GLNVGcall);
+	buffers[NVG_MEMORY_RENDER_PATHS].capacity = gl->cpaths*(int)sizeof(GLNVGpath);
+	buffers[NVG_MEMORY_RENDER_VERTS].capacity = gl->cverts*(int)sizeof(NVGvertex);
+	buffers[NVG_MEMORY_RENDER_UNIFORMS].capacity = gl->cuniforms*gl->fragSize;
+
+	textures->current = 0;
+	for (i = 0; i < gl->ntextures; i++) {
+		GLNVGtexture* tex = &gl->textures[i];
+		int size;
+		if (tex->tex == 0 || (tex->flags & NVG_IMAGE_NODELETE))
+			continue;
+		size = tex->width * tex->height * (tex->type == NVG_TEXTURE_RGBA ? 4 : 1);
+		if (tex->flags & NVG_IMAGE_GENERATE_MIPMAPS)
+			size += size / 3;
+		textures->current += size;
+	}
+	gl->mem[NVG_MEMORY_TEXTURES].peak = glnvg__maxi(gl->mem[NVG_MEMORY_TEXTURES].peak, textures->current);
+	textures->peak = gl->mem[NVG_MEMORY_TEXTURES].peak;
+	textures->capacity = textures->current;
+}
+
+static void* glnvg__shrinkBuffer(void* buf, int* cap, int size, int target, int minCap)
+{
+	int c = glnvg__maxi(target / size, minCap);
+	void* ptr;
+	if (buf == NULL || c >= *cap) return buf;
+	ptr = realloc(buf, size * c);
+	if (ptr == NULL) return buf;
+	*cap = c;
+	return ptr;
+}
+
+// Called between frames, shrinks the per frame buffers to at most the given sizes in bytes.
+static void glnvg__renderTrimMemory(void* uptr, const int* sizes)
+{
+	GLNVGcontext* gl = (GLNVGcontext*)uptr;
+	gl->calls = (GLNVGcall*)glnvg__shrinkBuffer(gl->calls, &gl->ccalls, sizeof(GLNVGcall), sizes[NVG_MEMORY_RENDER_CALLS], 128);
+	gl->paths = (GLNVGpath*)glnvg__shrinkBuffer(gl->paths, &gl->cpaths, sizeof(GLNVGpath), sizes[NVG_MEMORY_RENDER_PATHS], 128);
+	gl->verts = (NVGvertex*)glnvg__shrinkBuffer(gl->verts, &gl->cverts, sizeof(NVGvertex), sizes[NVG_MEMORY_RENDER_VERTS], 4096);
+	gl->uniforms = (unsigned char*)glnvg__shrinkBuffer(gl->uniforms, &gl->cuniforms, gl->fragSize, sizes[NVG_MEMORY_RENDER_UNIFORMS], 128);
+}
+
 static int glnvg__maxVertCount(const NVGpath* paths, int npaths)
 {
 	int i, count = 0;
@@ -4307,10 +7147,28 @@ error:
 	if (gl->ncalls > 0) gl->ncalls--;
 }
 
-static void glnvg__renderTriangles(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor,
-								   const NVGvertex* verts, int nverts, float fringe)
+// Appends the last call to the one before it if both draw triangles with the same state and their vertices
+// are adjacent, so that consecutive text draws with the same paint and scissor become one draw call.
+static void glnvg__mergeTriangles(GLNVGcontext* gl)
+{
+	GLNVGcall* call, *prev;
+	if (gl->ncalls < 2) return;
+	call = &gl->calls[gl->ncalls-1];
+	prev = &gl->calls[gl->ncalls-2];
+	if (prev->type != GLNVG_TRIANGLES || prev->image != call->image ||
+		prev->triangleOffset + prev->triangleCount != call->triangleOffset ||
+		memcmp(&prev->blendFunc, &call->blendFunc, sizeof(GLNVGblend)) != 0 ||
+		prev->uniformOffset + gl->fragSize != call->uniformOffset ||
+		memcmp(nvg__fragUniformPtr(gl, prev->uniformOffset), nvg__fragUniformPtr(gl, call->uniformOffset), sizeof(GLNVGfragUniforms)) != 0)
+		return;
+	prev->triangleCount += call->triangleCount;
+	gl->nuniforms--;
+	gl->ncalls--;
+}
+
+static void glnvg__addTriangles(GLNVGcontext* gl, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor,
+								const NVGvertex* verts, int nverts, float fringe, float sdfWidth)
 {
-	GLNVGcontext* gl = (GLNVGcontext*)uptr;
 	GLNVGcall* call = glnvg__allocCall(gl);
 	GLNVGfragUniforms* frag;
 
@@ -4333,7 +7191,17 @@ static void glnvg__renderTriangles(void* uptr, NVGpaint* paint, NVGcompositeOper
 	frag = nvg__fragUniformPtr(gl, call->uniformOffset);
 	glnvg__convertPaint(gl, frag, paint, scissor, 1.0f, fringe, -1.0f);
 	frag->type = NSVG_SHADER_IMG;
+	if (sdfWidth > 0.0f) {
+		// Distance field text, radius holds the half width of the edge in field units.
+		frag->radius = sdfWidth;
+		#if NANOVG_GL_USE_UNIFORMBUFFER
+		frag->texType = 3;
+		#else
+		frag->texType = 3.0f;
+		#endif
+	}
 
+	glnvg__mergeTriangles(gl);
 	return;
 
 error:
@@ -4342,6 +7210,18 @@ error:
 	if (gl->ncalls > 0) gl->ncalls--;
 }
 
+static void glnvg__renderTriangles(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor,
+								   const NVGvertex* verts, int nverts, float fringe)
+{
+	glnvg__addTriangles((GLNVGcontext*)uptr, paint, compositeOperation, scissor, verts, nverts, fringe, 0.0f);
+}
+
+static void glnvg__renderSDFTriangles(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor,
+									  const NVGvertex* verts, int nverts, float fringe, float sdfWidth)
+{
+	glnvg__addTriangles((GLNVGcontext*)uptr, paint, compositeOperation, scissor, verts, nverts, fringe, sdfWidth);
+}
+
 static void glnvg__renderDelete(void* uptr)
 {
 	GLNVGcontext* gl = (GLNVGcontext*)uptr;
@@ -4390,8 +7270,12 @@ NVGcontext* nvgCreateGLES3(int flags)
 	params.renderStroke = glnvg__renderStroke;
 	params.renderTriangles = glnvg__renderTriangles;
 	params.renderDelete = glnvg__renderDelete;
+	params.renderMemoryStats = glnvg__renderMemoryStats;
+	params.renderTrimMemory = glnvg__renderTrimMemory;
+	params.renderSDFTriangles = glnvg__renderSDFTriangles;
 	params.userPtr = gl;
 	params.edgeAntiAlias = flags & NVG_ANTIALIAS ? 1 : 0;
+	params.fontAtlasMaxRects = flags & NVG_FONT_MAXRECTS ? 1 : 0;
 
 	gl->flags = flags;
 
@@ -1001,6 +1001,17 @@ enum NVGlineCap {
 	NVG_MITER,
 };
 
+enum NVGsimplify {
+	NVG_SIMPLIFY_NONE,
+	NVG_SIMPLIFY_MINMAX,
+	NVG_SIMPLIFY_RDP,
+};
+
+enum NVGtextRasterizer {
+	NVG_RASTER_SCANLINE,	// Scanline rasterizer of the font backend.
+	NVG_RASTER_COVERAGE,	// Signed area coverage summed along rows, faster for large glyphs.
+};
+
 enum NVGalign {
 	// Horizontal align
 	NVG_ALIGN_LEFT 		= 1<<0,	// Default, align text horizontally to left.
@@ -1065,6 +1076,16 @@ struct NVGtextRow {
 };
 typedef struct NVGtextRow NVGtextRow;
 
+typedef struct NVGparagraph NVGparagraph;
+typedef struct NVGdocument NVGdocument;
+
+struct NVGgridCell {
+	unsigned int codepoint;	// Codepoint of the glyph, zero and space draw only the background.
+	unsigned char fg, bg;	// Palette indices of the glyph and background colors.
+};
+typedef struct NVGgridCell NVGgridCell;
+typedef struct NVGgrid NVGgrid;
+
 enum NVGimageFlags {
     NVG_IMAGE_GENERATE_MIPMAPS	= 1<<0,     // Generate mipmaps during creation of the image.
 	NVG_IMAGE_REPEATX			= 1<<1,		// Repeat image in X direction.
@@ -1151,6 +1172,7 @@ NVGcolor nvgHSLA(float h, float s, float l, unsigned char a);
 
 // Pushes and saves the current render state into a state stack.
 // A matching nvgRestore() must be used to restore the state.
+// The stack grows as needed, parts of the state are copied only when they are changed after the save.
 void nvgSave(NVGcontext* ctx);
 
 // Pops and restores current render state.
@@ -1198,6 +1220,13 @@ void nvgLineCap(NVGcontext* ctx, int cap);
 // Can be one of NVG_MITER (default), NVG_ROUND, NVG_BEVEL.
 void nvgLineJoin(NVGcontext* ctx, int join);
 
+// Sets polyline simplification applied to the flattened paths of nvgFill() and nvgStroke().
+// Mode can be one of NVG_SIMPLIFY_NONE (default), NVG_SIMPLIFY_MINMAX or NVG_SIMPLIFY_RDP.
+// NVG_SIMPLIFY_MINMAX is meant for x-monotonic data series, it keeps the first, last, min and max
+// point of each column of width tolerance. NVG_SIMPLIFY_RDP uses Ramer-Douglas-Peucker with tolerance
+// as maximum distance. Tolerance is in device pixels, values up to 1.0 keep the result visually unchanged.
+void nvgPathSimplify(NVGcontext* ctx, int mode, float tolerance);
+
 // Sets the transparency applied to all rendered shapes.
 // Already transparent paths will get proportionally more transparent as well.
 void nvgGlobalAlpha(NVGcontext* ctx, float alpha);
@@ -1251,6 +1280,13 @@ void nvgScale(NVGcontext* ctx, float x, float y);
 // There should be space for 6 floats in the return buffer for the values a-f.
 void nvgCurrentTransform(NVGcontext* ctx, float* xform);
 
+// Pushes the current transform into a transform stack which is separate from the state stack.
+// Cheaper than nvgSave() when only the transform changes. A matching nvgPopTransform() must be used.
+void nvgPushTransform(NVGcontext* ctx);
+
+// Pops and restores the transform pushed by nvgPushTransform().
+void nvgPopTransform(NVGcontext* ctx);
+
 
 // The following functions can be used to make calculations on 2x3 transformation matrices.
 // A 2x3 matrix is represented as float[6].
@@ -1373,6 +1409,13 @@ void nvgIntersectScissor(NVGcontext* ctx, float x, float y, float w, float h);
 // Reset and disables scissoring.
 void nvgResetScissor(NVGcontext* ctx);
 
+// Pushes the current scissor into a scissor stack which is separate from the state stack.
+// A matching nvgPopScissor() must be used.
+void nvgPushScissor(NVGcontext* ctx);
+
+// Pops and restores the scissor pushed by nvgPushScissor().
+void nvgPopScissor(NVGcontext* ctx);
+
 //
 // Paths
 //
@@ -1477,6 +1520,7 @@ void nvgStroke(NVGcontext* ctx);
 // Note: currently only solid color fill is supported for text.
 
 // Creates font by loading it from the disk from specified file name.
+// The file is memory mapped where possible, so that it is read in lazily and shared between processes.
 // Returns handle to the font.
 int nvgCreateFont(NVGcontext* ctx, const char* name, const char* filename);
 
@@ -1493,6 +1537,10 @@ int nvgCreateFontMemAtIndex(NVGcontext* ctx, const char* name, unsigned char* da
 // Finds a loaded font of specified name, and returns handle to it, or -1 if the font is not found.
 int nvgFindFont(NVGcontext* ctx, const char* name);
 
+// Returns bytes of font files mapped into memory and how many of them are resident,
+// and bytes of fonts read into or created from memory buffers.
+void nvgFontMemory(NVGcontext* ctx, size_t* mapped, size_t* resident, size_t* heap);
+
 // Adds a fallback font by handle.
 int nvgAddFallbackFontId(NVGcontext* ctx, int baseFont, int fallbackFont);
 
@@ -1505,6 +1553,51 @@ void nvgResetFallbackFontsId(NVGcontext* ctx, int baseFont);
 // Resets fallback fonts by name.
 void nvgResetFallbackFonts(NVGcontext* ctx, const char* baseFont);
 
+// Renders the font by handle from signed distance field glyphs, which are rasterized once and shared by all sizes and blurs.
+// Returns 0 if the render back-end does not support distance field text.
+int nvgFontSDFId(NVGcontext* ctx, int font, int enabled);
+
+// Renders the font by name from signed distance field glyphs.
+int nvgFontSDF(NVGcontext* ctx, const char* name, int enabled);
+
+// Rasterizes glyphs at 1 to 4 horizontal subpixel phases, 1 by default. More phases place glyphs closer to their
+// fractional positions and stop rounding advances, at the cost of up to that many atlas bitmaps per glyph.
+// Returns the number of phases used.
+int nvgTextSubpixel(NVGcontext* ctx, int phases);
+
+// Returns the number of phases and fills, for up to maxPhases phases, the glyphs in the font atlas and their area in pixels.
+int nvgTextSubpixelUsage(NVGcontext* ctx, int* glyphs, int* area, int maxPhases);
+
+// Rasterizes glyphs at perOctave sizes per doubling of the font size and scales them to the size drawn,
+// so that zooming text reuses glyphs at the cost of slight blur. 0 disables bucketing, which is the default.
+// Can be switched at any time.
+void nvgTextSizeBuckets(NVGcontext* ctx, int perOctave);
+
+// Selects the rasterizer of glyphs rasterized from now on, one of NVGtextRasterizer. Glyphs already in the
+// font atlas are kept. Returns the rasterizer used, the coverage rasterizer is not available with FreeType.
+int nvgTextRasterizer(NVGcontext* ctx, int rasterizer);
+
+// Starts or stops threads rasterizing glyphs, returns the number of workers running.
+int nvgTextWorkers(NVGcontext* ctx, int nworkers);
+
+// When enabled, glyphs missing from the atlas are rasterized by the workers and draw empty until ready.
+void nvgTextAsync(NVGcontext* ctx, int enabled);
+
+// Rasterizes glyphs of the font for the sizes and codepoint ranges, given as pairs of first and last codepoint.
+// The glyphs are done on the workers if there are any. Returns the number of glyphs requested.
+int nvgTextPrewarm(NVGcontext* ctx, int font, const float* sizes, int nsizes, const unsigned int* ranges, int nranges);
+
+// Returns the number of glyphs the workers have not finished yet.
+int nvgTextPendingGlyphs(NVGcontext* ctx);
+
+// Writes the font atlas and glyph tables to a cache file, returns 0 on failure.
+int nvgSaveFontCache(NVGcontext* ctx, const char* path);
+
+// Fills the font atlas from a cache file written by nvgSaveFontCache, so that glyphs of the fonts
+// loaded the same way need not be rasterized again. Call outside of a frame, after creating the fonts.
+// Returns the number of fonts restored, or -1 if the file cannot be used.
+int nvgLoadFontCache(NVGcontext* ctx, const char* path);
+
 // Sets the font size of current text style.
 void nvgFontSize(NVGcontext* ctx, float size);
 
@@ -1558,6 +1651,286 @@ void nvgTextMetrics(NVGcontext* ctx, float* ascender, float* descender, float* l
 // Words longer than the max width are slit at nearest character (i.e. no hyphenation).
 int nvgTextBreakLines(NVGcontext* ctx, const char* string, const char* end, float breakRowWidth, NVGtextRow* rows, int maxRows);
 
+//
+// Paragraphs
+//
+// A paragraph keeps the rows and glyph positions of a wrapped text between frames, so that drawing,
+// measuring and caret queries do not break and lay out the text again. The paragraph is laid out
+// with the current text style on first use, and again only when the text, the width or the font,
+// size, letter spacing, blur or vertical alignment changes. After a text edit, the rows before
+// the edited one are kept, and the rows after it are reused once the new rows line up with them.
+// Horizontal alignment and line height are applied when drawing, as in nvgTextBox().
+// Byte offsets refer to the paragraph text.
+
+// Creates an empty paragraph. Returns NULL on failure.
+NVGparagraph* nvgCreateParagraph(void);
+
+// Deletes the paragraph.
+void nvgDeleteParagraph(NVGparagraph* para);
+
+// Sets the text of the paragraph. If end is specified only the sub-string is used. Returns 0 on failure.
+int nvgParagraphSetText(NVGparagraph* para, const char* string, const char* end);
+
+// Sets the width at which the rows are wrapped.
+void nvgParagraphSetWidth(NVGparagraph* para, float breakRowWidth);
+
+// Draws the paragraph at specified location, like nvgTextBox().
+void nvgParagraph(NVGcontext* ctx, NVGparagraph* para, float x, float y);
+
+// Measures the paragraph at specified location, like nvgTextBoxBounds().
+void nvgParagraphBounds(NVGcontext* ctx, NVGparagraph* para, float x, float y, float* bounds);
+
+// Returns the number of rows in the paragraph, and copies up to maxRows of them to rows.
+// The row pointers are valid until the text of the paragraph is changed.
+int nvgParagraphRows(NVGcontext* ctx, NVGparagraph* para, NVGtextRow* rows, int maxRows);
+
+// Calculates the glyph positions of the specified row of the paragraph drawn at x.
+int nvgParagraphGlyphPositions(NVGcontext* ctx, NVGparagraph* para, int row, float x, NVGglyphPosition* positions, int maxPositions);
+
+// Returns the row of the caret at the specified byte offset and its position in cx and cy,
+// where cy is the y of the row as passed to nvgText(). Returns -1 if the paragraph is empty.
+int nvgParagraphCaret(NVGcontext* ctx, NVGparagraph* para, float x, float y, int offset, float* cx, float* cy);
+
+// Returns the byte offset of the caret position closest to the point (px,py).
+int nvgParagraphHitTest(NVGcontext* ctx, NVGparagraph* para, float x, float y, float px, float py);
+
+//
+// Documents
+//
+// A document holds a large text as lines, and keeps an index of the number of wrapped rows
+// of each line, so that drawing and queries only lay out the rows they touch. Lines added or
+// changed since the last call are wrapped on the next call, all lines are wrapped again when
+// the width or the font, size or letter spacing changes. Lines are wrapped at the font size in
+// local units, so changing the transform or the device pixel ratio does not wrap them again.
+// Finding the row of a line, the line of a row and the row at a position take logarithmic time.
+// All rows have the same height.
+// If the width is zero or less the lines are not wrapped and are aligned like nvgText(),
+// otherwise they are wrapped and aligned like nvgTextBox().
+
+// Creates an empty document. Returns NULL on failure.
+NVGdocument* nvgCreateDocument(void);
+
+// Deletes the document.
+void nvgDeleteDocument(NVGdocument* doc);
+
+// Appends text to the end of the document, new-line characters start new lines. Returns 0 on failure.
+int nvgDocumentAppend(NVGdocument* doc, const char* string, const char* end);
+
+// Replaces the text of a line, text after a new-line character is inserted as new lines below it.
+// Returns 0 on failure.
+int nvgDocumentSetLine(NVGdocument* doc, int line, const char* string, const char* end);
+
+// Inserts text as new lines before a line, or at the end if line is the line count. New-line
+// characters separate the lines, a new-line at the end of the text does not start another line.
+// Returns 0 on failure.
+int nvgDocumentInsertLines(NVGdocument* doc, int line, const char* string, const char* end);
+
+// Deletes count lines starting at a line. Returns 0 on failure.
+int nvgDocumentDeleteLines(NVGdocument* doc, int line, int count);
+
+// Returns the number of lines in the document.
+int nvgDocumentLineCount(NVGdocument* doc);
+
+// Returns the text of a line and its end in end, or NULL if there is no such line.
+const char* nvgDocumentLine(NVGdocument* doc, int line, const char** end);
+
+// Sets the width at which the lines are wrapped.
+void nvgDocumentSetWidth(NVGdocument* doc, float breakRowWidth);
+
+// Draws the rows of the document which are visible in the current scissor and viewport.
+// The first row is drawn at (x,y), like nvgText().
+void nvgDocument(NVGcontext* ctx, NVGdocument* doc, float x, float y);
+
+// Returns the number of rows in the document.
+int nvgDocumentRowCount(NVGcontext* ctx, NVGdocument* doc);
+
+// Returns the distance between rows, the y of a row is y + row * row height.
+float nvgDocumentRowHeight(NVGcontext* ctx, NVGdocument* doc);
+
+// Returns the first row of a line.
+int nvgDocumentLineRow(NVGcontext* ctx, NVGdocument* doc, int line);
+
+// Returns the line of a row, and the index of the row within the line in rowInLine.
+int nvgDocumentRowLine(NVGcontext* ctx, NVGdocument* doc, int row, int* rowInLine);
+
+// Returns the byte offset in the line of the caret position closest to the point (px,py),
+// and the line in line, for the document drawn at (x,y).
+int nvgDocumentHitTest(NVGcontext* ctx, NVGdocument* doc, float x, float y, float px, float py, int* line);
+
+//
+// Cell grids
+//
+// A grid draws a rows x cols buffer of cells with the current font face and size, for terminal
+// and code views with monospace fonts. Every cell has the advance of the 'M' glyph rounded to whole
+// pixels and the rows are one line height apart, there is no kerning or letter spacing. The backgrounds
+// and glyphs of all cells are drawn with one draw call per palette color used, backgrounds first.
+// Only the rows changed since the last draw are laid out again, and an unchanged grid drawn at
+// the same place reuses the vertices of the last draw. Scrolling keeps the layout of the rows.
+// Palette index 0 is the default background and is transparent, the other indices are white.
+
+// Creates a grid of empty cells. Returns NULL on failure.
+NVGgrid* nvgCreateGrid(int rows, int cols);
+
+// Deletes the grid.
+void nvgDeleteGrid(NVGgrid* grid);
+
+// Sets a palette color.
+void nvgGridSetPalette(NVGgrid* grid, int index, NVGcolor color);
+
+// Sets a cell.
+void nvgGridSetCell(NVGgrid* grid, int row, int col, unsigned int codepoint, int fg, int bg);
+
+// Sets up to ncells cells of a row from its first column.
+void nvgGridSetRow(NVGgrid* grid, int row, const NVGgridCell* cells, int ncells);
+
+// Returns the cells of a row, or NULL if there is no such row.
+const NVGgridCell* nvgGridGetRow(NVGgrid* grid, int row);
+
+// Scrolls the contents of the grid up by n rows, or down if n is negative. The rows scrolled in are empty.
+void nvgGridScroll(NVGgrid* grid, int n);
+
+// Draws the grid with the top-left corner of the first cell at (x,y).
+void nvgGrid(NVGcontext* ctx, NVGgrid* grid, float x, float y);
+
+// Returns the size of a cell in local coordinate space.
+void nvgGridCellSize(NVGcontext* ctx, NVGgrid* grid, float* w, float* h);
+
+//
+// Memory management
+//
+// The per-frame buffers grow to fit the largest frame. Memory stats can be used to
+// track the usage, and a memory budget can be set to release memory after spikes.
+
+enum NVGmemoryBuffers {
+	NVG_MEMORY_COMMANDS,
+	NVG_MEMORY_POINTS,
+	NVG_MEMORY_PATHS,
+	NVG_MEMORY_VERTS,
+	NVG_MEMORY_STATES,
+	NVG_MEMORY_RENDER_CALLS,
+	NVG_MEMORY_RENDER_PATHS,
+	NVG_MEMORY_RENDER_VERTS,
+	NVG_MEMORY_RENDER_UNIFORMS,
+	NVG_MEMORY_FONT_ATLAS,		// CPU copy of the font atlas.
+	NVG_MEMORY_TEXTURES,		// Textures allocated by the render backend.
+	NVG_MEMORY_BUFFER_COUNT
+};
+
+struct NVGmemoryBuffer {
+	int current;				// Bytes used during the last frame.
+	int peak;					// Most bytes used during any frame.
+	int capacity;				// Bytes allocated.
+};
+typedef struct NVGmemoryBuffer NVGmemoryBuffer;
+
+struct NVGmemoryStats {
+	NVGmemoryBuffer buffers[NVG_MEMORY_BUFFER_COUNT];
+	int capacity;				// Sum of buffer capacities in bytes.
+	int budget;					// Memory budget in bytes, 0 if not set.
+	int trimCount;				// Number of times the buffers have been trimmed.
+};
+typedef struct NVGmemoryStats NVGmemoryStats;
+
+// Returns current memory usage of the context and the render backend.
+void nvgGetMemoryStats(NVGcontext* ctx, NVGmemoryStats* stats);
+
+struct NVGtextStats {
+	int glyphs;					// Glyphs passed to nvgText during the last frame.
+	int culledGlyphs;			// Glyphs skipped because they were outside the scissor or the viewport.
+};
+typedef struct NVGtextStats NVGtextStats;
+
+// Returns how many glyphs nvgText drew and culled in the last frame.
+void nvgGetTextStats(NVGcontext* ctx, NVGtextStats* stats);
+
+// The counters wrap around, the difference between two reads is correct modulo 2^32.
+struct NVGglyphStats {
+	unsigned int hits;			// Glyphs drawn from the font atlas.
+	unsigned int misses;		// Glyphs drawn which were not in the atlas.
+	unsigned int rasterized;	// Glyph bitmaps rasterized.
+	unsigned int evicted;		// Glyph bitmaps thrown out of the atlas.
+	int glyphs;					// Glyphs in the atlas.
+	int atlasBytes;				// Atlas area used by the glyphs, in bytes.
+	unsigned int lookups;		// Glyph hash lookups.
+	unsigned int probes;		// Hash slots visited by the lookups, probes / lookups is the mean probe length.
+	int maxProbe;				// Longest probe sequence of a lookup.
+	int hashSlots;				// Slots of the glyph hash.
+};
+typedef struct NVGglyphStats NVGglyphStats;
+
+// Returns glyph cache counters of the font since it was created, or their sum over all fonts if font is -1.
+void nvgGetGlyphStats(NVGcontext* ctx, int font, NVGglyphStats* stats);
+
+struct NVGfontAtlasStats {
+	int pages;					// Pages the font atlas is packed and evicted by.
+	int area;					// Pixels of the atlas.
+	int used;					// Pixels covered by glyphs.
+	int free;					// Pixels where glyphs can still be placed.
+	int largestFree;			// Area of the largest free rectangle, fragmentation is 1 - largestFree / free.
+	int freeRects;				// Free spans or rectangles tracked by the packer.
+};
+typedef struct NVGfontAtlasStats NVGfontAtlasStats;
+
+// Returns occupancy and fragmentation of the current font atlas.
+void nvgGetFontAtlasStats(NVGcontext* ctx, NVGfontAtlasStats* stats);
+
+struct NVGtextUploadStats {
+	int uploads;				// Font atlas texture updates during the last frame.
+	int bytes;					// Bytes uploaded during the last frame.
+	int peakBytes;				// Most bytes uploaded during any frame.
+};
+typedef struct NVGtextUploadStats NVGtextUploadStats;
+
+// Returns how much of the font atlas was uploaded to the render backend. Changed areas of the atlas
+// are uploaded once per frame in nvgEndFrame.
+void nvgGetTextUploadStats(NVGcontext* ctx, NVGtextUploadStats* stats);
+
+// Sets memory budget in bytes, 0 disables the budget. When the total capacity has stayed over
+// the budget for trimFrames frames, the per-frame buffers are shrunk to fit the largest usage
+// during those frames. The font atlas and textures are counted, but not trimmed.
+void nvgMemoryBudget(NVGcontext* ctx, int budget, int trimFrames);
+
+//
+// Quality governor
+//
+// The quality governor trades rendering quality for speed when frames take longer than
+// the frame budget, and restores the quality when there is headroom again. Each level
+// doubles the tessellation tolerances, from level 2 on text is drawn without blur and
+// from level 3 on edge antialiasing is turned off. Changes take effect on the next nvgBeginFrame().
+
+#define NVG_QUALITY_MAX_LEVEL 4
+
+enum NVGqualityFlags {
+	NVG_QUALITY_TESSELLATION	= 1<<0,	// Coarser curve tessellation.
+	NVG_QUALITY_ROUND_JOINS		= 1<<1,	// Fewer divisions for round joins and caps.
+	NVG_QUALITY_TEXT_BLUR		= 1<<2,	// Draw blurred text without blur.
+	NVG_QUALITY_ANTIALIAS		= 1<<3,	// Turn off edge antialiasing.
+	NVG_QUALITY_ALL				= 0x0f,
+};
+
+struct NVGqualityChange {
+	int frame;					// Frame number, as counted by nvgQualityFrameTime().
+	int level;					// New quality level, 0 is full quality.
+	float frameTime;			// Average frame time which caused the change, 0 if set by nvgQualityGovernor().
+};
+typedef struct NVGqualityChange NVGqualityChange;
+
+// Enables the quality governor. Frame budget is in seconds, 0 disables the governor and restores full quality.
+// Max level limits how far the quality may be lowered, flags select which knobs may be
+// turned, and should be combination of NVGqualityFlags.
+void nvgQualityGovernor(NVGcontext* ctx, float frameBudget, int maxLevel, int flags);
+
+// Reports the duration of the last frame in seconds to the quality governor.
+// Usually the same frame time that is used to update the performance graphs.
+void nvgQualityFrameTime(NVGcontext* ctx, float frameTime);
+
+// Returns current quality level, 0 is full quality.
+int nvgQualityLevel(NVGcontext* ctx);
+
+// Copies at most maxChanges of the latest quality level changes, oldest first.
+// Returns number of changes copied.
+int nvgQualityHistory(NVGcontext* ctx, NVGqualityChange* changes, int maxChanges);
+
 //
 // Internal Render API
 //
@@ -1594,6 +1967,7 @@ typedef struct NVGpath NVGpath;
 struct NVGparams {
 	void* userPtr;
 	int edgeAntiAlias;
+	int fontAtlasMaxRects;
 	int (*renderCreate)(void* uptr);
 	int (*renderCreateTexture)(void* uptr, int type, int w, int h, int imageFlags, const unsigned char* data);
 	int (*renderDeleteTexture)(void* uptr, int image);
@@ -1606,6 +1980,9 @@ struct NVGparams {
 	void (*renderStroke)(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor, float fringe, float strokeWidth, const NVGpath* paths, int npaths);
 	void (*renderTriangles)(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor, const NVGvertex* verts, int nverts, float fringe);
 	void (*renderDelete)(void* uptr);
+	void (*renderMemoryStats)(void* uptr, NVGmemoryBuffer* buffers);
+	void (*renderTrimMemory)(void* uptr, const int* sizes);
+	void (*renderSDFTriangles)(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor, const NVGvertex* verts, int nverts, float fringe, float sdfWidth);
 };
 typedef struct NVGparams NVGparams;
 
@@ -1642,6 +2019,9 @@ enum NVGcreateFlags {
 	NVG_STENCIL_STROKES = 1<<1,
 	// Flag indicating that additional debug checks are done.
 	NVG_DEBUG = 1<<2,
+	// Flag indicating that glyphs are packed into the font atlas with MaxRects instead of a skyline,
+	// which fits more glyphs per atlas page at a somewhat higher cost per new glyph.
+	NVG_FONT_MAXRECTS = 1<<3,
 };
 
 // Define VTable with pointers to the functions for a each OpenGL (ES) version.